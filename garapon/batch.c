@@ -0,0 +1,227 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "engine.h"
+
+/*
+ * Scripted draws without the terminal.  Draws are made BATCH_CHUNK at a
+ * time with draw_lines() and formatted straight into a buffer that goes
+ * out with one write(2) whenever it is nearly full.  Only the first few
+ * draws are written as soon as they are made, so that a reader sees a
+ * result without waiting for the buffer to fill.
+ *
+ * The binary format is a header followed by one record per draw: the
+ * main numbers and then the bonus numbers, one byte each.  NDJSON has
+ * one object per draw:
+ *
+ *	{"draw":1,"main":[3,14,15,26,35],"bonus":[9]}
+ */
+
+struct batch_filehdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t game;
+	uint32_t main;
+	uint32_t bonus;
+	uint64_t draws;
+};
+
+/* the longest record of a draw */
+#define RECORD_MAX (64 + 4 * (GAME_MAXPICK + GAME_MAXBONUS))
+/* draws in the first chunk, which is written out at once */
+#define FIRST_CHUNK 64
+
+struct out {
+	int fd;
+	size_t len;
+	char *buf;
+};
+
+int
+batch_format(const char *name)
+{
+	if (strcmp(name, "ndjson") == 0)
+		return BATCH_NDJSON;
+	if (strcmp(name, "bin") == 0)
+		return BATCH_BIN;
+	return -1;
+}
+
+static int
+flush(struct out *o)
+{
+	ssize_t w;
+	size_t off;
+
+	for (off = 0; off < o->len; off += w) {
+		if ((w = write(o->fd, o->buf + off, o->len - off)) == -1) {
+			if (errno == EINTR) {
+				w = 0;
+				continue;
+			}
+			return -1;
+		}
+	}
+	o->len = 0;
+	return 0;
+}
+
+static char *
+putnum(char *p, uint64_t n)
+{
+	char tmp[20];
+	int i;
+
+	i = 0;
+	do {
+		tmp[i++] = '0' + n % 10;
+		n /= 10;
+	} while (n != 0);
+	while (i > 0)
+		*p++ = tmp[--i];
+	return p;
+}
+
+static char *
+putlist(char *p, const char *key, size_t klen, const int *v, int n)
+{
+	int i;
+
+	memcpy(p, key, klen);
+	p += klen;
+	for (i = 0; i < n; ++i) {
+		if (i > 0)
+			*p++ = ',';
+		p = putnum(p, v[i]);
+	}
+	*p++ = ']';
+	return p;
+}
+
+static void
+ndjson(struct out *o, const struct game *g, const vector main,
+    const vector bonus, uint64_t draw)
+{
+	char *p;
+
+	p = o->buf + o->len;
+	memcpy(p, "{\"draw\":", 8);
+	p = putnum(p + 8, draw);
+	p = putlist(p, ",\"main\":[", 9, main, g->sample);
+	if (GAME_BONUS(g) > 0)
+		p = putlist(p, ",\"bonus\":[", 10, bonus, GAME_BONUS(g));
+	*p++ = '}';
+	*p++ = '\n';
+	o->len = p - o->buf;
+}
+
+static void
+binary(struct out *o, const struct game *g, const vector main,
+    const vector bonus)
+{
+	unsigned char *p;
+	int i;
+
+	p = (unsigned char *) o->buf + o->len;
+	for (i = 0; i < g->sample; ++i)
+		*p++ = (unsigned char) main[i];
+	for (i = 0; i < GAME_BONUS(g); ++i)
+		*p++ = (unsigned char) bonus[i];
+	o->len = (char *) p - o->buf;
+}
+
+/*
+ * Writes the results of draws draws of game to fd in the given format.
+ * Returns -1 with errno set when out of memory or when the write fails.
+ */
+int
+batch_run(int fd, int game, uint64_t draws, int format, uint64_t seed)
+{
+	const struct game *g;
+	struct batch_filehdr fh;
+	struct pool pool;
+	struct out o;
+	vector main, bonus;
+	uint64_t done;
+	size_t i, n;
+	int nb, save;
+
+	g = &games[game];
+	nb = GAME_BONUS(g);
+	o.fd = fd;
+	o.len = 0;
+	o.buf = malloc(BATCH_BUFSIZE);
+	main = malloc(BATCH_CHUNK * g->sample * sizeof(int));
+	bonus = malloc(BATCH_CHUNK * MAX(nb, 1) * sizeof(int));
+	if (o.buf == NULL || main == NULL || bonus == NULL)
+		goto fail;
+	pool_seed(&pool, seed, 0);
+
+	if (format == BATCH_BIN) {
+		memset(&fh, 0, sizeof(fh));
+		memcpy(fh.magic, BATCH_MAGIC, sizeof(fh.magic));
+		fh.version = BATCH_VERSION;
+		fh.game = game;
+		fh.main = g->sample;
+		fh.bonus = nb;
+		fh.draws = draws;
+		memcpy(o.buf, &fh, sizeof(fh));
+		o.len = sizeof(fh);
+	}
+	for (done = 0; done < draws; done += n) {
+		n = (size_t) MIN(draws - done,
+		    done == 0 ? FIRST_CHUNK : BATCH_CHUNK);
+		draw_lines(g, &pool, main, bonus, n);
+		for (i = 0; i < n; ++i) {
+			if (o.len + RECORD_MAX > BATCH_BUFSIZE &&
+			    flush(&o) == -1)
+				goto fail;
+			if (format == BATCH_BIN)
+				binary(&o, g, main + i * g->sample,
+				    bonus + i * nb);
+			else
+				ndjson(&o, g, main + i * g->sample,
+				    bonus + i * nb, done + i + 1);
+		}
+		if (done == 0 && flush(&o) == -1)
+			goto fail;
+	}
+	if (flush(&o) == -1)
+		goto fail;
+	free(o.buf);
+	free(main);
+	free(bonus);
+	return 0;
+fail:
+	save = errno;
+	free(o.buf);
+	free(main);
+	free(bonus);
+	errno = save;
+	return -1;
+}
@@ -0,0 +1,21 @@
+/* batch.h */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+
+#define BATCH_MAGIC "GRPNDRAW"
+#define BATCH_VERSION 1
+#define BATCH_CHUNK 4096
+#define BATCH_BUFSIZE (1 << 20)
+
+enum {
+	BATCH_NDJSON,
+	BATCH_BIN
+};
+
+int batch_format(const char *name);
+int batch_run(int fd, int game, uint64_t draws, int format, uint64_t seed);
+
+#endif /* BATCH_H */
@@ -0,0 +1,332 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bcast.h"
+
+/*
+ * A broadcast segment is a POSIX shared memory object holding a header
+ * and a ring of BCAST_SLOTS draws.  There is one writer, kept unique by
+ * an exclusive flock on the segment, and any number of readers that
+ * never write to it.  Each slot carries its own sequence lock: while
+ * draw n is being written the lock is 2n - 1, afterwards 2n.  A reader
+ * wanting draw n waits for 2n, reads, and checks the lock again; a
+ * larger value means the writer lapped it and the draws in between are
+ * counted as lost.  head is the number of draws published so far.
+ */
+
+#define BCAST_MAGIC "GRPNBCST"
+#define BCAST_VERSION 1
+#define BCAST_LINE 64
+
+struct bcast_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t slots;
+	uint32_t slotsize;
+	uint32_t pad;
+	_Alignas(BCAST_LINE) _Atomic uint64_t head;
+};
+
+struct bcast_slot {
+	_Alignas(BCAST_LINE) _Atomic uint64_t lock;
+	struct bcast_draw d;
+};
+
+struct bcast_map {
+	struct bcast_header *hdr;
+	struct bcast_slot *slot;
+	size_t len;
+	int fd;
+};
+
+struct bcast {
+	struct bcast_map m;
+};
+
+struct bcast_sub {
+	struct bcast_map m;
+	uint64_t next;
+	uint64_t lost;
+};
+
+#define BCAST_SIZE \
+	(sizeof(struct bcast_header) + \
+	 (size_t) BCAST_SLOTS * sizeof(struct bcast_slot))
+
+static int
+map(struct bcast_map *m, const char *name, int writer)
+{
+	struct stat st;
+	int e;
+
+	m->len = BCAST_SIZE;
+	m->fd = shm_open(name, writer ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+	if (m->fd == -1)
+		return -1;
+	if (writer) {
+		if (flock(m->fd, LOCK_EX | LOCK_NB) == -1)
+			goto bad;
+		if (fstat(m->fd, &st) == -1)
+			goto bad;
+		if ((size_t) st.st_size != m->len &&
+		    ftruncate(m->fd, (off_t) m->len) == -1)
+			goto bad;
+	} else {
+		if (fstat(m->fd, &st) == -1)
+			goto bad;
+		if ((size_t) st.st_size != m->len) {
+			errno = EINVAL;
+			goto bad;
+		}
+	}
+	m->hdr = (struct bcast_header *) mmap(NULL, m->len,
+	    writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m->fd, 0);
+	if (m->hdr == MAP_FAILED)
+		goto bad;
+	m->slot = (struct bcast_slot *) (m->hdr + 1);
+	return 0;
+
+bad:
+	e = errno;
+	close(m->fd);
+	errno = e;
+	return -1;
+}
+
+static void
+unmap(struct bcast_map *m)
+{
+	munmap(m->hdr, m->len);
+	close(m->fd);
+}
+
+static int
+valid(const struct bcast_header *h)
+{
+	return memcmp(h->magic, BCAST_MAGIC, 8) == 0 &&
+	    h->version == BCAST_VERSION && h->slots == BCAST_SLOTS &&
+	    h->slotsize == sizeof(struct bcast_slot);
+}
+
+/*
+ * Opens the segment name (as for shm_open) for publishing, creating it
+ * if needed.  A segment left by an earlier writer keeps its sequence,
+ * so readers carry on across a restart.
+ */
+struct bcast *
+bcast_create(const char *name)
+{
+	struct bcast *b;
+	int e;
+
+	if ((b = (struct bcast *) malloc(sizeof(*b))) == NULL)
+		return NULL;
+	if (map(&b->m, name, 1) == -1) {
+		e = errno;
+		free(b);
+		errno = e;
+		return NULL;
+	}
+	if (!valid(b->m.hdr)) {
+		memset(b->m.hdr, 0, b->m.len);
+		b->m.hdr->version = BCAST_VERSION;
+		b->m.hdr->slots = BCAST_SLOTS;
+		b->m.hdr->slotsize = sizeof(struct bcast_slot);
+		atomic_thread_fence(memory_order_release);
+		memcpy(b->m.hdr->magic, BCAST_MAGIC, 8);
+	}
+	return b;
+}
+
+int
+bcast_publish(struct bcast *b, int game, const int *main, int nmain,
+    const int *bonus, int nbonus)
+{
+	struct bcast_slot *sl;
+	struct timespec ts;
+	uint64_t n;
+	int i;
+
+	if (nmain < 0 || nmain > BCAST_MAXPICK ||
+	    nbonus < 0 || nbonus > BCAST_MAXBONUS) {
+		errno = EINVAL;
+		return -1;
+	}
+	clock_gettime(CLOCK_REALTIME, &ts);
+	n = atomic_load_explicit(&b->m.hdr->head, memory_order_relaxed) + 1;
+	sl = &b->m.slot[n & (BCAST_SLOTS - 1)];
+
+	atomic_store_explicit(&sl->lock, 2 * n - 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memset(&sl->d, 0, sizeof(sl->d));
+	sl->d.seq = n;
+	sl->d.stamp = (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	sl->d.game = game;
+	sl->d.nmain = nmain;
+	sl->d.nbonus = nbonus;
+	for (i = 0; i < nmain; ++i)
+		sl->d.main[i] = main[i];
+	for (i = 0; i < nbonus; ++i)
+		sl->d.bonus[i] = bonus[i];
+	atomic_store_explicit(&sl->lock, 2 * n, memory_order_release);
+	atomic_store_explicit(&b->m.hdr->head, n, memory_order_release);
+	return 0;
+}
+
+void
+bcast_close(struct bcast *b)
+{
+	if (b == NULL)
+		return;
+	unmap(&b->m);
+	free(b);
+}
+
+/*
+ * Attaches to a segment read-only.  The first draw returned is the
+ * next one published, or with oldest set the oldest still in the ring.
+ */
+struct bcast_sub *
+bcast_subscribe(const char *name, int oldest)
+{
+	struct bcast_sub *s;
+	uint64_t head;
+	int e;
+
+	if ((s = (struct bcast_sub *) calloc(1, sizeof(*s))) == NULL)
+		return NULL;
+	if (map(&s->m, name, 0) == -1) {
+		e = errno;
+		free(s);
+		errno = e;
+		return NULL;
+	}
+	if (!valid(s->m.hdr)) {
+		unmap(&s->m);
+		free(s);
+		errno = EINVAL;
+		return NULL;
+	}
+	head = atomic_load_explicit(&s->m.hdr->head, memory_order_acquire);
+	if (oldest && head > BCAST_SLOTS)
+		s->next = head - BCAST_SLOTS + 1;
+	else if (oldest)
+		s->next = 1;
+	else
+		s->next = head + 1;
+	return s;
+}
+
+/*
+ * Returns the next draw where it lies in the ring, or NULL when nothing
+ * new has been published.  The draw must be handed back with
+ * bcast_release() before it can be trusted.
+ */
+const struct bcast_draw *
+bcast_peek(struct bcast_sub *s)
+{
+	struct bcast_slot *sl;
+	uint64_t head, lock, next;
+
+	for (;;) {
+		sl = &s->m.slot[s->next & (BCAST_SLOTS - 1)];
+		lock = atomic_load_explicit(&sl->lock, memory_order_acquire);
+		if (lock == 2 * s->next)
+			return &sl->d;
+		if (lock < 2 * s->next)
+			return NULL;
+		/* lapped: skip to the oldest draw still in the ring */
+		head = atomic_load_explicit(&s->m.hdr->head,
+		    memory_order_acquire);
+		next = head - BCAST_SLOTS + 1;
+		if (next <= s->next)
+			next = s->next + 1;
+		s->lost += next - s->next;
+		s->next = next;
+	}
+}
+
+/*
+ * Finishes with a draw from bcast_peek() and moves on.  Returns 0 if
+ * the draw was intact all the while, -1 if the writer overwrote it.
+ */
+int
+bcast_release(struct bcast_sub *s, const struct bcast_draw *d)
+{
+	const struct bcast_slot *sl;
+	uint64_t lock;
+
+	sl = (const struct bcast_slot *) ((const char *) d -
+	    offsetof(struct bcast_slot, d));
+	atomic_thread_fence(memory_order_acquire);
+	lock = atomic_load_explicit(&sl->lock, memory_order_relaxed);
+	if (lock != 2 * s->next++) {
+		++s->lost;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Copies the next intact draw to out.  Returns 1, or 0 when nothing
+ * new has been published.
+ */
+int
+bcast_read(struct bcast_sub *s, struct bcast_draw *out)
+{
+	const struct bcast_draw *d;
+
+	while ((d = bcast_peek(s)) != NULL) {
+		memcpy(out, d, sizeof(*out));
+		if (bcast_release(s, d) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+uint64_t
+bcast_lost(const struct bcast_sub *s)
+{
+	return s->lost;
+}
+
+void
+bcast_unsubscribe(struct bcast_sub *s)
+{
+	if (s == NULL)
+		return;
+	unmap(&s->m);
+	free(s);
+}
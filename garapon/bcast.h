@@ -0,0 +1,41 @@
+/* bcast.h */
+
+#ifndef BCAST_H
+#define BCAST_H
+
+#include <stdint.h>
+
+#define BCAST_SLOTS 4096
+#define BCAST_MAXPICK 7
+#define BCAST_MAXBONUS 2
+
+/*
+ * One published draw.  seq counts the draws of the segment from 1,
+ * stamp is CLOCK_REALTIME in nanoseconds.
+ */
+struct bcast_draw {
+	uint64_t seq;
+	int64_t stamp;
+	int32_t game;
+	int32_t nmain;
+	int32_t nbonus;
+	int32_t main[BCAST_MAXPICK];
+	int32_t bonus[BCAST_MAXBONUS];
+};
+
+struct bcast;
+struct bcast_sub;
+
+struct bcast *bcast_create(const char *name);
+int bcast_publish(struct bcast *b, int game, const int *main, int nmain,
+    const int *bonus, int nbonus);
+void bcast_close(struct bcast *b);
+
+struct bcast_sub *bcast_subscribe(const char *name, int oldest);
+const struct bcast_draw *bcast_peek(struct bcast_sub *s);
+int bcast_release(struct bcast_sub *s, const struct bcast_draw *d);
+int bcast_read(struct bcast_sub *s, struct bcast_draw *out);
+uint64_t bcast_lost(const struct bcast_sub *s);
+void bcast_unsubscribe(struct bcast_sub *s);
+
+#endif /* BCAST_H */
@@ -0,0 +1,207 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ckpt.h"
+
+/*
+ * A checkpoint file holds two copies of a fixed-size payload after a
+ * header page.  A commit always writes the copy that is not the latest,
+ * syncs it, and only then stamps it in the header with a generation and
+ * a checksum, so a crash at any point leaves the previous copy intact.
+ * Opening picks the copy with the highest generation whose checksum
+ * still matches.
+ */
+
+struct ckpt_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t pad;
+	uint64_t size;
+	struct {
+		uint64_t gen;
+		uint64_t sum;
+	} slot[2];
+};
+
+static uint64_t
+checksum(const unsigned char *p, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+		h = (h ^ p[i]) * 0x100000001b3ULL;
+	return h;
+}
+
+static size_t
+roundup_page(size_t n)
+{
+	return (n + CKPT_HEADER - 1) / CKPT_HEADER * CKPT_HEADER;
+}
+
+static unsigned char *
+payload(const struct ckpt *c, int slot)
+{
+	return c->map + CKPT_HEADER + slot * roundup_page(c->size);
+}
+
+static struct ckpt *
+map(int fd, size_t size)
+{
+	struct ckpt *c;
+
+	if ((c = malloc(sizeof(*c))) == NULL)
+		return NULL;
+	c->fd = fd;
+	c->size = size;
+	c->maplen = CKPT_HEADER + 2 * roundup_page(size);
+	c->slot = -1;
+	c->gen = 0;
+	c->map = mmap(NULL, c->maplen, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    fd, 0);
+	if (c->map == MAP_FAILED) {
+		free(c);
+		return NULL;
+	}
+	return c;
+}
+
+struct ckpt *
+ckpt_create(const char *path, size_t size)
+{
+	struct ckpt_hdr *h;
+	struct ckpt *c;
+	int fd, save;
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+		return NULL;
+	if (ftruncate(fd, CKPT_HEADER + 2 * roundup_page(size)) == -1 ||
+	    (c = map(fd, size)) == NULL) {
+		save = errno;
+		close(fd);
+		errno = save;
+		return NULL;
+	}
+	h = (struct ckpt_hdr *) c->map;
+	memcpy(h->magic, CKPT_MAGIC, sizeof(h->magic));
+	h->version = CKPT_VERSION;
+	h->size = size;
+	if (msync(c->map, CKPT_HEADER, MS_SYNC) == -1) {
+		save = errno;
+		ckpt_close(c);
+		errno = save;
+		return NULL;
+	}
+	return c;
+}
+
+struct ckpt *
+ckpt_open(const char *path)
+{
+	struct ckpt_hdr h;
+	struct ckpt *c;
+	struct stat st;
+	int fd, i;
+
+	if ((fd = open(path, O_RDWR)) == -1)
+		return NULL;
+	if (fstat(fd, &st) == -1)
+		goto fail;
+	if (read(fd, &h, sizeof(h)) != (ssize_t) sizeof(h) ||
+	    memcmp(h.magic, CKPT_MAGIC, sizeof(h.magic)) != 0 ||
+	    h.version != CKPT_VERSION ||
+	    (size_t) st.st_size != CKPT_HEADER + 2 * roundup_page(h.size)) {
+		errno = EINVAL;
+		goto fail;
+	}
+	if ((c = map(fd, h.size)) == NULL)
+		goto fail;
+	for (i = 0; i < 2; ++i)
+		if (h.slot[i].gen > c->gen &&
+		    checksum(payload(c, i), c->size) == h.slot[i].sum) {
+			c->slot = i;
+			c->gen = h.slot[i].gen;
+		}
+	return c;
+fail:
+	i = errno;
+	close(fd);
+	errno = i;
+	return NULL;
+}
+
+/*
+ * The latest committed payload, or NULL when nothing has been committed.
+ */
+const void *
+ckpt_last(const struct ckpt *c)
+{
+	return c->slot < 0 ? NULL : payload(c, c->slot);
+}
+
+/*
+ * The payload the next commit will publish.  Its contents are stale
+ * and must be written in full.
+ */
+void *
+ckpt_next(struct ckpt *c)
+{
+	return payload(c, c->slot == 0);
+}
+
+int
+ckpt_commit(struct ckpt *c)
+{
+	struct ckpt_hdr *h;
+	unsigned char *p;
+	int s;
+
+	h = (struct ckpt_hdr *) c->map;
+	s = c->slot == 0;
+	p = payload(c, s);
+	if (msync(p, roundup_page(c->size), MS_SYNC) == -1)
+		return -1;
+	h->slot[s].sum = checksum(p, c->size);
+	h->slot[s].gen = c->gen + 1;
+	if (msync(c->map, CKPT_HEADER, MS_SYNC) == -1)
+		return -1;
+	c->slot = s;
+	++c->gen;
+	return 0;
+}
+
+void
+ckpt_close(struct ckpt *c)
+{
+	munmap(c->map, c->maplen);
+	close(c->fd);
+	free(c);
+}
@@ -0,0 +1,29 @@
+/* ckpt.h */
+
+#ifndef CKPT_H
+#define CKPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CKPT_MAGIC "GRPNCKPT"
+#define CKPT_VERSION 1
+#define CKPT_HEADER 4096
+
+struct ckpt {
+	int fd;
+	unsigned char *map;
+	size_t maplen;
+	size_t size;
+	int slot;
+	uint64_t gen;
+};
+
+struct ckpt *ckpt_create(const char *path, size_t size);
+struct ckpt *ckpt_open(const char *path);
+const void *ckpt_last(const struct ckpt *c);
+void *ckpt_next(struct ckpt *c);
+int ckpt_commit(struct ckpt *c);
+void ckpt_close(struct ckpt *c);
+
+#endif /* CKPT_H */
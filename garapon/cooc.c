@@ -0,0 +1,493 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cooc.h"
+#include "entropy.h"
+
+/*
+ * How often each pair and each triple of main numbers came up together.
+ * Counts are kept packed in colex order: pair a < b (from 0) at
+ * C(b, 2) + a, triple a < b < d at C(d, 3) + C(b, 2) + a, so a game of n
+ * numbers needs C(n, 2) + C(n, 3) counters, under 350 000 for every game
+ * here.
+ *
+ * A draw becomes a bitmask of its numbers and is tallied by walking the
+ * set bits in order, which yields its pairs and triples already sorted.
+ * With five to seven numbers out of dozens this touches 10 to 35
+ * counters a draw; a bit-sliced popcount kernel over batches of draws
+ * would touch all C(n, 3) of them per batch, which costs more until
+ * draws are far denser than lottery draws are.  Draws are tallied into
+ * 32-bit partial counts, small enough to stay in cache, which are
+ * folded into the 64-bit totals every COOC_CHUNK draws.  Simulation
+ * threads each keep their own totals, merged at the end.
+ */
+
+#define C2(n) ((size_t) (n) * ((n) - 1) / 2)
+#define C3(n) ((size_t) (n) * ((n) - 1) * ((n) - 2) / 6)
+
+struct cooc_filehdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t game;
+	uint32_t number;
+	uint32_t pad;
+	uint64_t draws;
+};
+
+struct cooc *
+cooc_new(int game)
+{
+	struct cooc *c;
+	int n;
+
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+		return NULL;
+	c->game = game;
+	c->width = n = games[game].number;
+	c->npair = C2(n);
+	c->ntriple = C3(n);
+	c->single = calloc(n, sizeof(uint64_t));
+	c->pair = calloc(c->npair, sizeof(uint64_t));
+	c->triple = calloc(c->ntriple, sizeof(uint64_t));
+	if (c->single == NULL || c->pair == NULL || c->triple == NULL) {
+		cooc_free(c);
+		return NULL;
+	}
+	return c;
+}
+
+/*
+ * The numbers of a draw in ascending order, from 0, out of its bitmask.
+ */
+static int
+unmask(const vector main, int s, int *v)
+{
+	uint64_t m[2], w;
+	int i, k;
+
+	m[0] = m[1] = 0;
+	for (i = 0; i < s; ++i)
+		m[(main[i] - 1) >> 6] |= (uint64_t) 1 << ((main[i] - 1) & 63);
+	for (k = 0, i = 0; i < 2; ++i)
+		for (w = m[i]; w != 0; w &= w - 1)
+			v[k++] = i * 64 + __builtin_ctzll(w);
+	return k;
+}
+
+struct partial {
+	uint32_t *single;
+	uint32_t *pair;
+	uint32_t *triple;
+	uint32_t draws;
+};
+
+static struct partial *
+partial_new(const struct cooc *c)
+{
+	struct partial *pt;
+
+	if ((pt = malloc(sizeof(*pt))) == NULL)
+		err(1, NULL);
+	pt->single = calloc(c->width, sizeof(uint32_t));
+	pt->pair = calloc(c->npair, sizeof(uint32_t));
+	pt->triple = calloc(c->ntriple, sizeof(uint32_t));
+	if (pt->single == NULL || pt->pair == NULL || pt->triple == NULL)
+		err(1, NULL);
+	pt->draws = 0;
+	return pt;
+}
+
+static void
+partial_flush(struct cooc *c, struct partial *pt)
+{
+	size_t i;
+
+	for (i = 0; i < (size_t) c->width; ++i)
+		c->single[i] += pt->single[i];
+	for (i = 0; i < c->npair; ++i)
+		c->pair[i] += pt->pair[i];
+	for (i = 0; i < c->ntriple; ++i)
+		c->triple[i] += pt->triple[i];
+	c->draws += pt->draws;
+	memset(pt->single, 0, c->width * sizeof(uint32_t));
+	memset(pt->pair, 0, c->npair * sizeof(uint32_t));
+	memset(pt->triple, 0, c->ntriple * sizeof(uint32_t));
+	pt->draws = 0;
+}
+
+static void
+partial_free(struct partial *pt)
+{
+	free(pt->single);
+	free(pt->pair);
+	free(pt->triple);
+	free(pt);
+}
+
+static void
+tally(struct cooc *c, struct partial *pt, const vector main)
+{
+	int v[GAME_MAXPICK];
+	int a, b, d, k;
+	size_t td, tb;
+
+	k = unmask(main, games[c->game].sample, v);
+	for (d = 0; d < k; ++d) {
+		++pt->single[v[d]];
+		td = C3(v[d]);
+		for (b = 0; b < d; ++b) {
+			++pt->pair[C2(v[d]) + v[b]];
+			tb = td + C2(v[b]);
+			for (a = 0; a < b; ++a)
+				++pt->triple[tb + v[a]];
+		}
+	}
+	if (++pt->draws == COOC_CHUNK)
+		partial_flush(c, pt);
+}
+
+void
+cooc_merge(struct cooc *into, const struct cooc *from)
+{
+	size_t i;
+
+	for (i = 0; i < (size_t) into->width; ++i)
+		into->single[i] += from->single[i];
+	for (i = 0; i < into->npair; ++i)
+		into->pair[i] += from->pair[i];
+	for (i = 0; i < into->ntriple; ++i)
+		into->triple[i] += from->triple[i];
+	into->draws += from->draws;
+}
+
+/*
+ * Draws in which both numbers came up; a == b gives the draws with a.
+ */
+uint64_t
+cooc_pair(const struct cooc *c, int a, int b)
+{
+	int t;
+
+	if (a > b) {
+		t = a;
+		a = b;
+		b = t;
+	}
+	if (a < 1 || b > c->width)
+		return 0;
+	if (a == b)
+		return c->single[a - 1];
+	return c->pair[C2(b - 1) + a - 1];
+}
+
+uint64_t
+cooc_triple(const struct cooc *c, int a, int b, int d)
+{
+	int t;
+
+	if (a > b) {
+		t = a;
+		a = b;
+		b = t;
+	}
+	if (b > d) {
+		t = b;
+		b = d;
+		d = t;
+	}
+	if (a > b) {
+		t = a;
+		a = b;
+		b = t;
+	}
+	if (a < 1 || d > c->width || a == b || b == d)
+		return 0;
+	return c->triple[C3(d - 1) + C2(b - 1) + a - 1];
+}
+
+struct scan {
+	struct cooc *c;
+	struct partial *pt;
+};
+
+static int
+scan(const struct hist_block *b, void *arg)
+{
+	struct scan *sc = arg;
+	int main[GAME_MAXPICK];
+	int i, k;
+
+	for (i = b->lo; i < b->hi; ++i) {
+		for (k = 0; k < games[sc->c->game].sample; ++k)
+			main[k] = b->main[k][i];
+		tally(sc->c, sc->pt, main);
+	}
+	return 0;
+}
+
+struct cooc *
+cooc_history(struct history *h, int game)
+{
+	struct scan sc;
+	int r, save;
+
+	if ((sc.c = cooc_new(game)) == NULL)
+		return NULL;
+	sc.pt = partial_new(sc.c);
+	r = hist_scan(h, game, 0, hist_count(h, game), scan, &sc);
+	save = errno;
+	partial_flush(sc.c, sc.pt);
+	partial_free(sc.pt);
+	if (r != 0) {
+		cooc_free(sc.c);
+		errno = save;
+		return NULL;
+	}
+	return sc.c;
+}
+
+struct simjob {
+	int game;
+	uint64_t draws;
+	uint64_t seed;
+	atomic_uint_fast64_t next;
+};
+
+struct simthread {
+	struct simjob *job;
+	pthread_t tid;
+	struct cooc *c;
+};
+
+static void *
+simulate(void *arg)
+{
+	struct simthread *t = arg;
+	struct simjob *job = t->job;
+	const struct game *g = &games[job->game];
+	struct partial *pt;
+	struct pool *p;
+	uint64_t chunk, i, n;
+	int main[GAME_MAXPICK], bonus[GAME_MAXBONUS];
+
+	if ((p = malloc(sizeof(*p))) == NULL)
+		err(1, NULL);
+	pt = partial_new(t->c);
+	while ((chunk = atomic_fetch_add(&job->next, 1)) * COOC_CHUNK <
+	    job->draws) {
+		n = MIN(COOC_CHUNK, job->draws - chunk * COOC_CHUNK);
+		pool_seed(p, job->seed, chunk);
+		for (i = 0; i < n; ++i) {
+			draw_game(g, p, main, bonus);
+			tally(t->c, pt, main);
+		}
+	}
+	partial_flush(t->c, pt);
+	partial_free(pt);
+	free(p);
+	return NULL;
+}
+
+/*
+ * Tallies draws simulated draws of game.  Chunk i of COOC_CHUNK draws
+ * uses stream i of seed, so the counts do not depend on the number of
+ * threads (all online CPUs when 0).
+ */
+struct cooc *
+cooc_simulate(int game, uint64_t draws, uint64_t seed, int threads)
+{
+	struct simthread *t;
+	struct simjob job;
+	struct cooc *c;
+	int i, n;
+
+	job.game = game;
+	job.draws = draws;
+	job.seed = seed;
+	atomic_init(&job.next, 0);
+	n = threads > 0 ? threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+	n = MAX(MIN((uint64_t) n, (draws + COOC_CHUNK - 1) / COOC_CHUNK), 1);
+	if ((t = calloc(n, sizeof(*t))) == NULL)
+		return NULL;
+	for (i = 0; i < n; ++i) {
+		t[i].job = &job;
+		if ((t[i].c = cooc_new(game)) == NULL)
+			err(1, NULL);
+		if (pthread_create(&t[i].tid, NULL, simulate, &t[i]) != 0)
+			err(1, "pthread_create");
+	}
+	for (i = 0; i < n; ++i)
+		pthread_join(t[i].tid, NULL);
+	c = t[0].c;
+	for (i = 1; i < n; ++i) {
+		cooc_merge(c, t[i].c);
+		cooc_free(t[i].c);
+	}
+	free(t);
+	return c;
+}
+
+/*
+ * The file is a header, the full symmetric matrix of pair counts with
+ * the single counts on its diagonal, then the packed triple counts, all
+ * in native byte order.
+ */
+int
+cooc_write(const struct cooc *c, const char *path)
+{
+	struct cooc_filehdr fh;
+	uint64_t *row;
+	FILE *fp;
+	int a, b, save;
+
+	if ((fp = fopen(path, "wb")) == NULL)
+		return -1;
+	if ((row = malloc(c->width * sizeof(*row))) == NULL)
+		goto fail;
+	memset(&fh, 0, sizeof(fh));
+	memcpy(fh.magic, COOC_MAGIC, sizeof(fh.magic));
+	fh.version = COOC_VERSION;
+	fh.game = c->game;
+	fh.number = c->width;
+	fh.draws = c->draws;
+	if (fwrite(&fh, sizeof(fh), 1, fp) != 1)
+		goto fail;
+	for (a = 1; a <= c->width; ++a) {
+		for (b = 1; b <= c->width; ++b)
+			row[b - 1] = cooc_pair(c, a, b);
+		if (fwrite(row, sizeof(*row), c->width, fp) !=
+		    (size_t) c->width)
+			goto fail;
+	}
+	if (fwrite(c->triple, sizeof(uint64_t), c->ntriple, fp) !=
+	    c->ntriple)
+		goto fail;
+	free(row);
+	return fclose(fp);
+fail:
+	save = errno;
+	free(row);
+	fclose(fp);
+	errno = save;
+	return -1;
+}
+
+struct top {
+	uint64_t count;
+	size_t index;
+};
+
+static void
+offer(struct top *t, int *n, int k, uint64_t count, size_t index)
+{
+	int i;
+
+	if (*n == k && count <= t[k - 1].count)
+		return;
+	i = *n < k ? (*n)++ : k - 1;
+	for (; i > 0 && count > t[i - 1].count; --i)
+		t[i] = t[i - 1];
+	t[i].count = count;
+	t[i].index = index;
+}
+
+static size_t
+cn(int n, int r)
+{
+	return r == 3 ? C3(n) : r == 2 ? C2(n) : (size_t) n;
+}
+
+/*
+ * The numbers of a packed pair or triple index, ascending from 1.
+ */
+static void
+unpack(size_t index, int r, int *v)
+{
+	int x;
+
+	for (; r > 0; --r) {
+		for (x = r - 1; cn(x + 1, r) <= index; ++x)
+			;
+		index -= cn(x, r);
+		v[r - 1] = x + 1;
+	}
+}
+
+/*
+ * The top most frequent pairs and triples, each with its ratio to the
+ * count expected if draws were uniform.
+ */
+void
+cooc_report(FILE *fp, const struct cooc *c, int top)
+{
+	const struct game *g = &games[c->game];
+	struct top *t;
+	double e2, e3;
+	size_t i;
+	int j, n, v[3];
+
+	fprintf(fp, "%s: %llu draws\n", g->name, (unsigned long long) c->draws);
+	if (top <= 0 || c->draws == 0)
+		return;
+	if ((t = calloc(top, sizeof(*t))) == NULL)
+		err(1, NULL);
+	e2 = (double) c->draws * C2(g->sample) / C2(g->number);
+	e3 = (double) c->draws * C3(g->sample) / C3(g->number);
+
+	for (n = 0, i = 0; i < c->npair; ++i)
+		offer(t, &n, top, c->pair[i], i);
+	fprintf(fp, "%-12s %14s %8s\n", "pair", "draws", "ratio");
+	for (j = 0; j < n; ++j) {
+		unpack(t[j].index, 2, v);
+		fprintf(fp, "%3d %3d      %14llu %8.4f\n", v[0], v[1],
+		    (unsigned long long) t[j].count, t[j].count / e2);
+	}
+
+	for (n = 0, i = 0; i < c->ntriple; ++i)
+		offer(t, &n, top, c->triple[i], i);
+	fprintf(fp, "%-12s %14s %8s\n", "triple", "draws", "ratio");
+	for (j = 0; j < n; ++j) {
+		unpack(t[j].index, 3, v);
+		fprintf(fp, "%3d %3d %3d  %14llu %8.4f\n", v[0], v[1], v[2],
+		    (unsigned long long) t[j].count, t[j].count / e3);
+	}
+	free(t);
+}
+
+void
+cooc_free(struct cooc *c)
+{
+	if (c == NULL)
+		return;
+	free(c->single);
+	free(c->pair);
+	free(c->triple);
+	free(c);
+}
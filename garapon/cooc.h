@@ -0,0 +1,38 @@
+/* cooc.h */
+
+#ifndef COOC_H
+#define COOC_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "engine.h"
+#include "history.h"
+
+#define COOC_MAGIC "GRPNCOOC"
+#define COOC_VERSION 1
+#define COOC_CHUNK 65536
+
+struct cooc {
+	int game;
+	int width;
+	uint64_t draws;
+	size_t npair;
+	size_t ntriple;
+	uint64_t *single;
+	uint64_t *pair;
+	uint64_t *triple;
+};
+
+struct cooc *cooc_new(int game);
+void cooc_merge(struct cooc *into, const struct cooc *from);
+uint64_t cooc_pair(const struct cooc *c, int a, int b);
+uint64_t cooc_triple(const struct cooc *c, int a, int b, int d);
+struct cooc *cooc_history(struct history *h, int game);
+struct cooc *cooc_simulate(int game, uint64_t draws, uint64_t seed,
+    int threads);
+int cooc_write(const struct cooc *c, const char *path);
+void cooc_report(FILE *fp, const struct cooc *c, int top);
+void cooc_free(struct cooc *c);
+
+#endif /* COOC_H */
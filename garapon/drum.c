@@ -0,0 +1,400 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drum.h"
+#include "garapon.h"
+
+/*
+ * A turning drum full of balls, in two dimensions.  The drum is a
+ * regular polygon of DRUM_SIDES sides with a circumradius of 1, turning
+ * at OMEGA radians a second about its centre; the balls are discs of
+ * equal mass sized so they fill FILL of its area, whatever their
+ * number.  The sides carry the balls up until they tumble back down.
+ * OMEGA is slow enough that gravity beats the pull outwards, or a ball
+ * could be pinned to the sides and carried past the exit for good.
+ * When the exit at the bottom is opened the first ball to fall through
+ * it is the one drawn.
+ *
+ * Positions and velocities are kept as separate arrays so that
+ * integration is one straight loop per array, which the compiler turns
+ * into vector code.  Collisions between balls use a uniform grid of
+ * cells one ball across: each substep the balls are counting-sorted by
+ * cell, the arrays permuted to match so neighbours sit next to each
+ * other in memory, and each ball is checked only against its own and
+ * the neighbouring cells.  A second pass sweeps the cells bottom up and
+ * moves only the upper ball of each pair, which keeps a deep pile from
+ * sinking into itself.
+ */
+
+#define OMEGA 2.0f
+#define GRAVITY 6.0f
+#define FILL 0.35f
+#define BOUNCE 0.5f
+#define GRIP 0.3f
+#define SUBSTEPS 4
+#define HOLE 0.12f
+
+static void *
+xalloc(size_t n, size_t size)
+{
+	return calloc(n > 0 ? n : 1, size);
+}
+
+/*
+ * Lays the balls out on a hexagonal lattice from the bottom of the drum
+ * up, each with a small random push.  When the lattice cannot hold them
+ * all it is drawn tighter until it can; the collisions push any balls
+ * that overlap apart in the first frames.
+ */
+static void
+place(struct drum *d, struct pool *p)
+{
+	float a, s, x, y;
+	int i, row;
+
+	a = cosf((float) M_PI / DRUM_SIDES) - d->r;
+	for (s = 2.1f * d->r, i = 0; i < d->n; s *= 0.9f) {
+		i = 0;
+		for (row = 0, y = -a; i < d->n && y <= a;
+		    ++row, y += s * 0.866f)
+			for (x = -a + (row & 1) * s / 2; i < d->n && x <= a;
+			    x += s)
+				if (x * x + y * y <= a * a) {
+					d->x[i] = x;
+					d->y[i] = y;
+					++i;
+				}
+	}
+	for (i = 0; i < d->n; ++i) {
+		d->vx[i] = (float) (pool_double(p) - 0.5);
+		d->vy[i] = (float) (pool_double(p) - 0.5);
+	}
+}
+
+struct drum *
+drum_new(const int *label, int nball, struct pool *p)
+{
+	struct drum *d;
+	int n;
+
+	if ((d = calloc(1, sizeof(*d))) == NULL)
+		return NULL;
+	d->pool = p;
+	d->n = n = nball;
+	d->r = sqrtf(FILL / MAX(n, 1));
+	d->grid = MAX((int) (1.0f / d->r), 1);
+	d->inv = d->grid / 2.0f;
+	d->x = xalloc(n, sizeof(float));
+	d->y = xalloc(n, sizeof(float));
+	d->vx = xalloc(n, sizeof(float));
+	d->vy = xalloc(n, sizeof(float));
+	d->label = xalloc(n, sizeof(int));
+	d->tx = xalloc(n, sizeof(float));
+	d->ty = xalloc(n, sizeof(float));
+	d->tvx = xalloc(n, sizeof(float));
+	d->tvy = xalloc(n, sizeof(float));
+	d->tlabel = xalloc(n, sizeof(int));
+	d->cell = xalloc(n, sizeof(int));
+	d->start = xalloc((size_t) d->grid * d->grid + 1, sizeof(int));
+	if (d->x == NULL || d->y == NULL || d->vx == NULL || d->vy == NULL ||
+	    d->label == NULL || d->tx == NULL || d->ty == NULL ||
+	    d->tvx == NULL || d->tvy == NULL || d->tlabel == NULL ||
+	    d->cell == NULL || d->start == NULL) {
+		drum_free(d);
+		return NULL;
+	}
+	memcpy(d->label, label, n * sizeof(int));
+	pool_shuffle(p, d->label, n);
+	place(d, p);
+	return d;
+}
+
+int
+drum_ball(const struct drum *d, int i)
+{
+	return d->label[i];
+}
+
+static void
+integrate(struct drum *d, float dt)
+{
+	float *restrict x = d->x, *restrict y = d->y;
+	float *restrict vx = d->vx, *restrict vy = d->vy;
+	int i, n = d->n;
+
+	for (i = 0; i < n; ++i)
+		vy[i] -= GRAVITY * dt;
+	for (i = 0; i < n; ++i)
+		x[i] += vx[i] * dt;
+	for (i = 0; i < n; ++i)
+		y[i] += vy[i] * dt;
+}
+
+static int
+cellof(const struct drum *d, float x, float y)
+{
+	int cx, cy;
+
+	cx = (int) ((x + 1.0f) * d->inv);
+	cy = (int) ((y + 1.0f) * d->inv);
+	cx = MIN(MAX(cx, 0), d->grid - 1);
+	cy = MIN(MAX(cy, 0), d->grid - 1);
+	return cy * d->grid + cx;
+}
+
+static void
+swapf(float **a, float **b)
+{
+	float *t;
+
+	t = *a;
+	*a = *b;
+	*b = t;
+}
+
+/*
+ * Counting sort of the balls by cell; afterwards the balls of cell c
+ * are start[c] to start[c + 1] - 1.
+ */
+static void
+bin(struct drum *d)
+{
+	int *l;
+	int c, i, j, ncell;
+
+	ncell = d->grid * d->grid;
+	memset(d->start, 0, (ncell + 1) * sizeof(int));
+	for (i = 0; i < d->n; ++i)
+		++d->start[(d->cell[i] = cellof(d, d->x[i], d->y[i])) + 1];
+	for (c = 0; c < ncell; ++c)
+		d->start[c + 1] += d->start[c];
+	for (i = 0; i < d->n; ++i) {
+		j = d->start[d->cell[i]]++;
+		d->tx[j] = d->x[i];
+		d->ty[j] = d->y[i];
+		d->tvx[j] = d->vx[i];
+		d->tvy[j] = d->vy[i];
+		d->tlabel[j] = d->label[i];
+	}
+	for (c = ncell; c > 0; --c)
+		d->start[c] = d->start[c - 1];
+	d->start[0] = 0;
+	swapf(&d->x, &d->tx);
+	swapf(&d->y, &d->ty);
+	swapf(&d->vx, &d->tvx);
+	swapf(&d->vy, &d->tvy);
+	l = d->label;
+	d->label = d->tlabel;
+	d->tlabel = l;
+}
+
+static void
+resolve(struct drum *d, int i, int j, int shock)
+{
+	float dx, dy, dist2, dist, nx, ny, push, vn, diam, wi;
+
+	diam = 2.0f * d->r;
+	dx = d->x[j] - d->x[i];
+	dy = d->y[j] - d->y[i];
+	dist2 = dx * dx + dy * dy;
+	if (dist2 >= diam * diam || dist2 == 0.0f)
+		return;
+	dist = sqrtf(dist2);
+	nx = dx / dist;
+	ny = dy / dist;
+	push = diam - dist;
+	/* in the shock pass the lower ball holds and the upper one moves */
+	wi = !shock ? 0.5f : ny > 0.0f ? 0.0f : 1.0f;
+	d->x[i] -= nx * push * wi;
+	d->y[i] -= ny * push * wi;
+	d->x[j] += nx * push * (1.0f - wi);
+	d->y[j] += ny * push * (1.0f - wi);
+	vn = (d->vx[j] - d->vx[i]) * nx + (d->vy[j] - d->vy[i]) * ny;
+	if (vn < 0.0f) {
+		vn *= (1.0f + BOUNCE) / 2;
+		d->vx[i] += nx * vn;
+		d->vy[i] += ny * vn;
+		d->vx[j] -= nx * vn;
+		d->vy[j] -= ny * vn;
+	}
+}
+
+static void
+collide(struct drum *d, int shock)
+{
+	/* each pair of neighbouring cells is looked at from one side */
+	static const int half[4][2] = {
+		{ 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 }
+	};
+	int c, cx, cy, i, j, k, nx, ny, nc;
+
+	for (cy = 0; cy < d->grid; ++cy)
+		for (cx = 0; cx < d->grid; ++cx) {
+			c = cy * d->grid + cx;
+			for (i = d->start[c]; i < d->start[c + 1]; ++i) {
+				for (j = i + 1; j < d->start[c + 1]; ++j)
+					resolve(d, i, j, shock);
+				for (k = 0; k < 4; ++k) {
+					nx = cx + half[k][0];
+					ny = cy + half[k][1];
+					if (nx < 0 || nx >= d->grid ||
+					    ny >= d->grid)
+						continue;
+					nc = ny * d->grid + nx;
+					for (j = d->start[nc];
+					    j < d->start[nc + 1]; ++j)
+						resolve(d, i, j, shock);
+				}
+			}
+		}
+}
+
+/*
+ * Keeps the balls inside the sides, which push them along as they
+ * turn.  Over the open exit there is no side.
+ */
+static void
+walls(struct drum *d)
+{
+	float nx[DRUM_SIDES], ny[DRUM_SIDES];
+	float a, hole, pen, rvx, rvy, vn, vt, wx, wy;
+	int i, k;
+
+	a = cosf((float) M_PI / DRUM_SIDES) - d->r;
+	hole = MAX(3.0f * d->r, HOLE);
+	for (k = 0; k < DRUM_SIDES; ++k) {
+		nx[k] = cosf(d->angle + k * 2 * (float) M_PI / DRUM_SIDES);
+		ny[k] = sinf(d->angle + k * 2 * (float) M_PI / DRUM_SIDES);
+	}
+	for (i = 0; i < d->n; ++i) {
+		if (d->open && d->y[i] < 0.0f && fabsf(d->x[i]) < hole)
+			continue;
+		for (k = 0; k < DRUM_SIDES; ++k) {
+			pen = d->x[i] * nx[k] + d->y[i] * ny[k] - a;
+			if (pen <= 0.0f)
+				continue;
+			d->x[i] -= pen * nx[k];
+			d->y[i] -= pen * ny[k];
+			wx = -OMEGA * d->y[i];
+			wy = OMEGA * d->x[i];
+			rvx = d->vx[i] - wx;
+			rvy = d->vy[i] - wy;
+			vn = rvx * nx[k] + rvy * ny[k];
+			vt = -rvx * ny[k] + rvy * nx[k];
+			if (vn > 0.0f)
+				vn *= -BOUNCE;
+			vt *= 1.0f - GRIP;
+			d->vx[i] = wx + vn * nx[k] - vt * ny[k];
+			d->vy[i] = wy + vn * ny[k] + vt * nx[k];
+		}
+	}
+}
+
+/*
+ * Takes out the first ball below the drum, if any.
+ */
+static void
+fall(struct drum *d)
+{
+	int i, last;
+
+	for (i = 0; i < d->n; ++i)
+		if (d->y[i] < -1.0f - 2.0f * d->r)
+			break;
+	if (i == d->n)
+		return;
+	d->taken = d->label[i];
+	d->open = 0;
+	last = --d->n;
+	d->x[i] = d->x[last];
+	d->y[i] = d->y[last];
+	d->vx[i] = d->vx[last];
+	d->vy[i] = d->vy[last];
+	d->label[i] = d->label[last];
+}
+
+/*
+ * Advances the drum by one frame of 1/DRUM_HZ seconds.
+ */
+void
+drum_step(struct drum *d)
+{
+	float dt;
+	int k;
+
+	dt = 1.0f / (DRUM_HZ * SUBSTEPS);
+	for (k = 0; k < SUBSTEPS; ++k) {
+		d->angle = fmodf(d->angle + OMEGA * dt, 2 * (float) M_PI);
+		integrate(d, dt);
+		bin(d);
+		collide(d, 0);
+		walls(d);
+		collide(d, 1);
+		walls(d);
+		if (d->open)
+			fall(d);
+	}
+}
+
+void
+drum_open(struct drum *d)
+{
+	if (d->n > 0)
+		d->open = 1;
+}
+
+/*
+ * The ball that fell out since the last call, or 0.
+ */
+int
+drum_take(struct drum *d)
+{
+	int b;
+
+	b = d->taken;
+	d->taken = 0;
+	return b;
+}
+
+void
+drum_free(struct drum *d)
+{
+	if (d == NULL)
+		return;
+	free(d->x);
+	free(d->y);
+	free(d->vx);
+	free(d->vy);
+	free(d->label);
+	free(d->tx);
+	free(d->ty);
+	free(d->tvx);
+	free(d->tvy);
+	free(d->tlabel);
+	free(d->cell);
+	free(d->start);
+	free(d);
+}
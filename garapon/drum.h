@@ -0,0 +1,41 @@
+/* drum.h */
+
+#ifndef DRUM_H
+#define DRUM_H
+
+#include "entropy.h"
+
+#define DRUM_HZ 60
+#define DRUM_SIDES 6
+
+struct drum {
+	int n;
+	float r;
+	float angle;
+	int open;
+	int taken;
+	float *x;
+	float *y;
+	float *vx;
+	float *vy;
+	int *label;
+	float *tx;
+	float *ty;
+	float *tvx;
+	float *tvy;
+	int *tlabel;
+	int grid;
+	float inv;
+	int *start;
+	int *cell;
+	struct pool *pool;
+};
+
+struct drum *drum_new(const int *label, int n, struct pool *p);
+void drum_step(struct drum *d);
+void drum_open(struct drum *d);
+int drum_ball(const struct drum *d, int i);
+int drum_take(struct drum *d);
+void drum_free(struct drum *d);
+
+#endif /* DRUM_H */
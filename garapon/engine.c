@@ -0,0 +1,180 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "sort.h"
+
+/*
+ * The games in the same order as choices[].  Numbers in the omake
+ * columns are drawn from the main machine, the x columns from a
+ * second machine.
+ */
+const struct game games[NGAMES] = {
+	{ "mini garapon", "mini", JA_SIZE, MIN_L_N, MIN_L_S, MIN_L_O,
+	    0, 0, 0, STYLE_JA },
+	{ "garapon six", "six", JA_SIZE, L_SIX_N, L_SIX_S, L_SIX_O,
+	    0, 0, 0, STYLE_JA },
+	{ "garapon seven", "seven", JA_SIZE, L_SEV_N, L_SEV_S, L_SEV_O,
+	    0, 0, 0, STYLE_JA },
+	{ "power garapon", "power", US_SIZE, PMAIN_N, PMAIN_S, 0,
+	    US_SIZE, POWER_N, POWER_S, STYLE_US },
+	{ "mega garapon", "mega", US_SIZE, MMAIN_N, MMAIN_S, 0,
+	    US_SIZE, MEGA_N, MEGA_S, STYLE_US },
+	{ "super garapon", "super", EU_SIZE, SMAIN_N, SMAIN_S, 0,
+	    LS_SIZE, STARS_N, STARS_S, STYLE_EU }
+};
+
+int
+find_game(const char *key)
+{
+	int i;
+
+	for (i = 0; i < NGAMES; ++i)
+		if (strcmp(key, games[i].key) == 0 ||
+		    strcmp(key, games[i].name) == 0)
+			return i;
+	return -1;
+}
+
+static void
+pick(struct pool *p, int *ball, int number, int n)
+{
+	int i, j, temp;
+
+	for (i = 0; i < n; ++i) {
+		j = i + (int) pool_bounded(p, number - i);
+		temp = ball[i];
+		ball[i] = ball[j];
+		ball[j] = temp;
+	}
+}
+
+/*
+ * Draws one result of game g without any animation.  main receives
+ * g->sample numbers in ascending order, bonus the omake numbers
+ * followed by the numbers of the second machine, each group sorted.
+ */
+void
+draw_game(const struct game *g, struct pool *p, vector main, vector bonus)
+{
+	int ball[GAME_MAXNUMBER];
+	int i;
+
+	for (i = 0; i < g->number; ++i)
+		ball[i] = i + 1;
+	pick(p, ball, g->number, g->sample + g->omake);
+	distsort(g->sample, ball, main);
+	distsort(g->omake, ball + g->sample, bonus);
+
+	if (g->xsample > 0) {
+		for (i = 0; i < g->xnumber; ++i)
+			ball[i] = i + 1;
+		pick(p, ball, g->xnumber, g->xsample);
+		distsort(g->xsample, ball, bonus + g->omake);
+	}
+}
+
+/*
+ * Fills v with n lines of k distinct numbers from 1 to number, in
+ * draw order.  All candidates come from one batched bounded fill; a
+ * candidate that repeats an earlier number of its line is redrawn,
+ * which keeps the choice uniform over the combinations.
+ */
+static void
+sample(struct pool *p, vector v, int k, int number, size_t n)
+{
+	uint32_t *cand;
+	size_t t, total;
+	int b, i, j;
+
+	total = n * k;
+	if ((cand = (uint32_t *) malloc(total * sizeof(uint32_t))) == NULL)
+		err(1, NULL);
+	pool_fill_bounded(p, cand, total, number);
+	for (t = 0; t < total; t += k) {
+		for (i = 0; i < k; ++i) {
+			b = cand[t + i] + 1;
+			for (j = 0; j < i; ++j) {
+				if (v[t + j] == b) {
+					b = pool_bounded(p, number) + 1;
+					j = -1;
+				}
+			}
+			v[t + i] = b;
+		}
+	}
+	free(cand);
+}
+
+/*
+ * Fills tickets with n quick picks of g->sample main numbers each.
+ */
+void
+quick_pick(const struct game *g, struct pool *p, vector tickets, size_t n)
+{
+	sample(p, tickets, g->sample, g->number, n);
+	distsort_batch(g->sample, n, tickets, tickets);
+}
+
+/*
+ * Draws n independent lines of game g at once, each from freshly
+ * filled machines.  main and bonus receive the lines one after another
+ * in the layout of draw_game(): g->sample and GAME_BONUS(g) numbers per
+ * line.
+ */
+void
+draw_lines(const struct game *g, struct pool *p, vector main, vector bonus,
+    size_t n)
+{
+	vector v;
+	size_t t;
+	int k, nb;
+
+	k = g->sample + g->omake;
+	nb = GAME_BONUS(g);
+	if ((v = (vector) malloc(n * k * sizeof(int))) == NULL)
+		err(1, NULL);
+	sample(p, v, k, g->number, n);
+	for (t = 0; t < n; ++t) {
+		memcpy(main + t * g->sample, v + t * k,
+		    g->sample * sizeof(int));
+		memcpy(bonus + t * nb, v + t * k + g->sample,
+		    g->omake * sizeof(int));
+	}
+	distsort_batch(g->sample, n, main, main);
+	if (g->xsample > 0) {
+		sample(p, v, g->xsample, g->xnumber, n);
+		for (t = 0; t < n; ++t)
+			memcpy(bonus + t * nb + g->omake, v + t * g->xsample,
+			    g->xsample * sizeof(int));
+	}
+	for (t = 0; t < n; ++t) {
+		distsort(g->omake, bonus + t * nb, bonus + t * nb);
+		distsort(g->xsample, bonus + t * nb + g->omake,
+		    bonus + t * nb + g->omake);
+	}
+	free(v);
+}
@@ -0,0 +1,48 @@
+/* engine.h */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stddef.h>
+
+#include "entropy.h"
+#include "garapon.h"
+
+#define NGAMES 6
+#define GAME_MAXNUMBER 128
+#define GAME_MAXPICK 7
+#define GAME_MAXBONUS 2
+
+#define GAME_BONUS(g) ((g)->omake + (g)->xsample)
+
+/* The machine a game is played on. */
+enum {
+	STYLE_JA,	/* one machine, omake drawn after the main numbers */
+	STYLE_US,	/* two machines turning together */
+	STYLE_EU	/* two machines turning one at a time */
+};
+
+struct game {
+	const char *name;
+	const char *key;
+	size_t size;
+	int number;
+	int sample;
+	int omake;
+	size_t xsize;
+	int xnumber;
+	int xsample;
+	int style;
+};
+
+extern const struct game games[NGAMES];
+
+int find_game(const char *key);
+void draw_game(const struct game *g, struct pool *p, vector main,
+    vector bonus);
+void quick_pick(const struct game *g, struct pool *p, vector tickets,
+    size_t n);
+void draw_lines(const struct game *g, struct pool *p, vector main,
+    vector bonus, size_t n);
+
+#endif /* ENGINE_H */
@@ -0,0 +1,267 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_RANDOM_H
+#include <sys/random.h>
+#endif
+
+#include "entropy.h"
+
+/*
+ * A pool of random words refilled POOL_WORDS at a time from the kernel,
+ * and Lemire's multiply-shift reduction to map them onto [0, range)
+ * without modulo bias.  A pool is not locked; every thread keeps its
+ * own.
+ *
+ * A seeded pool is refilled from a counter-based generator instead:
+ * word pair c of stream s is a hash of (seed, s, c).  Simulations give
+ * each independent unit of work its own stream, so results do not
+ * depend on how the work is split, and the position in a stream is
+ * just (ctr, n).
+ */
+
+#define GOLDEN 0x9e3779b97f4a7c15ULL
+
+static void
+fill(void *buf, size_t len)
+{
+#if defined(HAVE_GETRANDOM)
+	unsigned char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = getrandom(p, len, 0)) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(1, "getrandom");
+		}
+		p += n;
+		len -= n;
+	}
+#elif defined(HAVE_ARC4RANDOM_BUF)
+	arc4random_buf(buf, len);
+#else
+	unsigned char *p = buf;
+	ssize_t n;
+	int fd;
+
+	if ((fd = open("/dev/urandom", O_RDONLY)) == -1)
+		err(1, "/dev/urandom");
+	while (len > 0) {
+		if ((n = read(fd, p, len)) <= 0) {
+			if (n == -1 && errno == EINTR)
+				continue;
+			err(1, "/dev/urandom");
+		}
+		p += n;
+		len -= n;
+	}
+	close(fd);
+#endif
+}
+
+static uint64_t
+mix64(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void
+pool_refill(struct pool *p)
+{
+	uint64_t z;
+	size_t i;
+
+	if (p->seeded) {
+		for (i = 0; i < POOL_WORDS; i += 2) {
+			z = mix64(p->key + (p->ctr++ + 1) * GOLDEN);
+			p->w[i] = (uint32_t) z;
+			p->w[i + 1] = (uint32_t) (z >> 32);
+		}
+	} else
+		fill(p->w, sizeof(p->w));
+	p->n = 0;
+}
+
+void
+pool_init(struct pool *p)
+{
+	p->seeded = 0;
+	pool_refill(p);
+}
+
+void
+pool_seed(struct pool *p, uint64_t seed, uint64_t stream)
+{
+	p->seeded = 1;
+	p->key = mix64(seed ^ mix64(stream * GOLDEN + 1));
+	p->ctr = 0;
+	pool_refill(p);
+}
+
+/*
+ * The number of words a seeded pool has handed out since pool_seed(),
+ * and the way back to that point.
+ */
+uint64_t
+pool_tell(const struct pool *p)
+{
+	return p->ctr * 2 - POOL_WORDS + p->n;
+}
+
+void
+pool_seek(struct pool *p, uint64_t pos)
+{
+	p->ctr = pos / POOL_WORDS * (POOL_WORDS / 2);
+	pool_refill(p);
+	p->n = pos % POOL_WORDS;
+}
+
+/*
+ * A double in [0, 1) with 53 random bits.
+ */
+double
+pool_double(struct pool *p)
+{
+	uint64_t hi, lo;
+
+	hi = pool_u32(p) >> 5;
+	lo = pool_u32(p) >> 6;
+	return (hi * 67108864.0 + lo) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * Poisson variates: multiplication of uniforms for small means and
+ * Hormann's transformed rejection (PTRS) otherwise.
+ */
+long
+pool_poisson(struct pool *p, double lambda)
+{
+	double a, b, invalpha, vr, loglam, u, us, v, e;
+	long k;
+
+	if (lambda <= 0)
+		return 0;
+	if (lambda < 10) {
+		e = exp(-lambda);
+		for (k = 0, u = pool_double(p); u > e; ++k)
+			u *= pool_double(p);
+		return k;
+	}
+	loglam = log(lambda);
+	b = 0.931 + 2.53 * sqrt(lambda);
+	a = -0.059 + 0.02483 * b;
+	invalpha = 1.1239 + 1.1328 / (b - 3.4);
+	vr = 0.9277 - 3.6224 / (b - 2);
+	for (;;) {
+		u = pool_double(p) - 0.5;
+		v = pool_double(p);
+		us = 0.5 - fabs(u);
+		k = (long) floor((2 * a / us + b) * u + lambda + 0.43);
+		if (us >= 0.07 && v <= vr)
+			return k;
+		if (k < 0 || (us < 0.013 && v > us))
+			continue;
+		if (log(v) + log(invalpha) - log(a / (us * us) + b) <=
+		    -lambda + k * loglam - lgamma(k + 1.0))
+			return k;
+	}
+}
+
+uint32_t
+pool_bounded(struct pool *p, uint32_t range)
+{
+	uint64_t m;
+	uint32_t l, t;
+
+	m = (uint64_t) pool_u32(p) * range;
+	l = (uint32_t) m;
+	if (l < range) {
+		t = -range % range;
+		while (l < t) {
+			m = (uint64_t) pool_u32(p) * range;
+			l = (uint32_t) m;
+		}
+	}
+	return (uint32_t) (m >> 32);
+}
+
+/*
+ * Fills out with n independent values in [0, range), or zeros when
+ * range is 0 as pool_bounded() gives.  The words left in the pool are
+ * reduced in one pass with no branches; the few that fall into the
+ * biased zone are redrawn afterwards.
+ */
+void
+pool_fill_bounded(struct pool *p, uint32_t *out, size_t n, uint32_t range)
+{
+	uint32_t low[POOL_WORDS];
+	uint64_t m;
+	uint32_t t;
+	size_t i, k, reject;
+
+	if (range == 0) {
+		memset(out, 0, n * sizeof(*out));
+		return;
+	}
+	t = -range % range;
+	while (n > 0) {
+		if (p->n == POOL_WORDS)
+			pool_refill(p);
+		k = (n < POOL_WORDS - p->n) ? n : POOL_WORDS - p->n;
+		for (i = 0, reject = 0; i < k; ++i) {
+			m = (uint64_t) p->w[p->n + i] * range;
+			out[i] = (uint32_t) (m >> 32);
+			low[i] = (uint32_t) m;
+			reject |= (low[i] < t);
+		}
+		p->n += k;
+		if (reject)
+			for (i = 0; i < k; ++i)
+				if (low[i] < t)
+					out[i] = pool_bounded(p, range);
+		out += k;
+		n -= k;
+	}
+}
+
+void
+pool_shuffle(struct pool *p, int *v, size_t n)
+{
+	size_t i, j;
+	int temp;
+
+	for (i = n; i > 1; --i) {
+		j = pool_bounded(p, i);
+		temp = v[i - 1];
+		v[i - 1] = v[j];
+		v[j] = temp;
+	}
+}
@@ -0,0 +1,39 @@
+/* entropy.h */
+
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define POOL_WORDS 1024
+
+struct pool {
+	uint32_t w[POOL_WORDS];
+	size_t n;
+	int seeded;
+	uint64_t key;
+	uint64_t ctr;
+};
+
+void pool_init(struct pool *p);
+void pool_seed(struct pool *p, uint64_t seed, uint64_t stream);
+void pool_refill(struct pool *p);
+uint64_t pool_tell(const struct pool *p);
+void pool_seek(struct pool *p, uint64_t pos);
+double pool_double(struct pool *p);
+long pool_poisson(struct pool *p, double lambda);
+uint32_t pool_bounded(struct pool *p, uint32_t range);
+void pool_fill_bounded(struct pool *p, uint32_t *out, size_t n,
+    uint32_t range);
+void pool_shuffle(struct pool *p, int *v, size_t n);
+
+static inline uint32_t
+pool_u32(struct pool *p)
+{
+	if (p->n == POOL_WORDS)
+		pool_refill(p);
+	return p->w[p->n++];
+}
+
+#endif /* ENTROPY_H */
@@ -0,0 +1,353 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "entropy.h"
+#include "filter.h"
+#include "rank.h"
+#include "sort.h"
+#include "ticket.h"
+
+/*
+ * Every combination of main numbers that passes a set of filters: sum
+ * range, number of odd numbers, longest run of consecutive numbers,
+ * excluded numbers, and number of decades (1-9, 10-19, ...) covered.
+ * Numbers are chosen in ascending order by depth-first search, and a
+ * branch is cut as soon as no way of finishing it can pass: the sum is
+ * bounded by the smallest and largest numbers still free, the odd and
+ * decade counts by the picks left, and a run only grows.
+ *
+ * The work is split by the first two numbers, each pair a task handed
+ * out in order.  Tickets found by a task are kept as ranks and written
+ * once every earlier task is written, so the file comes out in the same
+ * order whatever the number of threads.  Numbers for a second machine
+ * are quick picked, as for wheels, from a stream of the seed per task.
+ * With no file only the count is kept.
+ */
+
+#define DECADE(x) ((x) / 10)
+
+struct out {
+	uint32_t *rank;
+	size_t n;
+	size_t cap;
+	int done;
+};
+
+struct job {
+	const struct filter *f;
+	const struct game *g;
+	struct tkfile *tk;
+	int ntask;
+	int (*task)[2];
+	atomic_int next;
+	atomic_uint_fast64_t count;
+	pthread_mutex_t lock;
+	struct out *out;
+	int written;
+	int error;
+};
+
+struct walk {
+	struct job *job;
+	const struct filter *f;
+	const struct game *g;
+	struct pool pool;
+	struct out *out;
+	uint64_t count;
+	int prefix[2];
+	int v[GAME_MAXPICK + GAME_MAXBONUS];
+};
+
+/*
+ * Clears f: no game yet and every bound FILTER_UNSET, so that the bounds
+ * can be given in any order before the game.
+ */
+void
+filter_init(struct filter *f)
+{
+	memset(f, 0, sizeof(*f));
+	f->game = -1;
+	f->sumlo = f->sumhi = FILTER_UNSET;
+	f->oddlo = f->oddhi = FILTER_UNSET;
+	f->maxrun = FILTER_UNSET;
+	f->declo = f->dechi = FILTER_UNSET;
+}
+
+/*
+ * Sets the game of f and opens every bound still unset as wide as the
+ * game allows.
+ */
+void
+filter_game(struct filter *f, int game)
+{
+	const struct game *g = &games[game];
+
+	f->game = game;
+	if (f->sumlo == FILTER_UNSET)
+		f->sumlo = 0;
+	if (f->sumhi == FILTER_UNSET)
+		f->sumhi = g->number * g->sample;
+	if (f->oddlo == FILTER_UNSET)
+		f->oddlo = 0;
+	if (f->oddhi == FILTER_UNSET)
+		f->oddhi = g->sample;
+	if (f->maxrun == FILTER_UNSET)
+		f->maxrun = g->sample;
+	if (f->declo == FILTER_UNSET)
+		f->declo = 0;
+	if (f->dechi == FILTER_UNSET)
+		f->dechi = g->sample;
+}
+
+static int
+excluded(const struct filter *f, int x)
+{
+	return (f->exclude[(x - 1) >> 6] >> ((x - 1) & 63)) & 1;
+}
+
+static int
+decades(const vector v, int n)
+{
+	int i, d;
+
+	for (d = 0, i = 0; i < n; ++i)
+		d += (i == 0 || DECADE(v[i]) != DECADE(v[i - 1]));
+	return d;
+}
+
+/*
+ * Whether a sorted set of main numbers passes every filter.
+ */
+int
+filter_match(const struct filter *f, const vector main)
+{
+	const struct game *g = &games[f->game];
+	int i, odd, run, sum, best;
+
+	odd = sum = 0;
+	run = best = 1;
+	for (i = 0; i < g->sample; ++i) {
+		if (excluded(f, main[i]))
+			return 0;
+		sum += main[i];
+		odd += main[i] & 1;
+		run = (i > 0 && main[i] == main[i - 1] + 1) ? run + 1 : 1;
+		best = MAX(best, run);
+	}
+	return sum >= f->sumlo && sum <= f->sumhi && odd >= f->oddlo &&
+	    odd <= f->oddhi && best <= f->maxrun &&
+	    decades(main, g->sample) >= f->declo &&
+	    decades(main, g->sample) <= f->dechi;
+}
+
+static void
+emit(struct walk *w)
+{
+	const struct game *g = w->g;
+	uint32_t *r;
+	int i, k, x;
+
+	++w->count;
+	if (w->out == NULL)
+		return;
+	for (k = 0; k < g->xsample; ++k) {
+		do {
+			x = pool_bounded(&w->pool, g->xnumber) + 1;
+			for (i = 0; i < k && w->v[g->sample + i] != x; ++i)
+				;
+		} while (i < k);
+		w->v[g->sample + k] = x;
+	}
+	distsort(g->xsample, w->v + g->sample, w->v + g->sample);
+	if (w->out->n == w->out->cap) {
+		w->out->cap = w->out->cap == 0 ? FILTER_BATCH : w->out->cap * 2;
+		if ((r = realloc(w->out->rank,
+		    w->out->cap * sizeof(*r))) == NULL)
+			err(1, NULL);
+		w->out->rank = r;
+	}
+	w->out->rank[w->out->n++] = ticket_rank(g, w->v);
+}
+
+/*
+ * Picks number d onwards, each above the last; sum, odd, run and dec
+ * describe the numbers picked so far.
+ */
+static void
+dfs(struct walk *w, int d, int sum, int odd, int run, int dec)
+{
+	const struct filter *f = w->f;
+	const int s = w->g->sample, n = w->g->number;
+	int left, lo, hi, nrun, ndec, x;
+
+	if (d == s) {
+		emit(w);
+		return;
+	}
+	left = s - d - 1;
+	lo = d == 0 ? 1 : w->v[d - 1] + 1;
+	hi = n - left;
+	if (d < 2) {
+		lo = w->prefix[d];
+		hi = MIN(lo, hi);
+	}
+	for (x = lo; x <= hi; ++x) {
+		/* x and the next left numbers are the least sum to come */
+		if (sum + x * (left + 1) + left * (left + 1) / 2 > f->sumhi)
+			break;
+		if (excluded(f, x))
+			continue;
+		/* the largest numbers are the most */
+		if (sum + x + left * (2 * n - left + 1) / 2 < f->sumlo)
+			continue;
+		if (odd + (x & 1) > f->oddhi ||
+		    odd + (x & 1) + left < f->oddlo)
+			continue;
+		nrun = (d > 0 && x == w->v[d - 1] + 1) ? run + 1 : 1;
+		if (nrun > f->maxrun)
+			continue;
+		ndec = dec + (d == 0 || DECADE(x) != DECADE(w->v[d - 1]));
+		if (ndec > f->dechi ||
+		    ndec + MIN(left, DECADE(n) - DECADE(x)) < f->declo)
+			continue;
+		w->v[d] = x;
+		dfs(w, d + 1, sum + x, odd + (x & 1), nrun, ndec);
+	}
+}
+
+/*
+ * Writes the tickets of every finished task that no earlier task is
+ * still holding back.
+ */
+static void
+flush(struct job *job)
+{
+	struct out *o;
+
+	while (job->written < job->ntask && job->out[job->written].done) {
+		o = &job->out[job->written++];
+		if (!job->error && tk_write_ranks(job->tk, o->rank, o->n) == -1)
+			job->error = errno;
+		free(o->rank);
+		o->rank = NULL;
+	}
+}
+
+static void *
+worker(void *arg)
+{
+	struct walk *w = arg;
+	struct job *job = w->job;
+	int t;
+
+	while ((t = atomic_fetch_add(&job->next, 1)) < job->ntask) {
+		w->prefix[0] = job->task[t][0];
+		w->prefix[1] = job->task[t][1];
+		if (job->tk != NULL) {
+			w->out = &job->out[t];
+			pool_seed(&w->pool, w->f->seed, t);
+		}
+		dfs(w, 0, 0, 0, 0, 0);
+		if (job->tk != NULL) {
+			pthread_mutex_lock(&job->lock);
+			w->out->done = 1;
+			flush(job);
+			pthread_mutex_unlock(&job->lock);
+		}
+	}
+	atomic_fetch_add(&job->count, w->count);
+	return NULL;
+}
+
+/*
+ * Counts the tickets passing f and, with a path, writes them there as
+ * a ticket file.  Returns the count, or -1 with errno set.
+ */
+int64_t
+filter_run(const struct filter *f, const char *path, int threads)
+{
+	struct walk *w;
+	pthread_t *tid;
+	struct job job;
+	int a, b, i, n, save;
+
+	memset(&job, 0, sizeof(job));
+	job.f = f;
+	job.g = &games[f->game];
+	n = job.g->number;
+	if ((job.task = malloc(n * n * sizeof(*job.task))) == NULL)
+		return -1;
+	for (a = 1; a <= n; ++a)
+		for (b = a + 1; b <= n; ++b) {
+			job.task[job.ntask][0] = a;
+			job.task[job.ntask++][1] = b;
+		}
+	if (path != NULL) {
+		if ((job.out = calloc(job.ntask, sizeof(*job.out))) == NULL ||
+		    (job.tk = tk_create(path, f->game)) == NULL) {
+			save = errno;
+			free(job.out);
+			free(job.task);
+			errno = save;
+			return -1;
+		}
+	}
+	atomic_init(&job.next, 0);
+	atomic_init(&job.count, 0);
+	pthread_mutex_init(&job.lock, NULL);
+
+	n = threads > 0 ? threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+	n = MAX(n, 1);
+	if ((w = calloc(n, sizeof(*w))) == NULL ||
+	    (tid = calloc(n, sizeof(*tid))) == NULL)
+		err(1, NULL);
+	for (i = 0; i < n; ++i) {
+		w[i].job = &job;
+		w[i].f = f;
+		w[i].g = job.g;
+		if (pthread_create(&tid[i], NULL, worker, &w[i]) != 0)
+			err(1, "pthread_create");
+	}
+	for (i = 0; i < n; ++i)
+		pthread_join(tid[i], NULL);
+	free(tid);
+	free(w);
+	pthread_mutex_destroy(&job.lock);
+	free(job.out);
+	free(job.task);
+
+	if (job.tk != NULL && tk_close(job.tk) == -1 && job.error == 0)
+		job.error = errno;
+	if (job.error != 0) {
+		errno = job.error;
+		return -1;
+	}
+	return (int64_t) atomic_load(&job.count);
+}
@@ -0,0 +1,31 @@
+/* filter.h */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+
+#include "engine.h"
+
+#define FILTER_BATCH 4096
+#define FILTER_UNSET (-1)
+
+struct filter {
+	int game;
+	int sumlo;
+	int sumhi;
+	int oddlo;
+	int oddhi;
+	int maxrun;
+	int declo;
+	int dechi;
+	uint64_t exclude[2];
+	uint64_t seed;
+};
+
+void filter_init(struct filter *f);
+void filter_game(struct filter *f, int game);
+int filter_match(const struct filter *f, const vector main);
+int64_t filter_run(const struct filter *f, const char *path, int threads);
+
+#endif /* FILTER_H */
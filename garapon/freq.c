@@ -0,0 +1,204 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freq.h"
+
+/*
+ * How often each main number came up over a range of draws.  The index
+ * is a Fenwick tree over draw numbers whose nodes are whole rows of
+ * per-ball counts: row i holds the counts of draws i - lowbit(i) + 1 to
+ * i (counting from 1).  A range query for one ball reads one column of
+ * O(log n) rows; a query for every ball adds those rows whole, which is
+ * what the hot and cold lists need.  A new draw only has to build its
+ * own row from the rows it covers, and old rows never change, so the
+ * tree can grow by plain realloc.
+ */
+
+#define FREQ_CAP 1024
+#define LOWBIT(i) ((i) & -(i))
+
+static uint32_t *
+row(const struct freq *f, size_t i)
+{
+	return f->tree + (i - 1) * f->width;
+}
+
+struct freq *
+freq_new(int game)
+{
+	struct freq *f;
+
+	if ((f = calloc(1, sizeof(*f))) == NULL)
+		return NULL;
+	f->game = game;
+	f->width = games[game].number;
+	return f;
+}
+
+int
+freq_append(struct freq *f, const vector main, int64_t stamp)
+{
+	const struct game *g = &games[f->game];
+	uint32_t *r, *t;
+	int64_t *s;
+	size_t cap, i, j;
+	int b;
+
+	if (f->n == f->cap) {
+		cap = f->cap == 0 ? FREQ_CAP : f->cap * 2;
+		if ((t = realloc(f->tree,
+		    cap * f->width * sizeof(*t))) == NULL)
+			return -1;
+		f->tree = t;
+		if ((s = realloc(f->stamp, cap * sizeof(*s))) == NULL)
+			return -1;
+		f->stamp = s;
+		f->cap = cap;
+	}
+	for (b = 0; b < g->sample; ++b)
+		if (main[b] < 1 || main[b] > f->width) {
+			errno = EINVAL;
+			return -1;
+		}
+
+	i = ++f->n;
+	r = row(f, i);
+	memset(r, 0, f->width * sizeof(*r));
+	for (j = i - 1; j > i - LOWBIT(i); j -= LOWBIT(j)) {
+		t = row(f, j);
+		for (b = 0; b < f->width; ++b)
+			r[b] += t[b];
+	}
+	for (b = 0; b < g->sample; ++b)
+		++r[main[b] - 1];
+	f->stamp[i - 1] = stamp;
+	return 0;
+}
+
+static uint32_t
+prefix(const struct freq *f, int ball, size_t i)
+{
+	uint32_t c = 0;
+
+	for (; i > 0; i -= LOWBIT(i))
+		c += row(f, i)[ball - 1];
+	return c;
+}
+
+/*
+ * Times ball came up in draws from to to - 1 (counting from 0).
+ */
+uint32_t
+freq_count(const struct freq *f, int ball, size_t from, size_t to)
+{
+	to = MIN(to, f->n);
+	if (from >= to || ball < 1 || ball > f->width)
+		return 0;
+	return prefix(f, ball, to) - prefix(f, ball, from);
+}
+
+/*
+ * The same for every ball at once, into count[ball - 1].
+ */
+void
+freq_counts(const struct freq *f, size_t from, size_t to, uint32_t *count)
+{
+	const uint32_t *r;
+	size_t i;
+	int b;
+
+	memset(count, 0, f->width * sizeof(*count));
+	to = MIN(to, f->n);
+	if (from >= to)
+		return;
+	for (i = to; i > 0; i -= LOWBIT(i))
+		for (r = row(f, i), b = 0; b < f->width; ++b)
+			count[b] += r[b];
+	for (i = from; i > 0; i -= LOWBIT(i))
+		for (r = row(f, i), b = 0; b < f->width; ++b)
+			count[b] -= r[b];
+}
+
+/*
+ * The first draw made at or after stamp.
+ */
+size_t
+freq_since(const struct freq *f, int64_t stamp)
+{
+	size_t lo, hi, mid;
+
+	lo = 0;
+	hi = f->n;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (f->stamp[mid] < stamp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * The k hottest balls over the range, or the k coldest, into out.  Ties
+ * go to the lower number.  Returns the number of entries filled.
+ */
+int
+freq_top(const struct freq *f, size_t from, size_t to, int cold,
+    struct freq_rank *out, int k)
+{
+	uint32_t count[GAME_MAXNUMBER];
+	struct freq_rank t;
+	int b, i, n;
+
+	if (k <= 0)
+		return 0;
+	freq_counts(f, from, to, count);
+	k = MIN(k, f->width);
+	for (n = 0, b = 1; b <= f->width; ++b) {
+		t.ball = b;
+		t.count = count[b - 1];
+		if (n == k && (cold ? t.count >= out[k - 1].count :
+		    t.count <= out[k - 1].count))
+			continue;
+		i = n < k ? n++ : k - 1;
+		for (; i > 0 && (cold ? t.count < out[i - 1].count :
+		    t.count > out[i - 1].count); --i)
+			out[i] = out[i - 1];
+		out[i] = t;
+	}
+	return n;
+}
+
+void
+freq_free(struct freq *f)
+{
+	if (f == NULL)
+		return;
+	free(f->tree);
+	free(f->stamp);
+	free(f);
+}
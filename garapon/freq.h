@@ -0,0 +1,35 @@
+/* freq.h */
+
+#ifndef FREQ_H
+#define FREQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine.h"
+
+struct freq {
+	int game;
+	int width;
+	size_t n;
+	size_t cap;
+	uint32_t *tree;
+	int64_t *stamp;
+};
+
+struct freq_rank {
+	int ball;
+	uint32_t count;
+};
+
+struct freq *freq_new(int game);
+int freq_append(struct freq *f, const vector main, int64_t stamp);
+uint32_t freq_count(const struct freq *f, int ball, size_t from, size_t to);
+void freq_counts(const struct freq *f, size_t from, size_t to,
+    uint32_t *count);
+size_t freq_since(const struct freq *f, int64_t stamp);
+int freq_top(const struct freq *f, size_t from, size_t to, int cold,
+    struct freq_rank *out, int k);
+void freq_free(struct freq *f);
+
+#endif /* FREQ_H */
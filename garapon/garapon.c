@@ -20,48 +20,63 @@
 
 #include <stdlib.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <limits.h>
 #include <menu.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "garapon.h"
+#include "batch.h"
+#include "bcast.h"
+#include "cooc.h"
+#include "engine.h"
+#include "entropy.h"
+#include "filter.h"
+#include "freq.h"
+#include "grid.h"
+#include "history.h"
+#include "hitidx.h"
+#include "keno.h"
+#include "rank.h"
+#include "rare.h"
+#include "server.h"
+#include "session.h"
+#include "settle.h"
+#include "shard.h"
+#include "sim.h"
+#include "sketch.h"
+#include "sort.h"
+#include "subidx.h"
+#include "ticket.h"
+#include "wheel.h"
 
 #define ENTER 10
+#define KENO_BALL_MS 600
 #define NOT_SET 0
 
 void finish(int status);
+void finish_err(const char *msg);
+static void interrupt(int sig);
+
+static struct pool pool;
+static struct history *history = NULL;
+static char *histdir = NULL;
+static struct bcast *bcast = NULL;
+static char *bcastname = NULL;
 
 char *choices[] = {
 	"mini garapon", "garapon six", "garapon seven",
-	"power garapon", "mega garapon", "super garapon",
+	"power garapon", "mega garapon", "super garapon", "keno garapon",
 	"garapon help", "garapon quit", (char *) NULL
 };
 
-vector
-newvec(size_t n)
-{
-	return (int *) calloc(n, sizeof(int));
-}
-
-vector
-new_vector(size_t n)
-{
-	vector v;
-
-	if ((v = newvec(n)) == NULL)
-		err(1, NULL);
-	return v;
-}
-
-void
-free_vector(vector v)
-{
-	free(v);
-}
-
 struct point
 makepoint(int x, int y)
 {
@@ -72,48 +87,6 @@ makepoint(int x, int y)
 	return temp;
 }
 
-GARAPON *
-new_machine(void)
-{
-	GARAPON *p;
-
-	if ((p = (GARAPON *) malloc(sizeof(GARAPON))) == NULL)
-		return NULL;
-	bzero((void *) p, sizeof(GARAPON));
-	return p;
-}
-
-GARAPON *
-make_machine(size_t n, int num, int sample, int bonus, chtype color)
-{
-	GARAPON *p;
-
-	if ((int) n < num || num < sample || sample < bonus || bonus < 0)
-		return NULL;
-	if ((p = new_machine()) == NULL)
-		return NULL;
-	p->size = n;
-	p->number = num;
-	p->sample = sample;
-	p->omake = bonus;
-	p->color = color;
-	p->v = new_vector(n);
-	return p;
-}
-
-void
-free_machine(GARAPON *a)
-{
-	free_vector(a->v);
-	free(a);
-}
-
-double
-rnd(void)
-{
-	return (1.0 / (RAND_MAX + 1.0) * (double) random());
-}
-
 static int
 colorful(WINDOW *win, const int n)
 {
@@ -164,17 +137,33 @@ printvec(WINDOW *win, struct point *start, int newline, GARAPON *machine)
 	wrefresh(win);
 }
 
+/*
+ * Draws the balls of a drum in the interior of its box, each ball in
+ * the printvec column nearest to it.  Where balls share a cell the last
+ * one drawn shows.
+ */
 static void
-shuffle(GARAPON *machine)
+draw_drum(WINDOW *win, struct point *start, int newline, GARAPON *machine,
+    const struct drum *d)
 {
-	size_t i, j, temp;
-
-	for (i = machine->size - 1; i > 0; --i) {
-		j = (size_t) ((i + 1) * rnd());
-		temp = machine->v[i];
-		machine->v[i] = machine->v[j];
-		machine->v[j] = temp;
+	int i, rows, x, y;
+
+	rows = getmaxy(win) - 2;
+	for (y = 0; y < rows; ++y)
+		mvwhline(win, start->y + y, start->x, ' ', 3 * newline - 1);
+	for (i = 0; i < d->n; ++i) {
+		x = (int) ((d->x[i] + 1) * 0.5f * newline);
+		y = (int) ((1 - d->y[i]) * 0.5f * rows);
+		if (x < 0 || x >= newline || y < 0 || y >= rows)
+			continue;
+		if (machine->color == NOT_SET)
+			colorful(win, drum_ball(d, i));
+		else
+			wattrset(win, machine->color);
+		mvwprintw(win, start->y + y, start->x + 3 * x, "%02d",
+		    drum_ball(d, i));
 	}
+	wrefresh(win);
 }
 
 static void
@@ -211,27 +200,6 @@ print_item_name(WINDOW *win, const char *name)
 	wrefresh(win);
 }
 
-#define DSMAX 100
-#define DSMIN 0
-
-static void
-distsort(int n, const vector a, vector b)
-{
-	int i, x;
-	static int count[DSMAX - DSMIN + 1];
-
-	for (i = 0; i <= DSMAX - DSMIN; ++i)
-		count[i] = 0;
-	for (i = 0; i < n; ++i)
-		++count[a[i] - DSMIN];
-	for (i = 1; i <= DSMAX - DSMIN; ++i)
-		count[i] += count[i - 1];
-	for (i = n - 1; i >= 0; --i) {
-		x = a[i] - DSMIN;
-		b[--count[x]] = a[i];
-	}
-}
-
 static void
 init_curses(void)
 {
@@ -380,10 +348,10 @@ init_game_menu(void)
 	game_items[n_choices] = (ITEM *) NULL;
 
 	game_menu = new_menu((ITEM **) game_items);
-	game_menu_win = newwin(10, 20, 2, 0);
+	game_menu_win = newwin(11, 20, 2, 0);
 	keypad(game_menu_win, true);
 	set_menu_win(game_menu, game_menu_win);
-	set_menu_sub(game_menu, derwin(game_menu_win, 8, 18, 1 ,0));
+	set_menu_sub(game_menu, derwin(game_menu_win, 9, 18, 1 ,0));
 	set_menu_mark(game_menu, " * ");
 	post_menu(game_menu);
 	wrefresh(game_menu_win);
@@ -440,62 +408,53 @@ init_game_menu(void)
 	return ERR;
 }
 
+/*
+ * Draws frame i of the nowsleeping animation: -2 is a blank line, -1
+ * the text alone, and each later frame adds or wipes one z.
+ */
 static void
-nowsleep(WINDOW *win, int starty, int startx, size_t width, int count)
+nowsleep(WINDOW *win, int width, int i)
 {
-	float temp;
-	unsigned int bit;
-	int i;
-	int x, y, spercex;
+	int x;
 	size_t flen, slen;
 	char first_str[] = "nowsleeping";
 	char second_str[] = "zzz...";
 
-	if (win == NULL)
-		win = stdscr;
-	getyx(win, y, x);
-	if (startx != 0)
-		x = startx;
-	if (starty != 0)
-		y = starty;
-	if (width == 0)
-		width = 80;
-
 	flen = strlen(first_str);
 	slen = strlen(second_str);
-	temp = (width - (flen + slen + 1)) / 2;
-	x = startx + (int) temp;
-	werase(win);
-	wrefresh(win);
-	napms(1000);
-	mvwprintw(win, y, x, "%s", first_str);
-	wrefresh(win);
-	napms(500);
-	x += flen;
-	spercex = x;
-	for (bit = 1, i = 0; i < count; ++i) {
-		if (bit)
-			mvwaddch(win, y, ++x, (i % 6 < 3) ? 'z' : '.');
-		else
-			mvwaddch(win, y, ++x, ' ');
-		if (i % 6 == 5) {
-			x = spercex;
-			bit ^= 1;
-		}
-		wrefresh(win);
-		napms(150);
-	}
-	werase(win);
+	x = (width - (int) (flen + slen + 1)) / 2;
+	if (i == -2)
+		werase(win);
+	else if (i == -1)
+		mvwprintw(win, 0, x, "%s", first_str);
+	else if ((i / 6) % 2 == 0)
+		mvwaddch(win, 0, x + flen + 1 + i % 6, (i % 6 < 3) ? 'z' : '.');
+	else
+		mvwaddch(win, 0, x + flen + 1 + i % 6, ' ');
 	wrefresh(win);
 }
 
-static long
-diffnsec(struct timespec *before, struct timespec *after)
+/*
+ * Records a finished game.  Each draw is synced as it is recorded, with
+ * SIGINT held off meanwhile, so an interrupt never finds a draw half
+ * written or waiting in memory.
+ */
+static void
+record_draw(int game, const vector main, const vector bonus)
 {
-	after->tv_nsec -= before->tv_nsec;
-	if (after->tv_nsec < 0)
-		after->tv_nsec += 1000000000;
-	return after->tv_nsec;
+	sigset_t set, old;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigprocmask(SIG_BLOCK, &set, &old);
+	if (history != NULL &&
+	    (hist_append(history, game, main, bonus,
+	    (int64_t) time(NULL)) == -1 || hist_sync(history) == -1))
+		finish_err(histdir);
+	if (bcast != NULL && bcast_publish(bcast, game, main,
+	    games[game].sample, bonus, GAME_BONUS(&games[game])))
+		finish_err(bcastname);
+	sigprocmask(SIG_SETMASK, &old, NULL);
 }
 
 static void
@@ -525,524 +484,1035 @@ num_mid(int width, int n)
 	return ((width - n * 3 + 1) / 2);
 }
 
-static void
-us_dream(int selected_item)
+/*
+ * Colour pairs of the two machines of each game; 0 leaves the balls
+ * in their own colours.
+ */
+static const short machine_pairs[NGAMES][2] = {
+	{ 0, 0 }, { 0, 0 }, { 0, 0 }, { 14, 11 }, { 16, 13 }, { 11, 13 }
+};
+
+static int64_t
+now_ms(void)
 {
-	WINDOW **imac = NULL;
-	GARAPON *lmachine = NULL;
-	GARAPON *rmachine = NULL;
-	struct point p, startp;
-	struct timespec before_ts, after_ts;
-	vector  v1 = NULL;
-	vector  v2 = NULL;
-	static int v3;
-	int a = 0;
-	int ch;
-	int i, j;
-	int selected_lot;
-	size_t ts;
-	size_t windows = 5;
-
-	selected_lot = selected_item;
-	switch (selected_lot) {
-	case 3:
-		lmachine = make_machine(US_SIZE,
-		    PMAIN_N,
-		    PMAIN_S,
-		    0,
-		    COLOR_PAIR(14));
-		rmachine = make_machine(US_SIZE,
-		    POWER_N,
-		    POWER_S,
-		    0,
-		    COLOR_PAIR(11));
-		if (lmachine == NULL || rmachine == NULL)
-			err(1, NULL);
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static WINDOW **
+open_windows(int style, size_t *windows)
+{
+	WINDOW **win;
+
+	*windows = style == STYLE_JA ? 4 : 5;
+	if ((win = (WINDOW **) calloc(*windows + 1, sizeof(WINDOW *))) == NULL)
+		err(1, NULL);
+
+	win[BOTTOM] = newwin(1, COLS, LINES - 2, 0);
+	switch (style) {
+	case STYLE_JA:
+		win[MBOX] = newwin(12, 24, 3, (COLS - 24) >> 1);
+		win[MTRAY] = newwin(3, 24, 15, (COLS - 24) >> 1);
+		win[OTRAY] = newwin(3, 24, 18, (COLS - 24) >> 1);
 		break;
-	case 4:
-		lmachine = make_machine(US_SIZE,
-		    MMAIN_N,
-		    MMAIN_S,
-		    0,
-		    COLOR_PAIR(16));
-		rmachine = make_machine(US_SIZE,
-		    MEGA_N,
-		    MEGA_S,
-		    0,
-		    COLOR_PAIR(13));
-		if (lmachine == NULL || rmachine == NULL)
-			err(1, NULL);
+	case STYLE_US:
+		win[LBOX] = newwin(14, 30, 3, COLS / 2 - 31);
+		win[RBOX] = newwin(14, 30, 3, COLS / 2 + 1);
+		win[CTRAY] = newwin(3, 21, 18, (COLS - 21) /2 );
+		win[SBOX] = newwin(9, 21, 3, (COLS - 21) / 2);
 		break;
-	default:
+	case STYLE_EU:
+		win[LBOX] = newwin(14, 30, 3, COLS / 2 - 31);
+		win[RBOX] = newwin(11, 21, 5, COLS / 2 + 1);
+		win[CTRAY] = newwin(3, 24, 18, (COLS - 24) / 2);
+		win[SBOX] = newwin(9, 24, 3, (COLS - 24) / 2);
 		break;
 	}
+	win[*windows] = (WINDOW *) NULL;
+	return win;
+}
 
-	if ((imac = (WINDOW **) calloc(windows + 1, sizeof(WINDOW *))) == NULL)
-		err(1, NULL);
-
-	imac[BOTTOM] = newwin(1, COLS, LINES - 2, 0);
-	imac[LBOX] = newwin(14, 30, 3, COLS / 2 - 31);
-	imac[RBOX] = newwin(14, 30, 3, COLS / 2 + 1);
-	imac[CTRAY] = newwin(3, 21, 18, (COLS - 21) /2 );
-	imac[SBOX] = newwin(9, 21, 3, (COLS - 21) / 2);
-	imac[windows] = (WINDOW *) NULL;
-
-	for (i = 1; i < (int) windows - 1; ++i) {
-		box(imac[i], 0, 0);
-		wnoutrefresh(imac[i]);
+static void
+show_results(WINDOW **win, const struct session *s)
+{
+	const struct game *g;
+	struct point p;
+	int a, i, width;
+
+	g = &games[s->game];
+	if (g->style == STYLE_JA) {
+		wattron(win[MBOX], COLOR_PAIR(17));
+		print_mid(win[MBOX], 1, 0, 24, "winning numbers");
+		print_mid(win[MBOX], 5, 0, 24, "omake");
+		wattroff(win[MBOX], COLOR_PAIR(17));
+
+		p = makepoint((int) num_mid(24, g->sample), 3);
+		for (i = 0, a = 0; i < g->sample; ++i, ++a)
+			mvwprintw(win[MBOX], p.y, p.x + STEP(a),
+			    "%02d", colorful(win[MBOX], s->main[i]));
+
+		p = makepoint((int) num_mid(24, g->omake), 7);
+		for (i = 0, a = 0; i < g->omake; ++i, ++a)
+			mvwprintw(win[MBOX], p.y, p.x + STEP(a),
+			    "%02d", colorful(win[MBOX], s->bonus[i]));
+		wrefresh(win[MBOX]);
+		return;
 	}
 
-	for (i = 0; i < lmachine->number; ++i)
-		lmachine->v[i] = i + 1;
-	for (i = 0; i < rmachine->number; ++i)
-		rmachine->v[i] = i + 1;
+	width = g->style == STYLE_US ? 21 : 24;
+	wattrset(win[SBOX], COLOR_PAIR(17));
+	print_mid(win[SBOX], 1, 0, width, "winning numbers");
 
-	p = startp = makepoint(2, 1);
-	printvec(imac[LBOX], &startp, 9, lmachine);
-	printvec(imac[RBOX], &startp, 9, rmachine);
+	wattrset(win[SBOX], s->machine[0].color);
+	p = makepoint(2, 3);
+	for (i = 0, a = 0; i < g->sample; ++i, ++a)
+		mvwprintw(win[SBOX], p.y, p.x + STEP(a), "%02d", s->main[i]);
+
+	wattrset(win[SBOX], s->machine[1].color);
+	for (i = 0; i < g->xsample; ++i, ++a)
+		mvwprintw(win[SBOX], p.y, p.x + STEP(a), "%02d",
+		    s->bonus[g->omake + i]);
+	wrefresh(win[SBOX]);
+}
 
-	print_mid(imac[BOTTOM], 0, 0, COLS, "Press <Enter> key");
-	while ((ch = wgetch(imac[BOTTOM])) != ENTER) {
-		if (ch == 'q') {
-			clear_windows(imac, windows);
-			delete_windows(imac, windows);
-			finish(0);
+/*
+ * Brings the windows up to date with whatever the session changed
+ * since the last call.
+ */
+static void
+render(WINDOW **win, size_t windows, struct session *s)
+{
+	const struct game *g;
+	struct point startp;
+	WINDOW *w;
+	int a, i, m, newline;
+
+	g = &games[s->game];
+	startp = makepoint(2, 1);
+	if (s->dirty & D_START) {
+		for (i = 1; i < 4; ++i) {
+			box(win[i], 0, 0);
+			wnoutrefresh(win[i]);
 		}
 	}
-
-	v1 = new_vector(lmachine->sample);
-	v2 = new_vector(lmachine->sample);
-	for (i = 0; i < lmachine->sample + rmachine->sample; ++i) {
-		print_mid(imac[BOTTOM], 0, 0, COLS, "Press <Enter> key");
-		wrefresh(imac[BOTTOM]);
-		if (clock_gettime(CLOCK_REALTIME, &before_ts))
-			err(1, NULL);
-
-		for (j = DAINOBONNOU; j > 0; --j) {
-			shuffle(lmachine);
-			shuffle(rmachine);
-			printvec(imac[LBOX], &startp, 9, lmachine);
-			printvec(imac[RBOX], &startp, 9, rmachine);
-			wnoutrefresh(imac[LBOX]);
-			wnoutrefresh(imac[RBOX]);
-			napms(30);
-			nodelay(imac[LBOX], true);
-			ch = wgetch(imac[LBOX]);
-			if (ch == ENTER)
-				break;
-			else if (ch == 'q') {
-				clear_windows(imac, windows);
-				delete_windows(imac, windows);
-				finish(0);
+	if (s->dirty & D_BALL) {
+		i = s->ball - 1;
+		if (g->style == STYLE_JA) {
+			werase(win[BOTTOM]);
+			wrefresh(win[BOTTOM]);
+			if (i < g->sample) {
+				w = win[MTRAY];
+				a = i;
+			} else {
+				w = win[OTRAY];
+				a = i - g->sample;
 			}
-		}
-		if (i < lmachine->sample) {
-			do {
-				if (clock_gettime(CLOCK_REALTIME, &after_ts))
-					err(1, NULL);
-				ts = diffnsec(&before_ts, &after_ts) %
-				    lmachine->size;
-			} while (lmachine->v[ts] == 0);
-
-			v1[i] = lmachine->v[ts];
-			lmachine->v[ts] = 0;
-			wattrset(imac[CTRAY], lmachine->color);
-			mvwprintw(imac[CTRAY],
-			    p.y, p.x + STEP(a++), "%02d", v1[i]);
-			wrefresh(imac[CTRAY]);
+			mvwprintw(w, startp.y, startp.x + STEP(a), "%02d",
+			    colorful(w, s->tray[i]));
 		} else {
-			do {
-				if (clock_gettime(CLOCK_REALTIME, &after_ts))
-					err(1, NULL);
-				ts = diffnsec(&before_ts, &after_ts) %
-				    rmachine->size;
-			} while (rmachine->v[ts] == 0);
-
-			v3 = rmachine->v[ts];
-			rmachine->v[ts] = 0;
-			wattrset(imac[CTRAY], rmachine->color);
-			mvwprintw(imac[CTRAY], p.y, p.x + STEP(a), "%02d", v3);
-			wrefresh(imac[CTRAY]);
+			w = win[CTRAY];
+			wattrset(w, s->machine[session_source(s, i)].color);
+			mvwprintw(w, startp.y, startp.x + STEP(i), "%02d",
+			    s->tray[i]);
 		}
-		printvec(imac[LBOX], &startp, 9, lmachine);
-		printvec(imac[RBOX], &startp, 9, rmachine);
-		wrefresh(imac[LBOX]);
-		wrefresh(imac[RBOX]);
+		wrefresh(w);
 	}
-	nowsleep(imac[BOTTOM], 0, 0, COLS, 30);
-	clear_windows(imac, windows);
+	if (s->dirty & D_MACHINE) {
+		for (m = 0; m < s->nmachine; ++m) {
+			if (s->state == S_SPINNING && !session_turning(s, m))
+				continue;
+			if (g->style == STYLE_JA) {
+				w = win[MBOX];
+				newline = 7;
+			} else {
+				w = win[m == 0 ? LBOX : RBOX];
+				newline = m == 1 && g->style == STYLE_EU ? 6 : 9;
+			}
+			if (s->drum[m] != NULL)
+				draw_drum(w, &startp, newline, &s->machine[m],
+				    s->drum[m]);
+			else
+				printvec(w, &startp, newline, &s->machine[m]);
+		}
+	}
+	if ((s->dirty & D_PROMPT) && s->state <= S_SPINNING)
+		print_mid(win[BOTTOM], 0, 0, COLS, "Press <Enter> key");
+	if (s->dirty & D_SLEEP)
+		nowsleep(win[BOTTOM], COLS, s->zzz);
+	if (s->dirty & D_RESULT) {
+		clear_windows(win, windows);
+		record_draw(s->game, s->main, s->bonus);
+		show_results(win, s);
+		print_mid(win[BOTTOM], 0, 0, COLS,
+		    "'r' to retry, 'q' to exit");
+	}
+	s->dirty = 0;
+}
 
-	distsort(lmachine->sample, v1, v2);
-	wattrset(imac[SBOX], COLOR_PAIR(17));
-	print_mid(imac[SBOX], 1, 0, 21, "winning numbers");
+/*
+ * Plays one game on the terminal.  Returns true when the player asked
+ * to quit rather than to retry.
+ */
+static bool
+dream(int selected_item)
+{
+	struct session s;
+	WINDOW **win;
+	size_t windows;
+	int64_t now;
+	int ch, ev, m;
+
+	session_init(&s, selected_item, &pool);
+	for (m = 0; m < s.nmachine; ++m)
+		if (machine_pairs[selected_item][m] != 0)
+			s.machine[m].color =
+			    COLOR_PAIR(machine_pairs[selected_item][m]);
+	if (session_drums(&s) == -1)
+		finish_err(NULL);
+	win = open_windows(games[selected_item].style, &windows);
 
-	wattrset(imac[SBOX], lmachine->color);
-	p = makepoint(2, 3);
-	for (i = 0, a = 0; i < lmachine->sample; ++i, ++a)
-		mvwprintw(imac[SBOX], p.y, p.x + STEP(a), "%02d", v2[i]);
-
-	wattrset(imac[SBOX], rmachine->color);
-	mvwprintw(imac[SBOX], p.y, p.x + STEP(a), "%02d", v3);
-	wrefresh(imac[SBOX]);
-
-	print_mid(imac[BOTTOM], 0, 0, COLS, "'r' to retry, 'q' to exit");
-	while ((ch = wgetch(imac[BOTTOM])) != 'r') {
-		if (ch == 'q') {
-			clear_windows(imac, windows);
-			delete_windows(imac, windows);
-			finish(0);
+	for (;;) {
+		render(win, windows, &s);
+		if (s.state == S_RETRY || s.state == S_QUIT)
+			break;
+		now = now_ms();
+		if (s.due == SESSION_WAIT)
+			wtimeout(win[BOTTOM], -1);
+		else
+			wtimeout(win[BOTTOM],
+			    s.due > now ? (int) (s.due - now) : 0);
+		switch (ch = wgetch(win[BOTTOM])) {
+		case ENTER:
+			ev = E_ENTER;
+			break;
+		case 'r':
+			ev = E_RETRY;
+			break;
+		case 'q':
+			ev = E_QUIT;
+			break;
+		default:
+			ev = E_TICK;
+			break;
 		}
+		session_step(&s, ev, now_ms());
+	}
+	clear_windows(win, windows);
+	delete_windows(win, windows);
+	session_free(&s);
+	return s.state == S_QUIT;
+}
+
+/*
+ * Shows ball b on the keno board: picked spots in reverse, drawn balls
+ * in their colours.
+ */
+static void
+keno_ball(WINDOW *win, int b, bool picked, bool drawn)
+{
+	if (drawn)
+		colorful(win, b);
+	else
+		wattrset(win, A_NORMAL);
+	if (picked)
+		wattron(win, A_REVERSE);
+	mvwprintw(win, 1 + (b - 1) / 10, 2 + STEP((b - 1) % 10), "%02d", b);
+}
+
+/*
+ * Plays one keno game: the player chooses how many spots to quick pick,
+ * then the twenty balls come out one by one on a board of all eighty.
+ * The ticket is settled ball by ball as a house of one.  Returns true
+ * when the player asked to quit rather than to retry.
+ */
+static bool
+keno_dream(void)
+{
+	WINDOW *board, *info, *bottom;
+	struct keno *k;
+	bool picked[KENO_N + 1];
+	int ball[KENO_S], pick[KENO_MAXSPOT];
+	int b, ch, hits, i, spots;
+
+	board = newwin(10, 33, 3, (COLS - 33) / 2);
+	info = newwin(1, COLS, 14, 0);
+	bottom = newwin(1, COLS, LINES - 2, 0);
+	memset(picked, 0, sizeof(picked));
+	box(board, 0, 0);
+	for (b = 1; b <= KENO_N; ++b)
+		keno_ball(board, b, false, false);
+	wrefresh(board);
+
+	print_mid(bottom, 0, 0, COLS, "Press 1-9, or 0 for 10 spots");
+	do {
+		ch = wgetch(bottom);
+		if (ch == 'q')
+			goto out;
+	} while (ch < '0' || ch > '9');
+	spots = ch == '0' ? 10 : ch - '0';
+	keno_pick(&pool, spots, pick);
+	if ((k = keno_new()) == NULL || keno_add(k, pick, spots) == -1 ||
+	    keno_close(k) == -1)
+		finish_err(NULL);
+	for (i = 0; i < spots; ++i) {
+		picked[pick[i]] = true;
+		keno_ball(board, pick[i], true, false);
 	}
-	free_vector(v1);
-	free_vector(v2);
-	free_machine(lmachine);
-	free_machine(rmachine);
-	clear_windows(imac, windows);
-	delete_windows(imac, windows);
+	wrefresh(board);
+
+	print_mid(bottom, 0, 0, COLS, "Press <Enter> key");
+	while ((ch = wgetch(bottom)) != ENTER)
+		if (ch == 'q')
+			goto done;
+	werase(bottom);
+	wrefresh(bottom);
+	keno_draw(&pool, ball);
+	wtimeout(bottom, KENO_BALL_MS);
+	for (hits = 0, i = 0; i < KENO_S; ++i) {
+		keno_reveal(k, ball[i]);
+		if (picked[ball[i]])
+			++hits;
+		keno_ball(board, ball[i], picked[ball[i]], true);
+		wrefresh(board);
+		werase(info);
+		wattrset(info, A_NORMAL);
+		mvwprintw(info, 0, (COLS - 36) / 2,
+		    "ball %2d   %2d of %2d hit   pays %6llu", i + 1, hits,
+		    spots, (unsigned long long) k->paid);
+		wrefresh(info);
+		if (i + 1 < KENO_S && (ch = wgetch(bottom)) == 'q')
+			goto done;
+	}
+	wtimeout(bottom, -1);
+	print_mid(bottom, 0, 0, COLS, "'r' to retry, 'q' to exit");
+	while ((ch = wgetch(bottom)) != 'r' && ch != 'q')
+		;
+done:
+	keno_free(k);
+out:
+	wtimeout(bottom, -1);
+	werase(board);
+	werase(info);
+	werase(bottom);
+	wrefresh(board);
+	wrefresh(info);
+	wrefresh(bottom);
+	delwin(board);
+	delwin(info);
+	delwin(bottom);
+	return ch == 'q';
 }
 
+/*
+ * Prints one page of lines into win, one line per row after a heading.
+ */
 static void
-eu_dream(int selected_item)
+show_page(WINDOW *win, int game, const vector main, const vector bonus,
+    size_t n, size_t first)
 {
-	WINDOW **emac = NULL;
-	GARAPON *lmachine = NULL;
-	GARAPON *rmachine = NULL;
-	struct point p, startp;
-	struct timespec before_ts, after_ts;
-	vector v1 = NULL;
-	vector v2 = NULL;
-	vector v3 = NULL;
-	int a = 0;
+	const struct game *g;
+	size_t t;
+	int i, nb, rows, x, y;
+
+	g = &games[game];
+	nb = GAME_BONUS(g);
+	rows = getmaxy(win) - 1;
+	werase(win);
+	wattrset(win, COLOR_PAIR(17));
+	mvwprintw(win, 0, 0, "%s: lines %zu-%zu of %zu", g->name, first + 1,
+	    MIN(first + rows, n), n);
+	for (y = 1, t = first; y <= rows && t < n; ++y, ++t) {
+		wattrset(win, A_NORMAL);
+		mvwprintw(win, y, 0, "%7zu ", t + 1);
+		for (x = 8, i = 0; i < g->sample; ++i, x += 3)
+			mvwprintw(win, y, x, "%02d",
+			    colorful(win, main[t * g->sample + i]));
+		if (nb > 0) {
+			wattrset(win, A_NORMAL);
+			mvwprintw(win, y, x, "+");
+			x += 2;
+		}
+		for (i = 0; i < nb; ++i, x += 3) {
+			if (i >= g->omake && machine_pairs[game][1] != 0)
+				wattrset(win, COLOR_PAIR(machine_pairs[game][1]));
+			else
+				colorful(win, bonus[t * nb + i]);
+			mvwprintw(win, y, x, "%02d", bonus[t * nb + i]);
+		}
+	}
+	wrefresh(win);
+}
+
+/*
+ * Draws n lines of a game in one pass and pages through them.  Returns
+ * true when the player asked to quit rather than to retry.
+ */
+static bool
+dream_lines(int game, size_t n)
+{
+	const struct game *g;
+	WINDOW *win, *bottom;
+	vector main, bonus;
+	size_t first, rows;
 	int ch;
-	int i, j;
-	int selected_lot;
-	size_t ts;
-	size_t windows = 5;
-
-	selected_lot = selected_item;
-	switch (selected_lot) {
-	case 5:
-		lmachine = make_machine(EU_SIZE,
-		    SMAIN_N,
-		    SMAIN_S,
-		    0,
-		    COLOR_PAIR(11));
-		rmachine = make_machine(LS_SIZE,
-		    STARS_N,
-		    STARS_S,
-		    0,
-		    COLOR_PAIR(13));
-		if (lmachine == NULL || rmachine == NULL)
-			err(1, NULL);
-		break;
-	default:
-		break;
+
+	g = &games[game];
+	main = (vector) malloc(n * g->sample * sizeof(int));
+	bonus = (vector) malloc(n * MAX(GAME_BONUS(g), 1) * sizeof(int));
+	if (main == NULL || bonus == NULL)
+		finish_err(NULL);
+	win = newwin(LINES - 4, COLS, 2, 0);
+	bottom = newwin(1, COLS, LINES - 2, 0);
+	keypad(bottom, true);
+	rows = LINES - 5;
+
+	draw_lines(g, &pool, main, bonus, n);
+	print_mid(bottom, 0, 0, COLS,
+	    "<space>/'b' to page, 'r' to retry, 'q' to exit");
+	first = 0;
+	for (;;) {
+		show_page(win, game, main, bonus, n, first);
+		ch = wgetch(bottom);
+		if (ch == 'q' || ch == 'r')
+			break;
+		if ((ch == ' ' || ch == KEY_NPAGE) && first + rows < n)
+			first += rows;
+		else if ((ch == 'b' || ch == KEY_PPAGE) && first > 0)
+			first -= MIN(first, rows);
 	}
+	werase(win);
+	werase(bottom);
+	wrefresh(win);
+	wrefresh(bottom);
+	delwin(win);
+	delwin(bottom);
+	free(main);
+	free(bonus);
+	return ch == 'q';
+}
 
-	if ((emac = (WINDOW **) calloc(windows + 1, sizeof(WINDOW *))) == NULL)
-		err(1, NULL);
+enum {
+	OPT_WHEEL = 256,
+	OPT_NUMBERS,
+	OPT_MATCH,
+	OPT_DRAWN,
+	OPT_SECONDS,
+	OPT_SIMULATE,
+	OPT_SCENARIOS,
+	OPT_YEARS,
+	OPT_SALES,
+	OPT_SEED,
+	OPT_SETTLE,
+	OPT_BONUS,
+	OPT_TOP,
+	OPT_CHECKPOINT,
+	OPT_INTERVAL,
+	OPT_RESUME,
+	OPT_SHARDS,
+	OPT_FREQ,
+	OPT_WINDOW,
+	OPT_SINCE,
+	OPT_COOC,
+	OPT_DRAWS,
+	OPT_FILTER,
+	OPT_SUM,
+	OPT_ODD,
+	OPT_RUN,
+	OPT_EXCLUDE,
+	OPT_DECADES,
+	OPT_LINES,
+	OPT_KENO,
+	OPT_SPOTS,
+	OPT_GAME,
+	OPT_FORMAT,
+	OPT_LOOKUP,
+	OPT_TICKETS,
+	OPT_HITS,
+	OPT_RARE
+};
+
+static const struct option longopts[] = {
+	{ "broadcast",	required_argument,	NULL,	'b' },
+	{ "history",	required_argument,	NULL,	'd' },
+	{ "grid",	required_argument,	NULL,	'g' },
+	{ "threads",	required_argument,	NULL,	'j' },
+	{ "output",	required_argument,	NULL,	'o' },
+	{ "serve",	required_argument,	NULL,	's' },
+	{ "wheel",	required_argument,	NULL,	OPT_WHEEL },
+	{ "numbers",	required_argument,	NULL,	OPT_NUMBERS },
+	{ "match",	required_argument,	NULL,	OPT_MATCH },
+	{ "drawn",	required_argument,	NULL,	OPT_DRAWN },
+	{ "seconds",	required_argument,	NULL,	OPT_SECONDS },
+	{ "simulate",	required_argument,	NULL,	OPT_SIMULATE },
+	{ "scenarios",	required_argument,	NULL,	OPT_SCENARIOS },
+	{ "years",	required_argument,	NULL,	OPT_YEARS },
+	{ "sales",	required_argument,	NULL,	OPT_SALES },
+	{ "seed",	required_argument,	NULL,	OPT_SEED },
+	{ "settle",	required_argument,	NULL,	OPT_SETTLE },
+	{ "bonus",	required_argument,	NULL,	OPT_BONUS },
+	{ "top",	required_argument,	NULL,	OPT_TOP },
+	{ "checkpoint",	required_argument,	NULL,	OPT_CHECKPOINT },
+	{ "interval",	required_argument,	NULL,	OPT_INTERVAL },
+	{ "resume",	no_argument,		NULL,	OPT_RESUME },
+	{ "shards",	required_argument,	NULL,	OPT_SHARDS },
+	{ "freq",	required_argument,	NULL,	OPT_FREQ },
+	{ "window",	required_argument,	NULL,	OPT_WINDOW },
+	{ "since",	required_argument,	NULL,	OPT_SINCE },
+	{ "cooc",	required_argument,	NULL,	OPT_COOC },
+	{ "draws",	required_argument,	NULL,	OPT_DRAWS },
+	{ "filter",	required_argument,	NULL,	OPT_FILTER },
+	{ "sum",	required_argument,	NULL,	OPT_SUM },
+	{ "odd",	required_argument,	NULL,	OPT_ODD },
+	{ "run",	required_argument,	NULL,	OPT_RUN },
+	{ "exclude",	required_argument,	NULL,	OPT_EXCLUDE },
+	{ "decades",	required_argument,	NULL,	OPT_DECADES },
+	{ "lines",	required_argument,	NULL,	OPT_LINES },
+	{ "keno",	required_argument,	NULL,	OPT_KENO },
+	{ "spots",	required_argument,	NULL,	OPT_SPOTS },
+	{ "game",	required_argument,	NULL,	OPT_GAME },
+	{ "format",	required_argument,	NULL,	OPT_FORMAT },
+	{ "lookup",	required_argument,	NULL,	OPT_LOOKUP },
+	{ "tickets",	required_argument,	NULL,	OPT_TICKETS },
+	{ "hits",	required_argument,	NULL,	OPT_HITS },
+	{ "rare",	no_argument,		NULL,	OPT_RARE },
+	{ NULL,		0,			NULL,	0 }
+};
 
-	emac[BOTTOM] = newwin(1, COLS, LINES - 2, 0);
-	emac[LBOX] = newwin(14, 30, 3, COLS / 2 - 31);
-	emac[RBOX] = newwin(11, 21, 5, COLS / 2 + 1);
-	emac[CTRAY] = newwin(3, 24, 18, (COLS - 24) / 2);
-	emac[SBOX] = newwin(9, 24, 3, (COLS - 24) / 2);
-	emac[windows] = (WINDOW *) NULL;
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: garapon [-b shmname] [-d histdir] [-g machines] "
+	    "[--lines n]\n"
+	    "       garapon --wheel game --numbers n,n,... --match k "
+	    "[--drawn m]\n"
+	    "               [--seconds s] [-j threads] [-o file]\n"
+	    "       garapon --simulate game [--scenarios n] [--years n] "
+	    "[--sales n]\n"
+	    "               [--seed n] [-j threads] [--shards n |\n"
+	    "               --checkpoint file [--interval s] [--resume]]\n"
+	    "       garapon --simulate game --rare [--tickets file] "
+	    "[--draws n] [--seed n]\n"
+	    "               [-j threads]\n"
+	    "       garapon --settle tickets [--numbers n,n,... "
+	    "[--bonus n,...]] [--top n]\n"
+	    "               [-j threads]\n"
+	    "       garapon -d histdir --freq game [--window n | "
+	    "--since yyyy-mm-dd] [--top n]\n"
+	    "       garapon --cooc game [-d histdir | --draws n [--seed n] "
+	    "[-j threads]]\n"
+	    "               [--top n] [-o file]\n"
+	    "       garapon --filter game [--sum lo-hi] [--odd lo-hi] "
+	    "[--run n]\n"
+	    "               [--exclude n,...] [--decades lo-hi] [-j threads] "
+	    "[-o file]\n"
+	    "       garapon --game game [--draws n] [--format ndjson|bin] "
+	    "[--seed n]\n"
+	    "               [-o file]\n"
+	    "       garapon -d histdir --lookup game (--numbers n,... | "
+	    "--tickets file)\n"
+	    "               [--hits k] [--top n] [-j threads]\n"
+	    "       garapon --keno tickets [--spots n] [--seed n]\n"
+	    "       garapon -s socket [-b shmname] [-d histdir] [--seed n]\n");
+	exit(1);
+}
+
+static int
+getnum(const char *name, const char *arg, int lo, int hi)
+{
+	char *end;
+	long n;
+
+	errno = 0;
+	n = strtol(arg, &end, 10);
+	if (errno != 0 || *end != '\0' || end == arg || n < lo || n > hi)
+		errx(1, "%s: must be %d to %d", name, lo, hi);
+	return (int) n;
+}
+
+static int
+getlist(const char *name, char *arg, vector v, int max)
+{
+	char *p;
+	int n = 0;
 
-	for (i = 1; i < (int) windows - 1; ++i) {
-		box(emac[i], 0, 0);
-		wnoutrefresh(emac[i]);
+	while ((p = strsep(&arg, ",")) != NULL) {
+		if (n == max)
+			errx(1, "%s: at most %d numbers", name, max);
+		v[n++] = getnum(name, p, 1, INT_MAX);
 	}
+	return n;
+}
 
-	for (i = 0; i < lmachine->number; ++i)
-		lmachine->v[i] = i + 1;
-	for (i = 0; i < rmachine->number; ++i)
-		rmachine->v[i] = i + 1;
+/*
+ * A range given as lo-hi, or as a single number.
+ */
+static void
+getrange(const char *name, char *arg, int *lo, int *hi)
+{
+	char *p;
 
-	p = startp = makepoint(2, 1);
-	printvec(emac[LBOX], &startp, 9, lmachine);
-	printvec(emac[RBOX], &startp, 6, rmachine);
+	if ((p = strchr(arg, '-')) != NULL)
+		*p++ = '\0';
+	*lo = getnum(name, arg, 0, INT_MAX);
+	*hi = p != NULL ? getnum(name, p, *lo, INT_MAX) : *lo;
+}
 
-	print_mid(emac[BOTTOM], 0, 0, COLS, "Press <Enter> key");
-	while ((ch = wgetch(emac[BOTTOM])) != ENTER) {
-		if (ch == 'q') {
-			clear_windows(emac, windows);
-			delete_windows(emac, windows);
-			finish(0);
-		}
+/*
+ * Exits when a number of v, each 1 to GAME_MAXNUMBER, is already in the
+ * mask seen; marks the numbers in it otherwise.
+ */
+static void
+distinct(const char *name, const vector v, int n, uint64_t *seen)
+{
+	uint64_t bit;
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		bit = (uint64_t) 1 << ((v[i] - 1) & 63);
+		if (seen[(v[i] - 1) >> 6] & bit)
+			errx(1, "%s: %d given twice", name, v[i]);
+		seen[(v[i] - 1) >> 6] |= bit;
 	}
+}
 
-	v1 = new_vector(lmachine->sample);
-	v2 = new_vector(lmachine->sample);
-	v3 = new_vector(rmachine->sample);
-	for (i = 0; i < lmachine->sample + rmachine->sample; ++i) {
-		print_mid(emac[BOTTOM], 0, 0, COLS, "Press <Enter> key");
-		wrefresh(emac[BOTTOM]);
-		if (clock_gettime(CLOCK_REALTIME, &before_ts))
-			err(1, NULL);
+static int
+getgame(const char *arg)
+{
+	int g;
 
-		for (j = DAINOBONNOU; j > 0; --j) {
-			if (i < lmachine->sample) {
-				shuffle(lmachine);
-				printvec(emac[LBOX], &startp, 9, lmachine);
-				wnoutrefresh(emac[LBOX]);
-			} else {
-				shuffle(rmachine);
-				printvec(emac[RBOX], &startp, 6, rmachine);
-				wnoutrefresh(emac[RBOX]);
-			}
-			napms(30);
-			nodelay(emac[LBOX], true);
-			ch = wgetch(emac[LBOX]);
-			if (ch == ENTER)
-				break;
-			else if (ch == 'q') {
-				clear_windows(emac, windows);
-				delete_windows(emac, windows);
-				finish(0);
-			}
-		}
-		if (i < lmachine->sample) {
-			do {
-				if (clock_gettime(CLOCK_REALTIME, &after_ts))
-					err(1, NULL);
-				ts = diffnsec(&before_ts, &after_ts) %
-				    lmachine->size;
-			} while (lmachine->v[ts] == 0);
-
-			v1[i] = lmachine->v[ts];
-			lmachine->v[ts] = 0;
-			wattrset(emac[CTRAY], lmachine->color);
-			mvwprintw(emac[CTRAY],
-			    p.y, p.x + STEP(a++), "%02d", v1[i]);
-			wrefresh(emac[CTRAY]);
-		} else {
-			do {
-				if (clock_gettime(CLOCK_REALTIME, &after_ts))
-					err(1, NULL);
-				ts = diffnsec(&before_ts, &after_ts) %
-				    rmachine->size;
-			} while (rmachine->v[ts] == 0);
-
-			v3[i - lmachine->sample] = rmachine->v[ts];
-			rmachine->v[ts] = 0;
-			wattrset(emac[CTRAY], rmachine->color);
-			mvwprintw(emac[CTRAY], p.y, p.x + STEP(a++),
-			    "%02d", v3[i - lmachine->sample]);
-			wrefresh(emac[CTRAY]);
-		}
-		printvec(emac[LBOX], &startp, 9, lmachine);
-		printvec(emac[RBOX], &startp, 6, rmachine);
-		wrefresh(emac[LBOX]);
-		wrefresh(emac[RBOX]);
+	if ((g = find_game(arg)) == -1)
+		errx(1, "%s: unknown game", arg);
+	return g;
+}
+
+static void
+run_wheel(struct wheel_spec *spec, const char *output)
+{
+	struct wheel w;
+	uint32_t t;
+	int i;
+
+	distsort(spec->n, spec->numbers, spec->numbers);
+	if (wheel_build(spec, &w) == -1)
+		err(1, "wheel");
+	printf("%d tickets\n", w.size);
+	for (i = 0; i < w.size; ++i) {
+		for (t = w.ticket[i]; t != 0; t &= t - 1)
+			printf("%02d%s", spec->numbers[__builtin_ctz(t)],
+			    (t & (t - 1)) ? " " : "\n");
 	}
-	nowsleep(emac[BOTTOM], 0, 0, COLS, 30);
-	clear_windows(emac, windows);
+	if (output != NULL && wheel_save(spec, &w, output) == -1)
+		err(1, "%s", output);
+	wheel_free(&w);
+}
 
-	distsort(lmachine->sample, v1, v2);
-	wattrset(emac[SBOX], COLOR_PAIR(17));
-	print_mid(emac[SBOX], 1, 0, 24, "winning numbers");
+static void
+run_simulation(struct sim_params *sp, int game, int shards)
+{
+	struct sim_result *r;
 
-	wattrset(emac[SBOX], lmachine->color);
-	p = makepoint(2, 3);
-	for (i = 0, a = 0; i < lmachine->sample; ++i, ++a)
-		mvwprintw(emac[SBOX], p.y, p.x + STEP(a), "%02d", v2[i]);
-
-	wattrset(emac[SBOX], rmachine->color);
-	mvwprintw(emac[SBOX], p.y, p.x + STEP(a++), "%02d", MIN(v3[0], v3[1]));
-	mvwprintw(emac[SBOX], p.y, p.x + STEP(a), "%02d", MAX(v3[0], v3[1]));
-	wrefresh(emac[SBOX]);
-
-	print_mid(emac[BOTTOM], 0, 0, COLS, "'r' to retry, 'q' to exit");
-	while ((ch = wgetch(emac[BOTTOM])) != 'r') {
-		if (ch == 'q') {
-			clear_windows(emac, windows);
-			delete_windows(emac, windows);
-			finish(0);
-		}
+	sp->game = game;
+	sim_defaults(sp);
+	r = shards > 0 ? shard_run(sp, shards) : sim_run(sp);
+	sim_report(stdout, sp, r);
+	free(r);
+}
+
+static double
+elapsed(const struct timespec *t0)
+{
+	struct timespec t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/*
+ * Lists the hottest and coldest main numbers of a game over the last
+ * window draws, or since a date, or over its whole history.
+ */
+static void
+run_freq(int game, int window, const char *since, int top)
+{
+	struct freq_rank hot[GAME_MAXNUMBER], cold[GAME_MAXNUMBER];
+	struct timespec t0;
+	struct freq *f;
+	struct tm tm;
+	size_t from, to;
+	double us;
+	int i, n;
+
+	if ((f = hist_freq(history, game)) == NULL)
+		err(1, "%s", histdir);
+	if ((to = f->n) == 0) {
+		printf("%s: no draws\n", games[game].name);
+		return;
+	}
+	from = 0;
+	if (window > 0)
+		from = to > (size_t) window ? to - window : 0;
+	if (since != NULL) {
+		memset(&tm, 0, sizeof(tm));
+		if (strptime(since, "%Y-%m-%d", &tm) == NULL)
+			errx(1, "%s: not a date", since);
+		tm.tm_isdst = -1;
+		from = freq_since(f, (int64_t) mktime(&tm));
 	}
-	free_vector(v1);
-	free_vector(v2);
-	free_vector(v3);
-	free_machine(lmachine);
-	free_machine(rmachine);
-	clear_windows(emac, windows);
-	delete_windows(emac, windows);
+	top = MAX(top, 1);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	n = freq_top(f, from, to, 0, hot, top);
+	freq_top(f, from, to, 1, cold, top);
+	us = elapsed(&t0) * 1e6;
+
+	printf("%s: draws %zu to %zu of %zu\n", games[game].name, from,
+	    to - 1, to);
+	printf("%4s %8s %8s   %8s %8s\n", "", "hot", "times", "cold", "times");
+	for (i = 0; i < n; ++i)
+		printf("%4d %8d %8u   %8d %8u\n", i + 1, hot[i].ball,
+		    hot[i].count, cold[i].ball, cold[i].count);
+	printf("%.1f us\n", us);
 }
 
+/*
+ * How close one ticket, or every ticket of a file, came to the draws of
+ * the history: the best match and the draws with at least k hits.
+ */
 static void
-ja_dream(int selected_item)
+run_lookup(int game, vector numbers, int n, const char *path, int k,
+    int top, int threads)
 {
-	WINDOW **imac = NULL;
-	GARAPON *mmachine = NULL;
-	struct point p, startp;
-	struct timespec before_ts, after_ts;
-	vector v1 = NULL;
-	vector v2 = NULL;
-	vector v3 = NULL;
-	int selected_lot;
-	int a = 0;
-	int ch;
-	int i, j;
-	size_t ts;
-	size_t windows = 4;
-
-	selected_lot = selected_item;
-	switch (selected_lot) {
-	case 0:
-		mmachine = make_machine(JA_SIZE,
-		    MIN_L_N,
-		    MIN_L_S,
-		    MIN_L_O,
-		    NOT_SET);
-		if (mmachine == NULL)
-			err(1, NULL);
-		break;
-	case 1:
-		mmachine = make_machine(JA_SIZE,
-		    L_SIX_N,
-		    L_SIX_S,
-		    L_SIX_O,
-		    NOT_SET);
-		if (mmachine == NULL)
-			err(1, NULL);
-		break;
-	case 2:
-		mmachine = make_machine(JA_SIZE,
-		    L_SEV_N,
-		    L_SEV_S,
-		    L_SEV_O,
-		    NOT_SET);
-		if (mmachine == NULL)
-			err(1, NULL);
-		break;
-	default:
-		break;
+	const struct game *g;
+	struct hitidx_result r;
+	struct hitidx_query q;
+	struct stage stage;
+	struct timespec t0;
+	struct hitidx *x;
+	struct tm tm;
+	int64_t stamp;
+	time_t t;
+	uint64_t seen[2];
+	size_t *draws;
+	size_t i, nlist;
+	int j, main[GAME_MAXPICK], bonus[GAME_MAXBONUS];
+	char date[16];
+	void *out;
+
+	g = &games[game];
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if ((x = hitidx_history(history, game)) == NULL)
+		err(1, "%s", histdir);
+	printf("%s: %zu draws indexed in %.3f s\n", g->name, x->n,
+	    elapsed(&t0));
+	if (x->n == 0) {
+		hitidx_free(x);
+		return;
 	}
 
-	if ((imac = (WINDOW **) calloc(windows + 1, sizeof(WINDOW *))) == NULL)
+	if (path != NULL) {
+		memset(&q, 0, sizeof(q));
+		q.x = x;
+		q.k = k;
+		stage = hitidx_stage;
+		stage.arg = &q;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (ingest(path, threads, &stage, 1, &out) == -1)
+			err(1, "%s", path);
+		hitidx_report(stdout, out);
+		printf("matched in %.3f s\n", elapsed(&t0));
+		stage.close(out);
+		hitidx_free(x);
+		return;
+	}
+
+	if (n != g->sample)
+		errx(1, "numbers: %s takes %d numbers", g->name, g->sample);
+	for (i = 0; i < (size_t) n; ++i)
+		if (numbers[i] > g->number)
+			errx(1, "numbers: must be 1 to %d", g->number);
+	memset(seen, 0, sizeof(seen));
+	distinct("numbers", numbers, n, seen);
+	if ((draws = (size_t *) malloc(MAX(top, 1) * sizeof(size_t))) == NULL)
 		err(1, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	nlist = hitidx_match(x, numbers, k, &r, draws, top);
+	printf("best %d in draw %zu, %llu draws with %d or more (%.1f us)\n",
+	    r.best, r.draw, (unsigned long long) r.count, k,
+	    elapsed(&t0) * 1e6);
+	for (i = 0; i < nlist; ++i) {
+		if (hist_get(history, game, draws[i], main, bonus,
+		    &stamp) == -1)
+			err(1, "%s", histdir);
+		t = (time_t) stamp;
+		localtime_r(&t, &tm);
+		strftime(date, sizeof(date), "%Y-%m-%d", &tm);
+		printf("%10zu %s ", draws[i], date);
+		for (j = 0; j < g->sample; ++j)
+			printf(" %02d", main[j]);
+		printf("\n");
+	}
+	free(draws);
+	hitidx_free(x);
+}
 
-	imac[BOTTOM] = newwin(1, COLS, LINES - 2, 0);
-	imac[MBOX] = newwin(12, 24, 3, (COLS - 24) >> 1);
-	imac[MTRAY] = newwin(3, 24, 15, (COLS - 24) >> 1);
-	imac[OTRAY] = newwin(3, 24, 18, (COLS - 24) >> 1);
-	imac[windows] = (WINDOW *) NULL;
+static void
+run_filter(struct filter *f, const vector exclude, int n, int threads,
+    const char *output)
+{
+	struct timespec t0;
+	int64_t count;
+	int i;
 
-	for (i = 1; i < (int) windows; ++i) {
-		box(imac[i], 0, 0);
-		wnoutrefresh(imac[i]);
+	for (i = 0; i < n; ++i) {
+		if (exclude[i] > games[f->game].number)
+			errx(1, "exclude: must be 1 to %d",
+			    games[f->game].number);
+		f->exclude[(exclude[i] - 1) >> 6] |=
+		    (uint64_t) 1 << ((exclude[i] - 1) & 63);
 	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if ((count = filter_run(f, output, threads)) == -1)
+		err(1, "%s", output);
+	printf("%lld of %llu tickets in %.2f s\n", (long long) count,
+	    (unsigned long long) comb_count(games[f->game].number,
+	    games[f->game].sample), elapsed(&t0));
+}
 
-	for (i = 0; i < mmachine->number; ++i)
-		mmachine->v[i] = i + 1;
+/*
+ * Pair and triple counts of a game's history when there is one, or else
+ * of draws simulated draws, optionally saved to output.
+ */
+static void
+run_cooc(int game, int draws, uint64_t seed, int threads, int top,
+    const char *output)
+{
+	struct timespec t0;
+	struct cooc *c;
 
-	p = startp = makepoint(2, 1);
-	printvec(imac[MBOX], &startp, 7, mmachine);
-	wnoutrefresh(imac[MBOX]);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (history != NULL)
+		c = cooc_history(history, game);
+	else
+		c = cooc_simulate(game, draws, seed, threads);
+	if (c == NULL)
+		err(1, "%s", history != NULL ? histdir : "cooc");
+	cooc_report(stdout, c, top);
+	printf("%.2f s\n", elapsed(&t0));
+	if (output != NULL && cooc_write(c, output) == -1)
+		err(1, "%s", output);
+	cooc_free(c);
+}
 
-	print_mid(imac[BOTTOM], 0, 0, COLS, "Press <Enter> key");
-	while ((ch = wgetch(imac[BOTTOM])) != ENTER) {
-		if (ch == 'q') {
-			clear_windows(imac, windows);
-			delete_windows(imac, windows);
-			finish(0);
+/*
+ * Odds of the rare prize tiers for the tickets in path, or for one
+ * quick pick, from draws importance-sampled draws.
+ */
+static void
+run_rare(int game, const char *path, int draws, uint64_t seed,
+    int threads)
+{
+	const struct game *g;
+	struct rare_result r;
+	struct timespec t0;
+	struct tkfile *tk;
+	vector t;
+	size_t n;
+	int bonus[GAME_MAXBONUS];
+
+	g = &games[game];
+	if (path == NULL) {
+		if ((t = (vector) malloc(TK_WIDTH(g) * sizeof(int))) == NULL)
+			err(1, NULL);
+		/* a quick pick and extras, on a stream past the draws' */
+		n = 1;
+		pool_seed(&pool, seed, UINT64_MAX);
+		draw_game(g, &pool, t, bonus);
+		memcpy(t + g->sample, bonus + g->omake,
+		    g->xsample * sizeof(int));
+	} else {
+		if ((tk = tk_open(path)) == NULL)
+			err(1, "%s", path);
+		if (tk->game != game)
+			errx(1, "%s: %s tickets", path,
+			    games[tk->game].name);
+		if (tk->count == 0)
+			errx(1, "%s: no tickets", path);
+		if ((t = (vector) malloc(tk->count * tk->width *
+		    sizeof(int))) == NULL)
+			err(1, NULL);
+		if ((n = tk_read(tk, t, tk->count)) != tk->count) {
+			if (tk->error != 0)
+				err(1, "%s", path);
+			errx(1, "%s: short file", path);
 		}
+		tk_close(tk);
 	}
-	werase(imac[BOTTOM]);
-	wrefresh(imac[BOTTOM]);
-
-	v1 = new_vector(mmachine->sample);
-	v2 = new_vector(mmachine->sample);
-	v3 = new_vector(mmachine->omake);
-	for (i = 0; i < mmachine->sample + mmachine->omake; ++i) {
-		print_mid(imac[BOTTOM], 0, 0, COLS, "Press <Enter> key");
-		wrefresh(imac[BOTTOM]);
-		if (clock_gettime(CLOCK_REALTIME, &before_ts))
-			err(1, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (rare_run(game, t, n, draws, seed, threads, &r) == -1)
+		err(1, "rare");
+	rare_report(stdout, &r);
+	printf("%.2f s\n", elapsed(&t0));
+	free(t);
+}
 
-		for (j = DAINOBONNOU; j > 0; --j) {
-			shuffle(mmachine);
-			printvec(imac[MBOX], &startp, 7, mmachine);
-			wrefresh(imac[MBOX]);
-			napms(30);
-			nodelay(imac[BOTTOM], true);
-			ch = wgetch(imac[BOTTOM]);
-			if (ch == ENTER)
-				break;
-			else if (ch  == 'q') {
-				clear_windows(imac, windows);
-				delete_windows(imac, windows);
-				finish(0);
-			}
-		}
-		werase(imac[BOTTOM]);
-		wrefresh(imac[BOTTOM]);
-
-		do {
-			if (clock_gettime(CLOCK_REALTIME, &after_ts))
-				err(1, NULL);
-			ts = diffnsec(&before_ts, &after_ts) %
-			    mmachine->size;
-		} while (mmachine->v[ts] == 0);
-
-		if (i < mmachine->sample) {
-			v1[i] = mmachine->v[ts];
-			mmachine->v[ts] = 0;
-			mvwprintw(imac[MTRAY], p.y, p.x + STEP(a++), "%02d",
-			    colorful(imac[MTRAY], v1[i]));
-			wrefresh(imac[MTRAY]);
-		} else {
-			v3[i - mmachine->sample] = mmachine->v[ts];
-			mmachine->v[ts] = 0;
-			mvwprintw(imac[OTRAY], p.y, p.x, "%02d",
-			    colorful(imac[OTRAY], v3[i - mmachine->sample]));
-			wrefresh(imac[OTRAY]);
-			p.x += 3;
-		}
-		printvec(imac[MBOX], &startp, 7, mmachine);
-		wrefresh(imac[MBOX]);
+/*
+ * Indexes the tickets in path and lists the top most popular
+ * combinations, answers the match counts of the draw from the index
+ * alone, then settles the draw by a full ticket scan.  Without numbers
+ * the draw is made here.
+ */
+static void
+run_settlement(const char *path, const vector numbers, int n,
+    const vector bonus, int nb, int top, int threads)
+{
+	const struct game *g;
+	struct stage stage, stages[2];
+	struct settle draw;
+	struct subidx *x;
+	struct timespec t0;
+	uint64_t exact[GAME_MAXPICK + 1], winners[PRIZE_MAXTIER];
+	uint64_t seen[2], total;
+	void *out, *st[2];
+	double dt;
+	int game, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	stages[0] = subidx_stage;
+	stages[1] = sketch_stage;
+	if ((game = ingest(path, threads, stages, 2, st)) == -1)
+		err(1, "%s", path);
+	x = st[0];
+	g = &games[game];
+	printf("%s: %llu tickets indexed in %.3f s\n", g->name,
+	    (unsigned long long) x->tickets, elapsed(&t0));
+	if (top > 0)
+		sketch_report(stdout, st[1], top);
+	sketch_free(st[1]);
+
+	memset(&draw, 0, sizeof(draw));
+	draw.game = game;
+	if (n == 0)
+		draw_game(g, &pool, draw.main, draw.bonus);
+	else {
+		if (n != g->sample || nb != GAME_BONUS(g))
+			errx(1, "%s: %d numbers and %d bonus numbers", g->name,
+			    g->sample, GAME_BONUS(g));
+		for (i = 0; i < n; ++i)
+			if (numbers[i] > g->number)
+				errx(1, "numbers: %d out of range", numbers[i]);
+		for (i = 0; i < nb; ++i)
+			if (bonus[i] > (i < g->omake ? g->number : g->xnumber))
+				errx(1, "bonus: %d out of range", bonus[i]);
+		/* omake numbers come out of the same machine as the rest */
+		memset(seen, 0, sizeof(seen));
+		distinct("numbers", numbers, n, seen);
+		distinct("bonus", bonus, g->omake, seen);
+		memset(seen, 0, sizeof(seen));
+		distinct("bonus", bonus + g->omake, g->xsample, seen);
+		distsort(n, numbers, draw.main);
+		distsort(g->omake, bonus, draw.bonus);
+		distsort(g->xsample, bonus + g->omake, draw.bonus + g->omake);
 	}
-	nowsleep(imac[BOTTOM], 0, 0, COLS, 30);
-	clear_windows(imac, windows);
-
-	distsort(mmachine->sample, v1, v2);
-	wattron(imac[MBOX], COLOR_PAIR(17));
-	print_mid(imac[MBOX], 1, 0, 24, "winning numbers");
-	print_mid(imac[MBOX], 5, 0, 24, "omake");
-	wattroff(imac[MBOX], COLOR_PAIR(17));
-
-	p = makepoint((int) num_mid(24, mmachine->sample), 3);
-	for (i = 0, a = 0; i < mmachine->sample; ++i, ++a)
-		mvwprintw(imac[MBOX], p.y, p.x + STEP(a),
-		    "%02d", colorful(imac[MBOX], v2[i]));
-
-	p = makepoint((int) num_mid(24, mmachine->omake), 7);
-	if (mmachine->omake == 1)
-		mvwprintw(imac[MBOX], p.y, p.x,
-		    "%02d", colorful(imac[MBOX], v3[0]));
-	else if (mmachine->omake == 2) {
-		mvwprintw(imac[MBOX], p.y, p.x,
-		    "%02d", colorful(imac[MBOX], MIN(v3[0], v3[1])));
-		mvwprintw(imac[MBOX], p.y, p.x + 3,
-		    "%02d", colorful(imac[MBOX], MAX(v3[0], v3[1])));
+	printf("draw");
+	for (i = 0; i < g->sample; ++i)
+		printf(" %02d", draw.main[i]);
+	for (i = 0; i < GAME_BONUS(g); ++i)
+		printf("%s%02d", i == 0 ? " + " : " ", draw.bonus[i]);
+	printf("\n");
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	subidx_exact(x, draw.main, exact);
+	memset(winners, 0, sizeof(winners));
+	if (g->xsample == 0)
+		subidx_tiers(x, draw.main, draw.bonus, winners);
+	dt = elapsed(&t0);
+	printf("%-8s %13s %13s\n", "matched", "exactly", "at least");
+	for (total = 0, i = g->sample; i >= 0; --i)
+		printf("%-8d %13llu %13llu\n", i,
+		    (unsigned long long) exact[i],
+		    (unsigned long long) (total += exact[i]));
+	printf("index answered in %.1f us\n", dt * 1e6);
+	if (g->xsample == 0) {
+		for (i = 0; i < prizes[game].ntier; ++i)
+			printf("%stier %d %llu", i == 0 ? "" : ", ", i + 1,
+			    (unsigned long long) winners[i]);
+		printf("\n");
 	}
-	wrefresh(imac[MBOX]);
+	subidx_free(x);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	stage = settle_stage;
+	stage.arg = &draw;
+	if (ingest(path, threads, &stage, 1, &out) == -1)
+		err(1, "%s", path);
+	settle_report(stdout, out);
+	printf("settled in %.3f s\n", elapsed(&t0));
+	stage.close(out);
+}
 
-	print_mid(imac[BOTTOM], 0, 0, COLS, "'r' to retry, 'q' to exit");
-	while ((ch = wgetch(imac[BOTTOM])) != 'r') {
-		if (ch == 'q') {
-			clear_windows(imac, windows);
-			delete_windows(imac, windows);
-			finish(0);
-		}
+/*
+ * Streams draws of a game to stdout or to the output file, with no
+ * terminal set up at all.
+ */
+static void
+run_batch(int game, int draws, int format, int seed, const char *output)
+{
+	int fd;
+
+	fd = STDOUT_FILENO;
+	if (output != NULL &&
+	    (fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1)
+		err(1, "%s", output);
+	if (seed == 0)
+		pool_init(&pool);
+	if (batch_run(fd, game, draws, format, seed != 0 ? (uint64_t) seed :
+	    (uint64_t) pool_u32(&pool) << 32 | pool_u32(&pool)) == -1)
+		err(1, "%s", output != NULL ? output : "stdout");
+	if (fd != STDOUT_FILENO && close(fd) == -1)
+		err(1, "%s", output);
+}
+
+/*
+ * Sells quick pick keno tickets of the given spots, or of 1 to 10 spots
+ * at random when spots is 0, then draws and settles them ball by ball.
+ */
+static void
+run_keno(size_t tickets, int spots, uint64_t seed)
+{
+	struct timespec t0;
+	struct keno *k;
+	int ball[KENO_S], pick[KENO_MAXSPOT];
+	size_t t;
+	int i, s;
+	double dt;
+
+	pool_seed(&pool, seed, 0);
+	if ((k = keno_new()) == NULL)
+		err(1, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (t = 0; t < tickets; ++t) {
+		s = spots > 0 ? spots : (int) pool_bounded(&pool,
+		    KENO_MAXSPOT) + 1;
+		keno_pick(&pool, s, pick);
+		if (keno_add(k, pick, s) == -1)
+			err(1, NULL);
 	}
-	free_vector(v1);
-	free_vector(v2);
-	free_vector(v3);
-	free_machine(mmachine);
-	clear_windows(imac, windows);
-	delete_windows(imac, windows);
+	if (keno_close(k) == -1)
+		err(1, NULL);
+	printf("sold %zu tickets in %.3f s\n", tickets, elapsed(&t0));
+
+	keno_draw(&pool, ball);
+	for (i = 0; i < KENO_S; ++i) {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		keno_reveal(k, ball[i]);
+		dt = elapsed(&t0);
+		printf("%02d%s", ball[i], i + 1 < KENO_S ? " " : "\n");
+	}
+	keno_report(stdout, k);
+	printf("settled %.3f ms after the last ball\n", dt * 1e3);
+	keno_free(k);
 }
 
 int
@@ -1052,16 +1522,284 @@ main(int argc, char *argv[])
 	WINDOW *messagebar = NULL;
 	int selected_item;
 	int ch;
+	struct wheel_spec spec;
+	struct sim_params sp;
+	char *output = NULL;
+	char *sockpath = NULL;
+	int machines = 0;
+	int simgame = -1;
+	char *settle = NULL;
+	int bonus[GAME_MAXBONUS];
+	int nbonus = 0;
+	int top = 10;
+	int shards = 0;
+	int freqgame = -1;
+	int window = 0;
+	char *since = NULL;
+	int coocgame = -1;
+	int draws = 0;
+	struct filter filter;
+	int filtergame = -1;
+	int exclude[GAME_MAXNUMBER];
+	int nexclude = 0;
+	int lines = 0;
+	int keno = 0;
+	int spots = 0;
+	int batchgame = -1;
+	int format = BATCH_NDJSON;
+	int lookup = -1;
+	char *tickets = NULL;
+	int hits = 0;
+	bool rare = false;
 	bool selected = false;
 
-	signal(SIGINT, finish);
-#ifdef HAVE_SRANDOMDEV
-	srandomdev();
-#else
-	srandom((unsigned) time(NULL));
-#endif
+	memset(&spec, 0, sizeof(spec));
+	spec.game = -1;
+	spec.seconds = 5;
+	memset(&sp, 0, sizeof(sp));
+	filter_init(&filter);
+	while ((ch = getopt_long(argc, argv, "b:d:g:j:o:s:", longopts,
+	    NULL)) != -1) {
+		switch (ch) {
+		case 'b':
+			bcastname = optarg;
+			break;
+		case 'd':
+			histdir = optarg;
+			break;
+		case 'g':
+			machines = getnum("grid", optarg, 1, GRID_MAX);
+			break;
+		case 'j':
+			spec.threads = getnum("threads", optarg, 1, 4096);
+			sp.threads = spec.threads;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 's':
+			sockpath = optarg;
+			break;
+		case OPT_WHEEL:
+			spec.game = getgame(optarg);
+			break;
+		case OPT_NUMBERS:
+			spec.n = getlist("numbers", optarg, spec.numbers,
+			    WHEEL_MAXN);
+			break;
+		case OPT_MATCH:
+			spec.k = getnum("match", optarg, 1, GAME_MAXPICK);
+			break;
+		case OPT_DRAWN:
+			spec.m = getnum("drawn", optarg, 1, GAME_MAXPICK);
+			break;
+		case OPT_SECONDS:
+			spec.seconds = getnum("seconds", optarg, 1, 86400);
+			break;
+		case OPT_SIMULATE:
+			simgame = getgame(optarg);
+			break;
+		case OPT_SCENARIOS:
+			sp.scenarios = getnum("scenarios", optarg, 1, INT_MAX);
+			break;
+		case OPT_YEARS:
+			sp.years = getnum("years", optarg, 1, 1000);
+			break;
+		case OPT_SALES:
+			sp.sales = getnum("sales", optarg, 1, INT_MAX);
+			break;
+		case OPT_SETTLE:
+			settle = optarg;
+			break;
+		case OPT_BONUS:
+			nbonus = getlist("bonus", optarg, bonus, GAME_MAXBONUS);
+			break;
+		case OPT_TOP:
+			top = getnum("top", optarg, 0, SKETCH_TOP);
+			break;
+		case OPT_SEED:
+			sp.seed = getnum("seed", optarg, 0, INT_MAX);
+			break;
+		case OPT_CHECKPOINT:
+			sp.checkpoint = optarg;
+			break;
+		case OPT_INTERVAL:
+			sp.interval = getnum("interval", optarg, 1, 86400);
+			break;
+		case OPT_RESUME:
+			sp.resume = 1;
+			break;
+		case OPT_FREQ:
+			freqgame = getgame(optarg);
+			break;
+		case OPT_WINDOW:
+			window = getnum("window", optarg, 1, INT_MAX);
+			break;
+		case OPT_SINCE:
+			since = optarg;
+			break;
+		case OPT_COOC:
+			coocgame = getgame(optarg);
+			break;
+		case OPT_DRAWS:
+			draws = getnum("draws", optarg, 1, INT_MAX);
+			break;
+		case OPT_FILTER:
+			filtergame = getgame(optarg);
+			break;
+		case OPT_SUM:
+			getrange("sum", optarg, &filter.sumlo, &filter.sumhi);
+			break;
+		case OPT_ODD:
+			getrange("odd", optarg, &filter.oddlo, &filter.oddhi);
+			break;
+		case OPT_RUN:
+			filter.maxrun = getnum("run", optarg, 1, GAME_MAXPICK);
+			break;
+		case OPT_EXCLUDE:
+			nexclude = getlist("exclude", optarg, exclude,
+			    GAME_MAXNUMBER);
+			break;
+		case OPT_DECADES:
+			getrange("decades", optarg, &filter.declo,
+			    &filter.dechi);
+			break;
+		case OPT_LOOKUP:
+			lookup = getgame(optarg);
+			break;
+		case OPT_TICKETS:
+			tickets = optarg;
+			break;
+		case OPT_HITS:
+			hits = getnum("hits", optarg, 1, GAME_MAXPICK);
+			break;
+		case OPT_RARE:
+			rare = true;
+			break;
+		case OPT_GAME:
+			batchgame = getgame(optarg);
+			break;
+		case OPT_FORMAT:
+			if ((format = batch_format(optarg)) == -1)
+				errx(1, "format: must be ndjson or bin");
+			break;
+		case OPT_KENO:
+			keno = getnum("keno", optarg, 1, INT_MAX);
+			break;
+		case OPT_SPOTS:
+			spots = getnum("spots", optarg, 1, KENO_MAXSPOT);
+			break;
+		case OPT_LINES:
+			lines = getnum("lines", optarg, 1, 10000000);
+			break;
+		case OPT_SHARDS:
+			shards = getnum("shards", optarg, 1, SHARD_MAX);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc != optind)
+		usage();
+
+	if (batchgame != -1) {
+		run_batch(batchgame, draws > 0 ? draws : 1, format, sp.seed,
+		    output);
+		exit(0);
+	}
+	if (spec.game != -1) {
+		if (spec.n == 0 || spec.k == 0)
+			usage();
+		if (spec.m == 0)
+			spec.m = games[spec.game].sample;
+		run_wheel(&spec, output);
+		exit(0);
+	}
+	if (filtergame != -1) {
+		filter_game(&filter, filtergame);
+		pool_init(&pool);
+		filter.seed = sp.seed != 0 ? (uint64_t) sp.seed :
+		    (uint64_t) pool_u32(&pool) << 32 | pool_u32(&pool);
+		run_filter(&filter, exclude, nexclude, spec.threads, output);
+		exit(0);
+	}
+	if (keno > 0) {
+		pool_init(&pool);
+		run_keno(keno, spots, sp.seed != 0 ? (uint64_t) sp.seed :
+		    (uint64_t) pool_u32(&pool) << 32 | pool_u32(&pool));
+		exit(0);
+	}
+	if ((sp.resume && sp.checkpoint == NULL) ||
+	    (shards > 0 && sp.checkpoint != NULL))
+		usage();
+	if (simgame != -1 && rare) {
+		pool_init(&pool);
+		run_rare(simgame, tickets, draws > 0 ? draws : 100000,
+		    sp.seed != 0 ? (uint64_t) sp.seed :
+		    (uint64_t) pool_u32(&pool) << 32 | pool_u32(&pool),
+		    spec.threads);
+		exit(0);
+	}
+	if (simgame != -1) {
+		run_simulation(&sp, simgame, shards);
+		exit(0);
+	}
+	if (settle != NULL) {
+		pool_init(&pool);
+		run_settlement(settle, spec.numbers, spec.n, bonus, nbonus,
+		    top, spec.threads);
+		exit(0);
+	}
+	if (histdir != NULL && (history = hist_open(histdir)) == NULL)
+		err(1, "%s", histdir);
+	if (freqgame != -1) {
+		if (history == NULL || (window > 0 && since != NULL))
+			usage();
+		run_freq(freqgame, window, since, top);
+		hist_close(history);
+		exit(0);
+	}
+	if (lookup != -1) {
+		if (history == NULL || (spec.n > 0) == (tickets != NULL))
+			usage();
+		run_lookup(lookup, spec.numbers, spec.n, tickets,
+		    hits > 0 ? hits : MIN(3, games[lookup].sample), top,
+		    spec.threads);
+		hist_close(history);
+		exit(0);
+	}
+	if (coocgame != -1) {
+		if (history != NULL && draws > 0)
+			usage();
+		pool_init(&pool);
+		run_cooc(coocgame, draws > 0 ? draws : 1000000,
+		    sp.seed != 0 ? (uint64_t) sp.seed :
+		    (uint64_t) pool_u32(&pool) << 32 | pool_u32(&pool),
+		    spec.threads, top, output);
+		hist_close(history);
+		exit(0);
+	}
+	if (bcastname != NULL && (bcast = bcast_create(bcastname)) == NULL)
+		err(1, "%s", bcastname);
+
+	pool_init(&pool);
+	if (sockpath != NULL) {
+		server_run(sockpath, sp.seed != 0 ? (uint64_t) sp.seed :
+		    (uint64_t) pool_u32(&pool) << 32 | pool_u32(&pool), history,
+		    bcast);
+		hist_close(history);
+		bcast_close(bcast);
+		exit(0);
+	}
+
+	signal(SIGINT, interrupt);
 	init_curses();
-	setup_colors(random() % 10 + 1);
+	setup_colors(pool_bounded(&pool, 10) + 1);
+
+	if (machines > 0) {
+		grid_run(machines);
+		finish(0);
+	}
 
 	titlebar = newwin(1, COLS, 0, 0);
 	messagebar = newwin(1, COLS, LINES - 2, 0);
@@ -1078,34 +1816,26 @@ main(int argc, char *argv[])
 
 		switch (selected_item) {
 		case 0:
-			ja_dream(selected_item);
-			selected = true;
-			break;
 		case 1:
-			ja_dream(selected_item);
-			selected = true;
-			break;
 		case 2:
-			ja_dream(selected_item);
-			selected = true;
-			break;
 		case 3:
-			us_dream(selected_item);
-			selected = true;
-			break;
 		case 4:
-			us_dream(selected_item);
-			selected = true;
-			break;
 		case 5:
-			eu_dream(selected_item);
+			if (lines > 0 ? dream_lines(selected_item, lines) :
+			    dream(selected_item))
+				goto endgame;
 			selected = true;
 			break;
 		case 6:
+			if (keno_dream())
+				goto endgame;
+			selected = true;
+			break;
+		case 7:
 			mvwprintw(messagebar, 0, 0, "'q' to exit");
 			selected = false;
 			break;
-		case 7:
+		case 8:
 			goto endgame;
 		default:
 			break;
@@ -1128,5 +1858,33 @@ void
 finish(int status)
 {
 	endwin();
+	hist_close(history);
+	bcast_close(bcast);
 	exit(status);
 }
+
+void
+finish_err(const char *msg)
+{
+	int e;
+
+	e = errno;
+	endwin();
+	hist_close(history);
+	bcast_close(bcast);
+	errno = e;
+	if (msg == NULL)
+		err(1, NULL);
+	err(1, "%s", msg);
+}
+
+/*
+ * SIGINT.  The history is synced after every draw, so there is nothing
+ * left to write and the handler only gives the terminal back.
+ */
+static void
+interrupt(int sig)
+{
+	endwin();
+	_exit(128 + sig);
+}
@@ -3,6 +3,8 @@
 #ifndef GARAPON_H
 #define GARAPON_H
 
+#include <curses.h>
+
 #ifdef BONNOU
 # include "bonnou.h"
 #else
@@ -35,6 +37,8 @@
 #define L_SEV_N (34 + BONNOU)
 #define L_SEV_S 7
 #define L_SEV_O 2
+#define KENO_N 80
+#define KENO_S 20
 
 #undef STEP
 #define STEP(a) (a * 3)
@@ -0,0 +1,307 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "engine.h"
+#include "grid.h"
+#include "sort.h"
+
+/*
+ * Tournament mode.  Every machine runs a full game on its own worker
+ * thread and publishes a complete snapshot of its state after each
+ * step into a single-producer single-consumer ring.  The calling thread
+ * is the only one that touches curses: it drains all rings once per
+ * frame, keeps the newest snapshot of each machine and redraws the
+ * tiles that changed.
+ */
+
+#define GRID_QLEN 8
+#define GRID_SHOW 8
+#define GRID_DRAWN (GAME_MAXPICK + GAME_MAXBONUS)
+#define GRID_HOLD 90
+#define GRID_CACHELINE 64
+
+enum {
+	G_SPIN,
+	G_DRAWN,
+	G_DONE
+};
+
+struct grid_snap {
+	unsigned int seq;
+	short game;
+	short state;
+	short ndrawn;
+	short nmain;
+	short spin[GRID_SHOW];
+	short drawn[GRID_DRAWN];
+};
+
+struct grid_queue {
+	_Alignas(GRID_CACHELINE) atomic_size_t head;
+	_Alignas(GRID_CACHELINE) atomic_size_t tail;
+	_Alignas(GRID_CACHELINE) struct grid_snap slot[GRID_QLEN];
+};
+
+struct grid_worker {
+	pthread_t thread;
+	struct grid_queue q;
+	struct grid_snap cur;
+	atomic_bool *stop;
+	struct pool pool;
+	int game;
+};
+
+static bool
+queue_push(struct grid_queue *q, const struct grid_snap *s)
+{
+	size_t h, t;
+
+	t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	h = atomic_load_explicit(&q->head, memory_order_acquire);
+	if (t - h == GRID_QLEN)
+		return false;
+	q->slot[t % GRID_QLEN] = *s;
+	atomic_store_explicit(&q->tail, t + 1, memory_order_release);
+	return true;
+}
+
+static bool
+queue_drain(struct grid_queue *q, struct grid_snap *s)
+{
+	size_t h, t;
+
+	h = atomic_load_explicit(&q->head, memory_order_relaxed);
+	t = atomic_load_explicit(&q->tail, memory_order_acquire);
+	if (h == t)
+		return false;
+	*s = q->slot[(t - 1) % GRID_QLEN];
+	atomic_store_explicit(&q->head, t, memory_order_release);
+	return true;
+}
+
+static void
+tick(long ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	nanosleep(&ts, NULL);
+}
+
+static void
+spin(struct grid_worker *w, int *ball, int n)
+{
+	int i;
+
+	pool_shuffle(&w->pool, ball, n);
+	for (i = 0; i < GRID_SHOW; ++i)
+		w->cur.spin[i] = (i < n) ? ball[i] : 0;
+}
+
+static void
+publish(struct grid_worker *w)
+{
+	++w->cur.seq;
+	queue_push(&w->q, &w->cur);
+}
+
+static bool
+stopped(struct grid_worker *w)
+{
+	return atomic_load_explicit(w->stop, memory_order_relaxed);
+}
+
+/*
+ * Draws n balls out of a machine of number balls, spinning it for a
+ * random number of frames before each one.
+ */
+static void
+run_machine(struct grid_worker *w, int number, int n)
+{
+	int ball[GAME_MAXNUMBER];
+	int i, j, left;
+
+	for (i = 0; i < number; ++i)
+		ball[i] = i + 1;
+	for (left = number; n > 0 && left > 0 && !stopped(w); --n, --left) {
+		w->cur.state = G_SPIN;
+		for (j = 10 + pool_bounded(&w->pool, 30); j > 0; --j) {
+			spin(w, ball, left);
+			publish(w);
+			tick(1000 / GRID_FPS);
+			if (stopped(w))
+				return;
+		}
+		w->cur.drawn[w->cur.ndrawn++] = ball[0];
+		ball[0] = ball[left - 1];
+		w->cur.state = G_DRAWN;
+		publish(w);
+	}
+}
+
+static void
+sort_result(struct grid_worker *w, const struct game *g)
+{
+	int v[GRID_DRAWN];
+	int i;
+
+	for (i = 0; i < w->cur.ndrawn; ++i)
+		v[i] = w->cur.drawn[i];
+	distsort(g->sample, v, v);
+	distsort(g->omake, v + g->sample, v + g->sample);
+	distsort(g->xsample, v + g->sample + g->omake,
+	    v + g->sample + g->omake);
+	for (i = 0; i < w->cur.ndrawn; ++i)
+		w->cur.drawn[i] = v[i];
+}
+
+static void *
+worker(void *arg)
+{
+	struct grid_worker *w = arg;
+	const struct game *g;
+	int i;
+
+	g = &games[w->game];
+	while (!stopped(w)) {
+		w->cur.ndrawn = 0;
+		w->cur.nmain = g->sample;
+		run_machine(w, g->number, g->sample + g->omake);
+		if (g->xsample > 0)
+			run_machine(w, g->xnumber, g->xsample);
+		if (stopped(w))
+			break;
+		sort_result(w, g);
+		w->cur.state = G_DONE;
+		for (i = 0; i < GRID_HOLD && !stopped(w); ++i) {
+			publish(w);
+			tick(1000 / GRID_FPS);
+		}
+	}
+	return NULL;
+}
+
+static void
+draw_tile(int y, int x, int n, const struct grid_snap *s)
+{
+	int i, pair;
+
+	wattrset(stdscr, COLOR_PAIR(17));
+	mvprintw(y, x, "#%02d %-*s", n + 1, GRID_TILE_W - 5,
+	    games[s->game].name);
+	move(y + 1, x);
+	for (i = 0; i < GRID_SHOW; ++i) {
+		if (s->state == G_SPIN && s->spin[i] != 0) {
+			wattrset(stdscr, COLOR_PAIR(s->spin[i] % 7 + 1));
+			printw("%02d ", s->spin[i]);
+		} else {
+			wattrset(stdscr, COLOR_PAIR(10));
+			printw("   ");
+		}
+	}
+	move(y + 2, x);
+	for (i = 0; i < GRID_DRAWN; ++i) {
+		if (i < s->ndrawn) {
+			pair = (i < s->nmain) ? 17 : 13;
+			if (s->state == G_DONE)
+				pair = (i < s->nmain) ? 12 : 11;
+			wattrset(stdscr, COLOR_PAIR(pair) | A_BOLD);
+			printw("%02d ", s->drawn[i]);
+		} else
+			printw("   ");
+	}
+	wattrset(stdscr, A_NORMAL);
+}
+
+void
+grid_run(int machines)
+{
+	struct grid_worker *w;
+	struct grid_snap s;
+	struct timespec next;
+	atomic_bool stop;
+	int i, ncols, nrows, shown;
+	int ch;
+
+	if (machines < 1 || machines > GRID_MAX)
+		errx(1, "machines must be between 1 and %d", GRID_MAX);
+	if ((w = aligned_alloc(GRID_CACHELINE,
+	    machines * sizeof(*w))) == NULL)
+		err(1, NULL);
+	memset(w, 0, machines * sizeof(*w));
+	atomic_init(&stop, false);
+	for (i = 0; i < machines; ++i) {
+		atomic_init(&w[i].q.head, 0);
+		atomic_init(&w[i].q.tail, 0);
+		w[i].stop = &stop;
+		w[i].game = i % NGAMES;
+		w[i].cur.game = w[i].game;
+		pool_init(&w[i].pool);
+		if (pthread_create(&w[i].thread, NULL, worker, &w[i]) != 0)
+			err(1, "pthread_create");
+	}
+
+	ncols = MAX(COLS / GRID_TILE_W, 1);
+	nrows = MAX((LINES - 1) / GRID_TILE_H, 1);
+	shown = MIN(machines, ncols * nrows);
+	erase();
+	nodelay(stdscr, true);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (;;) {
+		for (i = 0; i < shown; ++i)
+			if (queue_drain(&w[i].q, &s))
+				draw_tile((i / ncols) * GRID_TILE_H,
+				    (i % ncols) * GRID_TILE_W, i, &s);
+		for (; i < machines; ++i)
+			queue_drain(&w[i].q, &s);
+		mvprintw(LINES - 1, 0, "%d machines, %d shown, 'q' to exit",
+		    machines, shown);
+		wnoutrefresh(stdscr);
+		doupdate();
+		if ((ch = getch()) == 'q')
+			break;
+
+		next.tv_nsec += 1000000000L / GRID_FPS;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			++next.tv_sec;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	atomic_store(&stop, true);
+	for (i = 0; i < machines; ++i)
+		pthread_join(w[i].thread, NULL);
+	free(w);
+	nodelay(stdscr, false);
+	erase();
+	refresh();
+}
@@ -0,0 +1,13 @@
+/* grid.h */
+
+#ifndef GRID_H
+#define GRID_H
+
+#define GRID_MAX 256
+#define GRID_FPS 30
+#define GRID_TILE_W 29
+#define GRID_TILE_H 4
+
+void grid_run(int machines);
+
+#endif /* GRID_H */
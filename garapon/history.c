@@ -0,0 +1,626 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "history.h"
+
+/*
+ * Each game is kept in its own file <dir>/<key>.hist: a file header
+ * followed by blocks of HIST_BLOCK draws.  Within a block every column
+ * (main number positions, bonus numbers, timestamps) is stored with a
+ * frame of reference and bit packed at the smallest width that holds
+ * the column.  The main numbers are sorted, so position k is stored as
+ * the gap to position k - 1; timestamps as the gap to the previous
+ * draw.  Only the last block of a file may be partial; it is rewritten
+ * by hist_sync() and completed in memory by hist_append().
+ */
+
+struct hist_filehdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t game;
+	uint32_t sample;
+	uint32_t bonus;
+	uint32_t block;
+	uint32_t pad;
+};
+
+struct hist_blockhdr {
+	uint32_t size;
+	uint32_t count;
+	int64_t stamp;
+};
+
+struct hist_colhdr {
+	uint32_t ref;
+	uint32_t width;
+	uint32_t offset;
+};
+
+#define HIST_MAXCOL (GAME_MAXPICK + GAME_MAXBONUS + 1)
+#define HIST_PAD 8
+
+static uint64_t
+load_le64(const unsigned char *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t w;
+
+	memcpy(&w, p, sizeof(w));
+	return w;
+#else
+	uint64_t w;
+	int i;
+
+	for (w = 0, i = 7; i >= 0; --i)
+		w = w << 8 | p[i];
+	return w;
+#endif
+}
+
+static uint32_t
+bitwidth(uint32_t x)
+{
+	uint32_t n;
+
+	for (n = 0; x != 0; x >>= 1)
+		++n;
+	return n;
+}
+
+static size_t
+packed_size(int count, uint32_t width)
+{
+	return ((size_t) count * width + 7) / 8 + HIST_PAD;
+}
+
+static void
+pack(unsigned char *out, const uint32_t *v, int count, uint32_t ref,
+    uint32_t width)
+{
+	uint64_t acc = 0;
+	int bits = 0;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		acc |= (uint64_t) (v[i] - ref) << bits;
+		bits += width;
+		while (bits >= 8) {
+			*out++ = acc & 0xff;
+			acc >>= 8;
+			bits -= 8;
+		}
+	}
+	if (bits > 0)
+		*out++ = acc & 0xff;
+	memset(out, 0, HIST_PAD);
+}
+
+/*
+ * Every value is read with one unaligned 64-bit load at a position
+ * computed from its index, so there is no dependency between lanes
+ * and the loop vectorizes.
+ */
+static void
+unpack(uint32_t *v, const unsigned char *in, int count, uint32_t ref,
+    uint32_t width)
+{
+	uint64_t mask;
+	size_t bit;
+	int i;
+
+	mask = (width >= 32) ? 0xffffffffu : ((uint64_t) 1 << width) - 1;
+	for (i = 0; i < count; ++i) {
+		bit = (size_t) i * width;
+		v[i] = ref + (uint32_t) ((load_le64(in + (bit >> 3)) >>
+		    (bit & 7)) & mask);
+	}
+}
+
+static int
+columns(const struct hist_game *hg)
+{
+	return hg->sample + hg->bonus + 1;
+}
+
+static unsigned char *
+encode_block(const struct hist_game *hg, const struct hist_block *b,
+    size_t *len)
+{
+	uint32_t v[HIST_MAXCOL][HIST_BLOCK];
+	struct hist_colhdr col[HIST_MAXCOL];
+	struct hist_blockhdr bh;
+	unsigned char *p;
+	uint32_t lo, hi;
+	size_t size;
+	int c, i, k, ncols;
+
+	ncols = columns(hg);
+	for (i = 0; i < b->count; ++i)
+		v[0][i] = b->main[0][i] - 1;
+	for (k = 1; k < hg->sample; ++k)
+		for (i = 0; i < b->count; ++i)
+			v[k][i] = b->main[k][i] - b->main[k - 1][i] - 1;
+	for (k = 0; k < hg->bonus; ++k)
+		for (i = 0; i < b->count; ++i)
+			v[hg->sample + k][i] = b->bonus[k][i];
+	v[ncols - 1][0] = 0;
+	for (i = 1; i < b->count; ++i)
+		v[ncols - 1][i] = (uint32_t) (b->stamp[i] - b->stamp[i - 1]);
+
+	size = sizeof(bh) + ncols * sizeof(col[0]);
+	for (c = 0; c < ncols; ++c) {
+		lo = hi = v[c][0];
+		for (i = 1; i < b->count; ++i) {
+			lo = MIN(lo, v[c][i]);
+			hi = MAX(hi, v[c][i]);
+		}
+		col[c].ref = lo;
+		col[c].width = bitwidth(hi - lo);
+		col[c].offset = size;
+		size += packed_size(b->count, col[c].width);
+	}
+	size = (size + 7) & ~(size_t) 7;
+
+	if ((p = (unsigned char *) calloc(1, size)) == NULL)
+		return NULL;
+	bh.size = size;
+	bh.count = b->count;
+	bh.stamp = b->stamp[0];
+	memcpy(p, &bh, sizeof(bh));
+	memcpy(p + sizeof(bh), col, ncols * sizeof(col[0]));
+	for (c = 0; c < ncols; ++c)
+		pack(p + col[c].offset, v[c], b->count, col[c].ref,
+		    col[c].width);
+	*len = size;
+	return p;
+}
+
+static int
+decode_block(const struct hist_game *hg, const unsigned char *p, size_t len,
+    struct hist_block *b)
+{
+	uint32_t v[HIST_BLOCK];
+	struct hist_colhdr col[HIST_MAXCOL];
+	struct hist_blockhdr bh;
+	int c, i, k, ncols;
+
+	ncols = columns(hg);
+	if (len < sizeof(bh) + ncols * sizeof(col[0]))
+		goto corrupt;
+	memcpy(&bh, p, sizeof(bh));
+	memcpy(col, p + sizeof(bh), ncols * sizeof(col[0]));
+	if (bh.size > len || bh.count == 0 || bh.count > HIST_BLOCK)
+		goto corrupt;
+	for (c = 0; c < ncols; ++c)
+		if (col[c].width > 32 || col[c].offset +
+		    packed_size(bh.count, col[c].width) > bh.size)
+			goto corrupt;
+
+	b->count = bh.count;
+	unpack(v, p + col[0].offset, b->count, col[0].ref, col[0].width);
+	for (i = 0; i < b->count; ++i)
+		b->main[0][i] = v[i] + 1;
+	for (k = 1; k < hg->sample; ++k) {
+		unpack(v, p + col[k].offset, b->count, col[k].ref,
+		    col[k].width);
+		for (i = 0; i < b->count; ++i)
+			b->main[k][i] = b->main[k - 1][i] + v[i] + 1;
+	}
+	for (k = 0; k < hg->bonus; ++k) {
+		c = hg->sample + k;
+		unpack(v, p + col[c].offset, b->count, col[c].ref,
+		    col[c].width);
+		for (i = 0; i < b->count; ++i)
+			b->bonus[k][i] = v[i];
+	}
+	c = ncols - 1;
+	unpack(v, p + col[c].offset, b->count, col[c].ref, col[c].width);
+	b->stamp[0] = bh.stamp;
+	for (i = 1; i < b->count; ++i)
+		b->stamp[i] = b->stamp[i - 1] + v[i];
+	return bh.size;
+
+corrupt:
+	errno = EINVAL;
+	return -1;
+}
+
+static int
+remap(struct hist_game *hg)
+{
+	if (hg->map != NULL)
+		munmap(hg->map, hg->maplen);
+	hg->maplen = hg->sealedend;
+	hg->map = mmap(NULL, hg->maplen, PROT_READ, MAP_SHARED, hg->fd, 0);
+	if (hg->map == MAP_FAILED) {
+		hg->map = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static int
+push_block(struct hist_game *hg, size_t off)
+{
+	size_t *p;
+	size_t n;
+
+	if (hg->nblocks == hg->maxblocks) {
+		n = hg->maxblocks ? hg->maxblocks * 2 : 64;
+		if ((p = (size_t *) realloc(hg->offset,
+		    n * sizeof(size_t))) == NULL)
+			return -1;
+		hg->offset = p;
+		hg->maxblocks = n;
+	}
+	hg->offset[hg->nblocks++] = off;
+	return 0;
+}
+
+static int
+open_game(struct hist_game *hg, const char *dir, int game)
+{
+	struct hist_filehdr fh;
+	struct hist_blockhdr bh;
+	struct hist_block *last;
+	struct stat st;
+	char path[PATH_MAX];
+	size_t off;
+	int n;
+
+	hg->sample = games[game].sample;
+	hg->bonus = GAME_BONUS(&games[game]);
+	snprintf(path, sizeof(path), "%s/%s.hist", dir, games[game].key);
+	if ((hg->fd = open(path, O_RDWR | O_CREAT, 0644)) == -1)
+		return -1;
+	if (fstat(hg->fd, &st) == -1)
+		return -1;
+
+	if (st.st_size == 0) {
+		memset(&fh, 0, sizeof(fh));
+		memcpy(fh.magic, HIST_MAGIC, sizeof(fh.magic));
+		fh.version = HIST_VERSION;
+		fh.game = game;
+		fh.sample = hg->sample;
+		fh.bonus = hg->bonus;
+		fh.block = HIST_BLOCK;
+		if (pwrite(hg->fd, &fh, sizeof(fh), 0) != sizeof(fh))
+			return -1;
+		st.st_size = sizeof(fh);
+	} else if (pread(hg->fd, &fh, sizeof(fh), 0) != sizeof(fh) ||
+	    memcmp(fh.magic, HIST_MAGIC, sizeof(fh.magic)) != 0 ||
+	    fh.version != HIST_VERSION || fh.game != (uint32_t) game ||
+	    fh.sample != (uint32_t) hg->sample ||
+	    fh.bonus != (uint32_t) hg->bonus || fh.block != HIST_BLOCK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	hg->sealedend = st.st_size;
+	if (remap(hg) == -1)
+		return -1;
+	for (off = sizeof(fh); off + sizeof(bh) <= (size_t) st.st_size;
+	    off += bh.size) {
+		memcpy(&bh, hg->map + off, sizeof(bh));
+		if (bh.size == 0 || off + bh.size > (size_t) st.st_size)
+			break;
+		if (bh.count < HIST_BLOCK) {
+			if (decode_block(hg, hg->map + off, bh.size,
+			    &hg->tail) == -1)
+				return -1;
+			break;
+		}
+		if (push_block(hg, off) == -1)
+			return -1;
+	}
+	hg->sealedend = off;
+	hg->tail.first = hg->nblocks * HIST_BLOCK;
+	if (hg->tail.count > 0)
+		hg->laststamp = hg->tail.stamp[hg->tail.count - 1];
+	else if (hg->nblocks > 0) {
+		if ((last = malloc(sizeof(*last))) == NULL)
+			return -1;
+		off = hg->offset[hg->nblocks - 1];
+		n = decode_block(hg, hg->map + off, hg->sealedend - off, last);
+		if (n != -1)
+			hg->laststamp = last->stamp[last->count - 1];
+		free(last);
+		if (n == -1)
+			return -1;
+	}
+	return remap(hg);
+}
+
+static void
+close_game(struct hist_game *hg)
+{
+	if (hg->map != NULL)
+		munmap(hg->map, hg->maplen);
+	if (hg->fd != -1)
+		close(hg->fd);
+	free(hg->offset);
+	freq_free(hg->freq);
+}
+
+struct history *
+hist_open(const char *dir)
+{
+	struct history *h;
+	int i, save;
+
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+		return NULL;
+	if ((h = (struct history *) calloc(1, sizeof(*h))) == NULL)
+		return NULL;
+	for (i = 0; i < NGAMES; ++i)
+		h->game[i].fd = -1;
+	for (i = 0; i < NGAMES; ++i) {
+		if (open_game(&h->game[i], dir, i) == -1) {
+			save = errno;
+			for (; i >= 0; --i)
+				close_game(&h->game[i]);
+			free(h);
+			errno = save;
+			return NULL;
+		}
+	}
+	return h;
+}
+
+static int
+write_tail(struct hist_game *hg)
+{
+	unsigned char *p;
+	size_t len;
+	ssize_t n;
+
+	if (hg->tail.count == 0)
+		return ftruncate(hg->fd, hg->sealedend);
+	if ((p = encode_block(hg, &hg->tail, &len)) == NULL)
+		return -1;
+	n = pwrite(hg->fd, p, len, hg->sealedend);
+	free(p);
+	if (n != (ssize_t) len)
+		return -1;
+	return ftruncate(hg->fd, hg->sealedend + len);
+}
+
+static int
+seal(struct hist_game *hg)
+{
+	size_t off;
+
+	off = hg->sealedend;
+	if (write_tail(hg) == -1 || push_block(hg, off) == -1)
+		return -1;
+	hg->sealedend = lseek(hg->fd, 0, SEEK_END);
+	hg->tail.count = 0;
+	hg->tail.first = hg->nblocks * HIST_BLOCK;
+	return remap(hg);
+}
+
+int
+hist_append(struct history *h, int game, const vector main,
+    const vector bonus, int64_t stamp)
+{
+	const struct game *g;
+	struct hist_game *hg;
+	int i, k, n;
+
+	if (game < 0 || game >= NGAMES)
+		goto invalid;
+	g = &games[game];
+	hg = &h->game[game];
+	for (k = 0; k < g->sample; ++k)
+		if (main[k] < 1 || main[k] > g->number ||
+		    (k > 0 && main[k] <= main[k - 1]))
+			goto invalid;
+	for (k = 0; k < GAME_BONUS(g); ++k) {
+		n = (k < g->omake) ? g->number : g->xnumber;
+		if (bonus[k] < 1 || bonus[k] > n)
+			goto invalid;
+	}
+	if (hist_count(h, game) > 0 && (stamp < hg->laststamp ||
+	    stamp - hg->laststamp > UINT32_MAX))
+		goto invalid;
+
+	i = hg->tail.count++;
+	for (k = 0; k < g->sample; ++k)
+		hg->tail.main[k][i] = main[k];
+	for (k = 0; k < GAME_BONUS(g); ++k)
+		hg->tail.bonus[k][i] = bonus[k];
+	hg->tail.stamp[i] = stamp;
+	hg->laststamp = stamp;
+	if (hg->freq != NULL && freq_append(hg->freq, main, stamp) == -1) {
+		/* built again from the file on the next hist_freq() */
+		freq_free(hg->freq);
+		hg->freq = NULL;
+	}
+	if (hg->tail.count == HIST_BLOCK)
+		return seal(hg);
+	return 0;
+
+invalid:
+	errno = EINVAL;
+	return -1;
+}
+
+size_t
+hist_count(const struct history *h, int game)
+{
+	return h->game[game].nblocks * HIST_BLOCK + h->game[game].tail.count;
+}
+
+static struct hist_block *
+load_block(struct hist_game *hg, size_t blk, struct hist_block *buf)
+{
+	size_t off;
+
+	if (blk == hg->nblocks)
+		return &hg->tail;
+	off = hg->offset[blk];
+	if (decode_block(hg, hg->map + off, hg->maplen - off, buf) == -1)
+		return NULL;
+	buf->first = blk * HIST_BLOCK;
+	return buf;
+}
+
+int
+hist_get(struct history *h, int game, size_t n, vector main, vector bonus,
+    int64_t *stamp)
+{
+	struct hist_block buf;
+	struct hist_block *b;
+	struct hist_game *hg;
+	int i, k;
+
+	if (n >= hist_count(h, game)) {
+		errno = EINVAL;
+		return -1;
+	}
+	hg = &h->game[game];
+	if ((b = load_block(hg, n / HIST_BLOCK, &buf)) == NULL)
+		return -1;
+	i = n % HIST_BLOCK;
+	for (k = 0; k < hg->sample; ++k)
+		main[k] = b->main[k][i];
+	for (k = 0; k < hg->bonus; ++k)
+		bonus[k] = b->bonus[k][i];
+	if (stamp != NULL)
+		*stamp = b->stamp[i];
+	return 0;
+}
+
+/*
+ * Calls fn once for every block holding draws in [from, to).  Rows
+ * lo to hi - 1 of the block are the requested ones; the draw number of
+ * row 0 is first.  A nonzero return from fn stops the scan.
+ */
+int
+hist_scan(struct history *h, int game, size_t from, size_t to,
+    hist_scanfn fn, void *arg)
+{
+	struct hist_block *buf;
+	struct hist_block *b;
+	struct hist_game *hg;
+	size_t blk;
+	int r = 0;
+
+	hg = &h->game[game];
+	to = MIN(to, hist_count(h, game));
+	if (from >= to)
+		return 0;
+	if ((buf = (struct hist_block *) malloc(sizeof(*buf))) == NULL)
+		return -1;
+	for (blk = from / HIST_BLOCK; blk * HIST_BLOCK < to; ++blk) {
+		if ((b = load_block(hg, blk, buf)) == NULL) {
+			r = -1;
+			break;
+		}
+		b->lo = (from > b->first) ? from - b->first : 0;
+		b->hi = MIN(to - b->first, (size_t) b->count);
+		if ((r = fn(b, arg)) != 0)
+			break;
+	}
+	free(buf);
+	return r;
+}
+
+static int
+index_block(const struct hist_block *b, void *arg)
+{
+	struct freq *f = arg;
+	int main[GAME_MAXPICK];
+	int i, k;
+
+	for (i = b->lo; i < b->hi; ++i) {
+		for (k = 0; k < games[f->game].sample; ++k)
+			main[k] = b->main[k][i];
+		if (freq_append(f, main, b->stamp[i]) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * The frequency index of a game, built from the file on first use and
+ * kept up to date by hist_append() from then on.
+ */
+struct freq *
+hist_freq(struct history *h, int game)
+{
+	struct hist_game *hg;
+	struct freq *f;
+	int save;
+
+	if (game < 0 || game >= NGAMES) {
+		errno = EINVAL;
+		return NULL;
+	}
+	hg = &h->game[game];
+	if (hg->freq != NULL)
+		return hg->freq;
+	if ((f = freq_new(game)) == NULL)
+		return NULL;
+	if (hist_scan(h, game, 0, hist_count(h, game), index_block, f) != 0) {
+		save = errno;
+		freq_free(f);
+		errno = save;
+		return NULL;
+	}
+	return hg->freq = f;
+}
+
+int
+hist_sync(struct history *h)
+{
+	int i, r = 0;
+
+	for (i = 0; i < NGAMES; ++i)
+		if (write_tail(&h->game[i]) == -1)
+			r = -1;
+	return r;
+}
+
+void
+hist_close(struct history *h)
+{
+	int i;
+
+	if (h == NULL)
+		return;
+	hist_sync(h);
+	for (i = 0; i < NGAMES; ++i)
+		close_game(&h->game[i]);
+	free(h);
+}
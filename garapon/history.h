@@ -0,0 +1,59 @@
+/* history.h */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine.h"
+#include "freq.h"
+
+#define HIST_BLOCK 128
+#define HIST_MAGIC "GRPNHIST"
+#define HIST_VERSION 1
+
+struct hist_block {
+	size_t first;
+	int count;
+	int lo;
+	int hi;
+	int main[GAME_MAXPICK][HIST_BLOCK];
+	int bonus[GAME_MAXBONUS][HIST_BLOCK];
+	int64_t stamp[HIST_BLOCK];
+};
+
+struct hist_game {
+	int fd;
+	int sample;
+	int bonus;
+	unsigned char *map;
+	size_t maplen;
+	size_t *offset;
+	size_t nblocks;
+	size_t maxblocks;
+	size_t sealedend;
+	int64_t laststamp;
+	struct hist_block tail;
+	struct freq *freq;
+};
+
+struct history {
+	struct hist_game game[NGAMES];
+};
+
+typedef int (*hist_scanfn)(const struct hist_block *, void *);
+
+struct history *hist_open(const char *dir);
+int hist_append(struct history *h, int game, const vector main,
+    const vector bonus, int64_t stamp);
+size_t hist_count(const struct history *h, int game);
+int hist_get(struct history *h, int game, size_t n, vector main,
+    vector bonus, int64_t *stamp);
+int hist_scan(struct history *h, int game, size_t from, size_t to,
+    hist_scanfn fn, void *arg);
+struct freq *hist_freq(struct history *h, int game);
+int hist_sync(struct history *h);
+void hist_close(struct history *h);
+
+#endif /* HISTORY_H */
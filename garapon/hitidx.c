@@ -0,0 +1,290 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hitidx.h"
+#include "ticket.h"
+
+/*
+ * How close tickets came to past draws, answered from one bitset per
+ * ball instead of matching every ticket against every draw.  The S
+ * rows of a ticket's numbers are added 64 draws at a time into a
+ * bit-sliced counter of three planes, plane j holding bit j of each
+ * draw's match count (up to GAME_MAXPICK), so one pass over S words per
+ * 64 draws gives both the draws with at least k hits and the best match.
+ *
+ * Batches go through the ticket ingestion path.  Each chunk is worked
+ * in blocks of tickets against tiles of HITIDX_TILE words, so the rows
+ * of a tile stay in cache while the whole block is scanned over them.
+ */
+
+#define BLOCK 256
+
+static int
+mark(const struct hist_block *b, void *arg)
+{
+	struct hitidx *x = arg;
+	size_t d;
+	int i, k;
+
+	for (i = b->lo; i < b->hi; ++i) {
+		d = b->first + i;
+		for (k = 0; k < games[x->game].sample; ++k)
+			x->bits[(b->main[k][i] - 1) * x->words + d / 64] |=
+			    (uint64_t) 1 << (d % 64);
+	}
+	return 0;
+}
+
+struct hitidx *
+hitidx_history(struct history *h, int game)
+{
+	struct hitidx *x;
+	int save;
+
+	if ((x = (struct hitidx *) calloc(1, sizeof(*x))) == NULL)
+		return NULL;
+	x->game = game;
+	x->n = hist_count(h, game);
+	/* whole tiles, so that every row ends on a tile boundary */
+	x->words = MAX((x->n + 64 * HITIDX_TILE - 1) / (64 * HITIDX_TILE),
+	    1) * HITIDX_TILE;
+	if ((x->bits = (uint64_t *) calloc(games[game].number * x->words,
+	    sizeof(uint64_t))) == NULL ||
+	    hist_scan(h, game, 0, x->n, mark, x) != 0) {
+		save = errno;
+		hitidx_free(x);
+		errno = save;
+		return NULL;
+	}
+	return x;
+}
+
+/*
+ * The draws of a bit-sliced count with at least k hits, compared a plane
+ * at a time from the top without branches.
+ */
+static inline uint64_t
+atleast(uint64_t c0, uint64_t c1, uint64_t c2, int k)
+{
+	uint64_t ge, eq, kb;
+
+	kb = -(uint64_t) (k >> 2 & 1);
+	ge = c2 & ~kb;
+	eq = ~(c2 ^ kb);
+	kb = -(uint64_t) (k >> 1 & 1);
+	ge |= eq & c1 & ~kb;
+	eq &= ~(c1 ^ kb);
+	kb = -(uint64_t) (k & 1);
+	ge |= eq & c0 & ~kb;
+	eq &= ~(c0 ^ kb);
+	return ge | eq;
+}
+
+static inline int
+popcount(uint64_t v)
+{
+	v -= v >> 1 & 0x5555555555555555ULL;
+	v = (v & 0x3333333333333333ULL) + (v >> 2 & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	v += v >> 8;
+	v += v >> 16;
+	v += v >> 32;
+	return (int) (v & 0x7f);
+}
+
+/*
+ * Scans the tile of words from w0 for ticket t, listing up to max draws
+ * with k hits or more in draws[] from *nlist on.  The rows are added
+ * into the counts a row at a time and every loop runs over a whole
+ * tile, which leaves the compiler free to vectorize them.
+ */
+static void
+scan(const struct hitidx *x, const int *t, int k, size_t w0,
+    struct hitidx_result *r, size_t *draws, size_t max, size_t *nlist)
+{
+	uint64_t c0[HITIDX_TILE], c1[HITIDX_TILE], c2[HITIDX_TILE];
+	const uint64_t *row;
+	uint64_t b, carry, count, m, better;
+	size_t w;
+	int i, next, s;
+
+	s = games[x->game].sample;
+	memset(c0, 0, sizeof(c0));
+	memset(c1, 0, sizeof(c1));
+	memset(c2, 0, sizeof(c2));
+	for (i = 0; i < s; ++i) {
+		row = x->bits + (t[i] - 1) * x->words + w0;
+		for (w = 0; w < HITIDX_TILE; ++w) {
+			/* a ripple-carry add of one bit to every count */
+			b = row[w];
+			carry = c0[w] & b;
+			c0[w] ^= b;
+			b = carry;
+			carry = c1[w] & b;
+			c1[w] ^= b;
+			c2[w] |= carry;
+		}
+	}
+
+	count = 0;
+	better = 0;
+	next = MIN(r->best + 1, s);
+	for (w = 0; w < HITIDX_TILE; ++w) {
+		count += popcount(atleast(c0[w], c1[w], c2[w], k));
+		better |= atleast(c0[w], c1[w], c2[w], next);
+	}
+	r->count += count;
+	if (draws != NULL)
+		for (w = 0; w < HITIDX_TILE && *nlist < max; ++w)
+			for (m = atleast(c0[w], c1[w], c2[w], k);
+			    m != 0 && *nlist < max; m &= m - 1)
+				draws[(*nlist)++] = (w0 + w) * 64 +
+				    __builtin_ctzll(m);
+	if (r->best == s || better == 0)
+		return;
+	for (w = 0; w < HITIDX_TILE; ++w) {
+		while (r->best < s && (m = atleast(c0[w], c1[w], c2[w],
+		    r->best + 1)) != 0) {
+			++r->best;
+			r->draw = (w0 + w) * 64 + __builtin_ctzll(m);
+		}
+	}
+}
+
+/*
+ * Matches one ticket of main numbers against every draw.  Fills r and
+ * up to max of the draws with k hits or more; returns how many draws
+ * were listed.
+ */
+size_t
+hitidx_match(const struct hitidx *x, const vector ticket, int k,
+    struct hitidx_result *r, size_t *draws, size_t max)
+{
+	size_t nlist, w;
+
+
+	memset(r, 0, sizeof(*r));
+	nlist = 0;
+	for (w = 0; w < x->words; w += HITIDX_TILE)
+		scan(x, ticket, MAX(k, 1), w, r, draws, max, &nlist);
+	return nlist;
+}
+
+void
+hitidx_add(struct hitidx_query *q, const vector tickets, size_t n)
+{
+	const struct hitidx *x = q->x;
+	struct hitidx_result r[BLOCK];
+	size_t first, i, len, w;
+	int width;
+
+	width = TK_WIDTH(&games[x->game]);
+	for (first = 0; first < n; first += len) {
+		len = MIN(n - first, BLOCK);
+		memset(r, 0, len * sizeof(r[0]));
+		for (w = 0; w < x->words; w += HITIDX_TILE)
+			for (i = 0; i < len; ++i)
+				scan(x, tickets + (first + i) * width,
+				    MAX(q->k, 1), w, &r[i], NULL, 0, NULL);
+		for (i = 0; i < len; ++i) {
+			++q->best[r[i].best];
+			if (r[i].count > 0)
+				++q->reached;
+			q->count += r[i].count;
+		}
+	}
+	q->tickets += n;
+}
+
+void
+hitidx_report(FILE *fp, const struct hitidx_query *q)
+{
+	int i;
+
+	fprintf(fp, "%-8s %13s\n", "best", "tickets");
+	for (i = games[q->x->game].sample; i >= 0; --i)
+		fprintf(fp, "%-8d %13llu\n", i,
+		    (unsigned long long) q->best[i]);
+	fprintf(fp, "%llu of %llu tickets matched %d in %llu draws\n",
+	    (unsigned long long) q->reached,
+	    (unsigned long long) q->tickets, q->k,
+	    (unsigned long long) q->count);
+}
+
+static void *
+stage_open(int game, void *arg)
+{
+	struct hitidx_query *q;
+
+	if (game != ((struct hitidx_query *) arg)->x->game)
+		errx(1, "tickets are for %s", games[game].name);
+	if ((q = (struct hitidx_query *) malloc(sizeof(*q))) == NULL)
+		err(1, NULL);
+	memcpy(q, arg, sizeof(*q));
+	memset(q->best, 0, sizeof(q->best));
+	q->tickets = q->reached = q->count = 0;
+	return q;
+}
+
+static void
+stage_feed(void *st, const vector tickets, size_t n)
+{
+	hitidx_add(st, tickets, n);
+}
+
+static void
+stage_merge(void *into, void *from)
+{
+	struct hitidx_query *a = into, *b = from;
+	int i;
+
+	for (i = 0; i <= GAME_MAXPICK; ++i)
+		a->best[i] += b->best[i];
+	a->tickets += b->tickets;
+	a->reached += b->reached;
+	a->count += b->count;
+}
+
+static void
+stage_close(void *st)
+{
+	free(st);
+}
+
+const struct stage hitidx_stage = {
+	"history match", stage_open, stage_feed, stage_merge, stage_close,
+	NULL
+};
+
+void
+hitidx_free(struct hitidx *x)
+{
+	if (x == NULL)
+		return;
+	free(x->bits);
+	free(x);
+}
@@ -0,0 +1,53 @@
+/* hitidx.h */
+
+#ifndef HITIDX_H
+#define HITIDX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "engine.h"
+#include "history.h"
+#include "ingest.h"
+
+#define HITIDX_TILE 128		/* words of a ball row scanned at once */
+
+/*
+ * An inverted index of the draw history of one game: row b - 1 is a
+ * bitset over the draws, with bit i set when ball b was among the main
+ * numbers of draw i.
+ */
+struct hitidx {
+	int game;
+	size_t n;
+	size_t words;
+	uint64_t *bits;
+};
+
+struct hitidx_result {
+	int best;		/* most main numbers matched in one draw */
+	size_t draw;		/* the first draw matching that many */
+	uint64_t count;		/* draws matching at least k */
+};
+
+/* The query of hitidx_stage and the totals it returns. */
+struct hitidx_query {
+	const struct hitidx *x;
+	int k;
+	uint64_t tickets;
+	uint64_t best[GAME_MAXPICK + 1];
+	uint64_t reached;	/* tickets matching k in some draw */
+	uint64_t count;		/* ticket and draw pairs matching k */
+};
+
+extern const struct stage hitidx_stage;
+
+struct hitidx *hitidx_history(struct history *h, int game);
+size_t hitidx_match(const struct hitidx *x, const vector ticket, int k,
+    struct hitidx_result *r, size_t *draws, size_t max);
+void hitidx_add(struct hitidx_query *q, const vector tickets, size_t n);
+void hitidx_report(FILE *fp, const struct hitidx_query *q);
+void hitidx_free(struct hitidx *x);
+
+#endif /* HITIDX_H */
@@ -0,0 +1,144 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ingest.h"
+#include "rank.h"
+#include "ticket.h"
+
+/*
+ * The ticket-ingestion path shared by settlement and the statistics
+ * built over the tickets sold.  Threads take turns pulling a chunk of
+ * ranks from the ticket file; unranking and the stages run in parallel.
+ */
+
+struct feeder {
+	struct tkfile *tk;
+	pthread_mutex_t lock;
+	const struct stage *stage;
+	int nstage;
+	int error;
+};
+
+struct reader {
+	struct feeder *f;
+	pthread_t tid;
+	void *st[INGEST_MAXSTAGE];
+};
+
+static void *
+reader(void *arg)
+{
+	struct reader *r = arg;
+	struct feeder *f = r->f;
+	const struct game *g;
+	uint32_t *rank;
+	vector t;
+	size_t n;
+	int i;
+
+	g = &games[f->tk->game];
+	rank = (uint32_t *) malloc(INGEST_CHUNK * sizeof(uint32_t));
+	t = (vector) malloc(INGEST_CHUNK * TK_WIDTH(g) * sizeof(int));
+	if (rank == NULL || t == NULL)
+		err(1, NULL);
+	for (;;) {
+		pthread_mutex_lock(&f->lock);
+		n = tk_read_ranks(f->tk, rank, INGEST_CHUNK);
+		if (n == 0 && f->tk->error != 0)
+			f->error = f->tk->error;
+		pthread_mutex_unlock(&f->lock);
+		if (n == 0)
+			break;
+		ticket_unrank_batch(g, rank, n, t);
+		for (i = 0; i < f->nstage; ++i)
+			f->stage[i].feed(r->st[i], t, n);
+	}
+	free(rank);
+	free(t);
+	return NULL;
+}
+
+/*
+ * Streams the ticket file at path through nstage stages on threads
+ * threads (all online CPUs when 0).  out[i] receives the merged state
+ * of stage i, to be released with its close().  Returns the game of the
+ * file, or -1 with errno set.
+ */
+int
+ingest(const char *path, int threads, const struct stage *stage,
+    int nstage, void **out)
+{
+	struct feeder f;
+	struct reader *r;
+	int game, i, j, n;
+
+	if (nstage < 1 || nstage > INGEST_MAXSTAGE) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ((f.tk = tk_open(path)) == NULL)
+		return -1;
+	pthread_mutex_init(&f.lock, NULL);
+	f.stage = stage;
+	f.nstage = nstage;
+	f.error = 0;
+	game = f.tk->game;
+
+	n = threads > 0 ? threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+	n = MAX(n, 1);
+	if ((r = (struct reader *) calloc(n, sizeof(*r))) == NULL)
+		err(1, NULL);
+	for (i = 0; i < n; ++i) {
+		r[i].f = &f;
+		for (j = 0; j < nstage; ++j)
+			r[i].st[j] = stage[j].open(game, stage[j].arg);
+	}
+	for (i = 0; i < n; ++i)
+		if (pthread_create(&r[i].tid, NULL, reader, &r[i]) != 0)
+			err(1, "pthread_create");
+	for (i = 0; i < n; ++i)
+		pthread_join(r[i].tid, NULL);
+
+	for (j = 0; j < nstage; ++j) {
+		for (i = 1; i < n; ++i) {
+			stage[j].merge(r[0].st[j], r[i].st[j]);
+			stage[j].close(r[i].st[j]);
+		}
+		out[j] = r[0].st[j];
+	}
+	free(r);
+	pthread_mutex_destroy(&f.lock);
+	tk_close(f.tk);
+	if (f.error) {
+		for (j = 0; j < nstage; ++j)
+			stage[j].close(out[j]);
+		errno = f.error;
+		return -1;
+	}
+	return game;
+}
@@ -0,0 +1,30 @@
+/* ingest.h */
+
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+
+#include "engine.h"
+
+#define INGEST_CHUNK 4096
+#define INGEST_MAXSTAGE 8
+
+/*
+ * A consumer of the ticket stream.  Every thread opens its own state
+ * for each stage and feeds it chunks of tickets (TK_WIDTH numbers
+ * each); afterwards the states are merged into the first one.
+ */
+struct stage {
+	const char *name;
+	void *(*open)(int game, void *arg);
+	void (*feed)(void *st, const vector tickets, size_t n);
+	void (*merge)(void *into, void *from);
+	void (*close)(void *st);
+	void *arg;
+};
+
+int ingest(const char *path, int threads, const struct stage *stage,
+    int nstage, void **out);
+
+#endif /* INGEST_H */
@@ -0,0 +1,252 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keno.h"
+
+/*
+ * Keno: the house draws KENO_S of KENO_N balls and a ticket of 1 to
+ * KENO_MAXSPOT spots is paid by how many of its spots were drawn.
+ * Settlement runs as the balls come out: each ball walks only the
+ * tickets that picked it and moves them one hit up the histogram, so
+ * the payout is complete as soon as the last ball has been revealed.
+ */
+
+/* Multiples of the stake paid for h hits on a ticket of s spots. */
+const uint32_t keno_pay[KENO_MAXSPOT + 1][KENO_MAXSPOT + 1] = {
+	{ 0 },
+	{ 0, 2 },
+	{ 0, 0, 10 },
+	{ 0, 0, 2, 25 },
+	{ 0, 0, 1, 5, 75 },
+	{ 0, 0, 0, 2, 18, 420 },
+	{ 0, 0, 0, 1, 7, 50, 1100 },
+	{ 0, 0, 0, 1, 3, 17, 100, 4500 },
+	{ 0, 0, 0, 0, 2, 12, 50, 750, 10000 },
+	{ 0, 0, 0, 0, 1, 6, 25, 150, 3000, 30000 },
+	{ 5, 0, 0, 0, 0, 2, 15, 40, 450, 4250, 100000 }
+};
+
+#define SPOTS(st) ((st) >> 4)
+#define HITS(st) ((st) & 0xf)
+
+/*
+ * The first n balls of a shuffle of 1 to number, in draw order.
+ */
+static void
+deal(struct pool *p, vector v, int n, int number)
+{
+	int ball[KENO_N];
+	int i, j;
+
+	for (i = 0; i < number; ++i)
+		ball[i] = i + 1;
+	for (i = 0; i < n; ++i) {
+		j = i + (int) pool_bounded(p, number - i);
+		v[i] = ball[j];
+		ball[j] = ball[i];
+	}
+}
+
+void
+keno_pick(struct pool *p, int spots, vector v)
+{
+	deal(p, v, spots, KENO_N);
+}
+
+void
+keno_draw(struct pool *p, vector ball)
+{
+	deal(p, ball, KENO_S, KENO_N);
+}
+
+struct keno *
+keno_new(void)
+{
+	return (struct keno *) calloc(1, sizeof(struct keno));
+}
+
+/*
+ * Sells a ticket of the given spots.  Returns -1 with errno set to
+ * EINVAL when the ticket is not a valid keno ticket or sales are
+ * closed, or ENOMEM.
+ */
+int
+keno_add(struct keno *k, const vector v, int spots)
+{
+	uint8_t seen[KENO_N + 1];
+	uint8_t *state, *pick;
+	size_t cap;
+	int i;
+
+	if (k->start != NULL || spots < 1 || spots > KENO_MAXSPOT) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(seen, 0, sizeof(seen));
+	for (i = 0; i < spots; ++i) {
+		if (v[i] < 1 || v[i] > KENO_N || seen[v[i]]) {
+			errno = EINVAL;
+			return -1;
+		}
+		seen[v[i]] = 1;
+	}
+	if (k->n == k->cap) {
+		cap = k->cap == 0 ? 1024 : k->cap * 2;
+		if ((state = (uint8_t *) realloc(k->state, cap)) == NULL)
+			return -1;
+		k->state = state;
+		if ((pick = (uint8_t *) realloc(k->pick,
+		    cap * KENO_MAXSPOT)) == NULL)
+			return -1;
+		k->pick = pick;
+		k->cap = cap;
+	}
+	k->state[k->n++] = (uint8_t) (spots << 4);
+	for (i = 0; i < spots; ++i)
+		k->pick[k->npick++] = (uint8_t) v[i];
+	return 0;
+}
+
+/*
+ * Closes sales: lists the tickets of every ball with a counting sort
+ * and opens the histogram with no hits.  Returns -1 when out of memory.
+ */
+int
+keno_close(struct keno *k)
+{
+	size_t i, t;
+	int b, s;
+
+	if ((k->start = (uint32_t *) calloc(KENO_N + 2,
+	    sizeof(uint32_t))) == NULL)
+		return -1;
+	if ((k->index = (uint32_t *) malloc(MAX(k->npick, 1) *
+	    sizeof(uint32_t))) == NULL) {
+		free(k->start);
+		k->start = NULL;
+		return -1;
+	}
+	for (i = 0; i < k->npick; ++i)
+		++k->start[k->pick[i] + 1];
+	for (b = 1; b <= KENO_N + 1; ++b)
+		k->start[b] += k->start[b - 1];
+	/* filling moves start[b] on to the end of ball b */
+	for (i = 0, t = 0; t < k->n; ++t)
+		for (s = SPOTS(k->state[t]); s > 0; --s, ++i)
+			k->index[k->start[k->pick[i]]++] = (uint32_t) t;
+	free(k->pick);
+	k->pick = NULL;
+	keno_reset(k);
+	return 0;
+}
+
+static void
+total(struct keno *k)
+{
+	int h, s;
+
+	k->paid = 0;
+	for (s = 1; s <= KENO_MAXSPOT; ++s)
+		for (h = 0; h <= s; ++h)
+			k->paid += k->hist[s][h] * keno_pay[s][h];
+}
+
+/*
+ * Starts a new draw for the same tickets.
+ */
+void
+keno_reset(struct keno *k)
+{
+	size_t t;
+
+	memset(k->hist, 0, sizeof(k->hist));
+	for (t = 0; t < k->n; ++t) {
+		k->state[t] &= 0xf0;
+		++k->hist[SPOTS(k->state[t])][0];
+	}
+	k->drawn = 0;
+	total(k);
+}
+
+/*
+ * Settles one drawn ball.
+ */
+void
+keno_reveal(struct keno *k, int ball)
+{
+	uint8_t *restrict state = k->state;
+	const uint32_t *p, *end;
+	uint8_t st;
+
+	k->ball[k->drawn++] = ball;
+	/* the tickets of ball b run from start[b - 1] to start[b] */
+	end = k->index + k->start[ball];
+	for (p = k->index + k->start[ball - 1]; p < end; ++p) {
+		st = state[*p];
+		--k->hist[SPOTS(st)][HITS(st)];
+		++k->hist[SPOTS(st)][HITS(st) + 1];
+		state[*p] = st + 1;
+	}
+	total(k);
+}
+
+void
+keno_report(FILE *fp, const struct keno *k)
+{
+	uint64_t tickets, winners, paid;
+	int h, s;
+
+	fprintf(fp, "%-6s %13s %13s %15s\n", "spots", "tickets", "winners",
+	    "paid");
+	for (s = 1; s <= KENO_MAXSPOT; ++s) {
+		tickets = winners = paid = 0;
+		for (h = 0; h <= s; ++h) {
+			tickets += k->hist[s][h];
+			if (keno_pay[s][h] > 0) {
+				winners += k->hist[s][h];
+				paid += k->hist[s][h] * keno_pay[s][h];
+			}
+		}
+		fprintf(fp, "%-6d %13llu %13llu %15llu\n", s,
+		    (unsigned long long) tickets,
+		    (unsigned long long) winners, (unsigned long long) paid);
+	}
+	fprintf(fp, "%-6s %13llu %13s %15llu\n", "total",
+	    (unsigned long long) k->n, "",
+	    (unsigned long long) k->paid);
+}
+
+void
+keno_free(struct keno *k)
+{
+	if (k == NULL)
+		return;
+	free(k->state);
+	free(k->pick);
+	free(k->start);
+	free(k->index);
+	free(k);
+}
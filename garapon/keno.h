@@ -0,0 +1,47 @@
+/* keno.h */
+
+#ifndef KENO_H
+#define KENO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "entropy.h"
+#include "garapon.h"
+
+#define KENO_MAXSPOT 10
+
+/*
+ * The tickets open on one keno draw.  Once sales close each ball has
+ * the list of tickets that picked it, and hist[s][h] counts the tickets
+ * of s spots with h hits so far.  The state of a ticket keeps its spots
+ * in the high nibble and its hits in the low one.
+ */
+struct keno {
+	size_t n;
+	size_t cap;
+	uint8_t *state;
+	uint8_t *pick;
+	size_t npick;
+	uint32_t *start;
+	uint32_t *index;
+	int drawn;
+	int ball[KENO_S];
+	uint64_t hist[KENO_MAXSPOT + 1][KENO_MAXSPOT + 1];
+	uint64_t paid;
+};
+
+extern const uint32_t keno_pay[KENO_MAXSPOT + 1][KENO_MAXSPOT + 1];
+
+void keno_pick(struct pool *p, int spots, vector v);
+void keno_draw(struct pool *p, vector ball);
+struct keno *keno_new(void);
+int keno_add(struct keno *k, const vector v, int spots);
+int keno_close(struct keno *k);
+void keno_reveal(struct keno *k, int ball);
+void keno_reset(struct keno *k);
+void keno_report(FILE *fp, const struct keno *k);
+void keno_free(struct keno *k);
+
+#endif /* KENO_H */
@@ -0,0 +1,62 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+/* Writes binom.h, the table of binomial coefficients used by rank.c. */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "engine.h"
+
+#define BINOM_N GAME_MAXNUMBER
+#define BINOM_K GAME_MAXPICK
+
+int
+main(void)
+{
+	static uint64_t c[BINOM_N + 1][BINOM_K + 1];
+	int n, k;
+
+	for (n = 0; n <= BINOM_N; ++n) {
+		c[n][0] = 1;
+		for (k = 1; k <= BINOM_K; ++k) {
+			if (n == 0)
+				c[n][k] = 0;
+			else if (c[n - 1][k - 1] > UINT64_MAX - c[n - 1][k])
+				c[n][k] = UINT64_MAX;
+			else
+				c[n][k] = c[n - 1][k - 1] + c[n - 1][k];
+		}
+	}
+
+	printf("/* binom.h - generated by mkbinom, do not edit */\n\n");
+	printf("#ifndef BINOM_H\n#define BINOM_H\n\n#include <stdint.h>\n\n");
+	printf("#define BINOM_N %d\n#define BINOM_K %d\n\n", BINOM_N, BINOM_K);
+	printf("static const uint64_t binom[BINOM_N + 1][BINOM_K + 1] = {\n");
+	for (n = 0; n <= BINOM_N; ++n) {
+		printf("\t{");
+		for (k = 0; k <= BINOM_K; ++k)
+			printf(" %lluULL%s", (unsigned long long) c[n][k],
+			    k < BINOM_K ? "," : " ");
+		printf("}%s\n", n < BINOM_N ? "," : "");
+	}
+	printf("};\n\n#endif /* BINOM_H */\n");
+	return 0;
+}
@@ -0,0 +1,127 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "prize.h"
+
+/*
+ * Prize tiers of every game, best first.  A ticket's extra matches are
+ * its numbers found among the omake numbers for games drawing them
+ * from the main machine, and its second machine numbers found among
+ * the drawn ones otherwise.  The top tier of a game with a jackpot
+ * shares the jackpot; price, share (of sales paid back as prizes),
+ * jpshare (of that going to the jackpot), seed and cap describe it.
+ */
+const struct prize_table prizes[NGAMES] = {
+	{ 200, 0.45, 0, 0, 0, 4, {
+		{ 5, ANY, 10000000 },
+		{ 4, 1, 150000 },
+		{ 4, 0, 10000 },
+		{ 3, ANY, 1000 } } },
+	{ 200, 0.45, 0.4, 200000000, 600000000, 5, {
+		{ 6, ANY, PRIZE_JACKPOT },
+		{ 5, 1, 10000000 },
+		{ 5, 0, 300000 },
+		{ 4, ANY, 6800 },
+		{ 3, ANY, 1000 } } },
+	{ 300, 0.45, 0.4, 600000000, 1000000000, 7, {
+		{ 7, ANY, PRIZE_JACKPOT },
+		{ 6, 1, 7300000 },
+		{ 6, 0, 730000 },
+		{ 5, ANY, 9100 },
+		{ 4, ANY, 1400 },
+		{ 3, 1, 1000 },
+		{ 3, 2, 1000 } } },
+	{ 2, 0.5, 0.68, 20000000, 0, 9, {
+		{ 5, 1, PRIZE_JACKPOT },
+		{ 5, 0, 1000000 },
+		{ 4, 1, 50000 },
+		{ 4, 0, 100 },
+		{ 3, 1, 100 },
+		{ 3, 0, 7 },
+		{ 2, 1, 7 },
+		{ 1, 1, 4 },
+		{ 0, 1, 4 } } },
+	{ 2, 0.5, 0.7, 20000000, 0, 9, {
+		{ 5, 1, PRIZE_JACKPOT },
+		{ 5, 0, 1000000 },
+		{ 4, 1, 10000 },
+		{ 4, 0, 500 },
+		{ 3, 1, 200 },
+		{ 3, 0, 10 },
+		{ 2, 1, 10 },
+		{ 1, 1, 4 },
+		{ 0, 1, 2 } } },
+	{ 2.5, 0.5, 0.5, 17000000, 250000000, 12, {
+		{ 5, 2, PRIZE_JACKPOT },
+		{ 5, 1, 300000 },
+		{ 5, 0, 60000 },
+		{ 4, 2, 3000 },
+		{ 4, 1, 150 },
+		{ 4, 0, 60 },
+		{ 3, 2, 50 },
+		{ 2, 2, 20 },
+		{ 3, 1, 15 },
+		{ 3, 0, 13 },
+		{ 1, 2, 10 },
+		{ 2, 1, 8 } } }
+};
+
+int
+prize_tier(int game, int main, int extra)
+{
+	const struct prize_table *pt = &prizes[game];
+	int t;
+
+	for (t = 0; t < pt->ntier; ++t)
+		if (pt->tier[t].main == main &&
+		    (pt->tier[t].extra == ANY || pt->tier[t].extra == extra))
+			return t;
+	return -1;
+}
+
+/*
+ * Counts the matches of one ticket (sorted main numbers, then second
+ * machine numbers) against a draw as returned by draw_game().
+ */
+void
+count_matches(const struct game *g, const vector ticket, const vector main,
+    const vector bonus, int *m, int *e)
+{
+	int i, j;
+
+	*m = *e = 0;
+	for (i = 0, j = 0; i < g->sample && j < g->sample; ) {
+		if (ticket[i] == main[j]) {
+			++*m;
+			++i;
+			++j;
+		} else if (ticket[i] < main[j])
+			++i;
+		else
+			++j;
+	}
+	for (i = 0; i < g->sample; ++i)
+		for (j = 0; j < g->omake; ++j)
+			*e += (ticket[i] == bonus[j]);
+	for (i = 0; i < g->xsample; ++i)
+		for (j = 0; j < g->xsample; ++j)
+			*e += (ticket[g->sample + i] == bonus[g->omake + j]);
+}
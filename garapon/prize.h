@@ -0,0 +1,34 @@
+/* prize.h */
+
+#ifndef PRIZE_H
+#define PRIZE_H
+
+#include "engine.h"
+
+#define PRIZE_MAXTIER 16
+#define PRIZE_JACKPOT (-1.0)
+#define ANY (-1)
+
+struct tier {
+	int main;
+	int extra;
+	double prize;
+};
+
+struct prize_table {
+	double price;
+	double share;
+	double jpshare;
+	double seed;
+	double cap;
+	int ntier;
+	struct tier tier[PRIZE_MAXTIER];
+};
+
+extern const struct prize_table prizes[NGAMES];
+
+int prize_tier(int game, int main, int extra);
+void count_matches(const struct game *g, const vector ticket,
+    const vector main, const vector bonus, int *m, int *e);
+
+#endif /* PRIZE_H */
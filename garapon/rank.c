@@ -0,0 +1,140 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "binom.h"
+#include "rank.h"
+
+/*
+ * Combinatorial number system.  A sorted combination c[0] < ... <
+ * c[k - 1] of 0-based numbers has rank C(c[0], 1) + ... + C(c[k - 1], k),
+ * which enumerates the k-subsets of any n in colexicographic order.
+ * A ticket is ranked as its main numbers times the number of choices
+ * for the second machine plus the rank of those; every game in games[]
+ * has fewer than 2^32 tickets.
+ */
+
+uint64_t
+comb_count(int n, int k)
+{
+	if (k < 0 || n < k)
+		return 0;
+	return binom[n][k];
+}
+
+uint64_t
+comb_rank(const vector v, int k)
+{
+	uint64_t r = 0;
+	int i;
+
+	for (i = 0; i < k; ++i)
+		r += binom[v[i] - 1][i + 1];
+	return r;
+}
+
+void
+comb_unrank(uint64_t r, int k, vector v)
+{
+	int i, lo, hi, mid;
+
+	for (hi = BINOM_N + 1, i = k - 1; i >= 0; --i) {
+		lo = i;
+		while (hi - lo > 1) {
+			mid = (lo + hi) / 2;
+			if (binom[mid][i + 1] <= r)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		r -= binom[lo][i + 1];
+		v[i] = lo + 1;
+		hi = lo;
+	}
+}
+
+uint64_t
+ticket_space(const struct game *g)
+{
+	return comb_count(g->number, g->sample) *
+	    comb_count(g->xnumber, g->xsample);
+}
+
+uint64_t
+ticket_rank(const struct game *g, const vector t)
+{
+	return comb_rank(t, g->sample) * comb_count(g->xnumber, g->xsample) +
+	    comb_rank(t + g->sample, g->xsample);
+}
+
+void
+ticket_unrank(const struct game *g, uint64_t r, vector t)
+{
+	uint64_t x;
+
+	x = comb_count(g->xnumber, g->xsample);
+	comb_unrank(r / x, g->sample, t);
+	comb_unrank(r % x, g->xsample, t + g->sample);
+}
+
+void
+ticket_rank_batch(const struct game *g, const vector t, size_t n,
+    uint32_t *r)
+{
+	const int *v;
+	uint64_t m, x, y;
+	size_t i;
+	int k, s, w;
+
+	x = comb_count(g->xnumber, g->xsample);
+	s = g->sample;
+	w = s + g->xsample;
+	for (i = 0, v = t; i < n; ++i, v += w) {
+		m = y = 0;
+		for (k = 0; k < s; ++k)
+			m += binom[v[k] - 1][k + 1];
+		for (k = 0; k < g->xsample; ++k)
+			y += binom[v[s + k] - 1][k + 1];
+		r[i] = (uint32_t) (m * x + y);
+	}
+}
+
+void
+ticket_unrank_batch(const struct game *g, const uint32_t *r, size_t n,
+    vector t)
+{
+	size_t i;
+	int w;
+
+	w = g->sample + g->xsample;
+	for (i = 0; i < n; ++i, t += w)
+		ticket_unrank(g, r[i], t);
+}
+
+/*
+ * Uniform random tickets are uniform random ranks.
+ */
+void
+ticket_sample(const struct game *g, struct pool *p, uint32_t *r, size_t n)
+{
+	pool_fill_bounded(p, r, n, (uint32_t) ticket_space(g));
+}
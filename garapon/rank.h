@@ -0,0 +1,26 @@
+/* rank.h */
+
+#ifndef RANK_H
+#define RANK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine.h"
+#include "entropy.h"
+
+uint64_t comb_count(int n, int k);
+uint64_t comb_rank(const vector v, int k);
+void comb_unrank(uint64_t r, int k, vector v);
+
+uint64_t ticket_space(const struct game *g);
+uint64_t ticket_rank(const struct game *g, const vector t);
+void ticket_unrank(const struct game *g, uint64_t r, vector t);
+void ticket_rank_batch(const struct game *g, const vector t, size_t n,
+    uint32_t *r);
+void ticket_unrank_batch(const struct game *g, const uint32_t *r, size_t n,
+    vector t);
+void ticket_sample(const struct game *g, struct pool *p, uint32_t *r,
+    size_t n);
+
+#endif /* RANK_H */
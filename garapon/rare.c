@@ -0,0 +1,473 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "entropy.h"
+#include "rare.h"
+#include "ticket.h"
+
+/*
+ * Importance sampling of the prize tiers won by a set of tickets.  A
+ * uniform draw makes a jackpot winner once in hundreds of millions of
+ * draws, so most draws here are instead built around a ticket of the
+ * set: a ticket is picked at random, then a match level (m main and e
+ * bonus numbers in common) uniformly from the possible ones, then a
+ * draw uniformly from the N(m, e) draws at that level.  RARE_UNIFORM of
+ * the draws stay uniform, which keeps every draw possible.
+ *
+ * The chance q of a draw under this mixture is exact, since the match
+ * levels of all the tickets against it are counted anyway:
+ *
+ *	q / u = a + (1 - a) * U / n * sum over tickets of pi / N(m, e)
+ *
+ * with u = 1 / U the chance of the draw when uniform, a the uniform
+ * share and pi the chance of each level.  A draw is weighted u / q, so
+ * the weighted means are unbiased for uniform draws.  Chunk i of
+ * RARE_CHUNK draws uses stream i of the seed and its sums are added in
+ * chunk order, so the estimates do not depend on the thread count.
+ * The chunks run in rounds of RARE_ROUND to bound the memory held by
+ * their sums.
+ */
+
+#define MAXE GAME_MAXBONUS
+
+struct tmask {
+	uint64_t main[2];
+	uint64_t bonus[2];
+};
+
+struct model {
+	const struct game *g;
+	const int *tickets;
+	size_t n;
+	int width;
+	struct tmask *mask;
+	int ja;			/* bonus numbers from the main machine */
+	int nb;			/* bonus numbers drawn */
+	int tierof[GAME_MAXPICK + 1][MAXE + 1];
+	double prize[PRIZE_MAXTIER];
+	double bias[GAME_MAXPICK + 1][MAXE + 1];
+	int level[(GAME_MAXPICK + 1) * (MAXE + 1)][2];
+	int nlevel;
+	uint64_t draws;
+	uint64_t seed;
+	atomic_uint_fast64_t next;
+	uint64_t base;		/* first chunk of the round */
+	uint64_t end;
+	struct rare_sums *chunk;
+};
+
+struct rarethread {
+	struct model *md;
+	pthread_t tid;
+};
+
+static double
+choose(int n, int k)
+{
+	double c;
+	int i;
+
+	if (k < 0 || n < k)
+		return 0;
+	for (c = 1, i = 0; i < k; ++i)
+		c = c * (n - i) / (i + 1);
+	return c;
+}
+
+/* The draws sharing m main and e bonus numbers with a given ticket. */
+static double
+level_count(const struct game *g, int m, int e)
+{
+	int s = g->sample;
+
+	if (g->xsample == 0)
+		return choose(s, m) * choose(g->number - s, s - m) *
+		    choose(s - m, e) *
+		    choose(g->number - 2 * s + m, g->omake - e);
+	return choose(s, m) * choose(g->number - s, s - m) *
+	    choose(g->xsample, e) *
+	    choose(g->xnumber - g->xsample, g->xsample - e);
+}
+
+static double
+draw_count(const struct game *g)
+{
+	if (g->xsample == 0)
+		return choose(g->number, g->sample) *
+		    choose(g->number - g->sample, g->omake);
+	return choose(g->number, g->sample) *
+	    choose(g->xnumber, g->xsample);
+}
+
+/* The bits set in a and b together. */
+static inline int
+popcount2(uint64_t a, uint64_t b)
+{
+	a -= a >> 1 & 0x5555555555555555ULL;
+	b -= b >> 1 & 0x5555555555555555ULL;
+	a = (a & 0x3333333333333333ULL) + (a >> 2 & 0x3333333333333333ULL);
+	b = (b & 0x3333333333333333ULL) + (b >> 2 & 0x3333333333333333ULL);
+	a = (a & 0x0f0f0f0f0f0f0f0fULL) + (a >> 4 & 0x0f0f0f0f0f0f0f0fULL) +
+	    (b & 0x0f0f0f0f0f0f0f0fULL) + (b >> 4 & 0x0f0f0f0f0f0f0f0fULL);
+	return (int) (a * 0x0101010101010101ULL >> 56);
+}
+
+static void
+setbit(uint64_t *mask, int n)
+{
+	mask[(n - 1) >> 6] |= (uint64_t) 1 << ((n - 1) & 63);
+}
+
+/* Moves k of the n balls, chosen at random, to the front. */
+static void
+pick(struct pool *p, int *ball, int n, int k)
+{
+	int i, j, temp;
+
+	for (i = 0; i < k; ++i) {
+		j = i + (int) pool_bounded(p, n - i);
+		temp = ball[i];
+		ball[i] = ball[j];
+		ball[j] = temp;
+	}
+}
+
+/*
+ * Splits 1 to number into the k numbers of a ticket, in[], and the
+ * others, out[].  Returns how many others there are.
+ */
+static int
+split(const int *t, int k, int number, int *in, int *out)
+{
+	uint64_t mask[2] = { 0, 0 };
+	int i, n;
+
+	for (i = 0; i < k; ++i) {
+		in[i] = t[i];
+		setbit(mask, t[i]);
+	}
+	for (n = 0, i = 1; i <= number; ++i)
+		if (!(mask[(i - 1) >> 6] >> ((i - 1) & 63) & 1))
+			out[n++] = i;
+	return n;
+}
+
+/*
+ * A draw sharing exactly m main and e bonus numbers with ticket t, as
+ * the masks of its main and bonus numbers.
+ */
+static void
+biased(const struct model *md, struct pool *p, const int *t, int m, int e,
+    uint64_t *dm, uint64_t *bm)
+{
+	const struct game *g = md->g;
+	int in[GAME_MAXPICK], out[GAME_MAXNUMBER];
+	int i, nout, s;
+
+	s = g->sample;
+	nout = split(t, s, g->number, in, out);
+	pick(p, in, s, m);
+	pick(p, out, nout, s - m);
+	for (i = 0; i < m; ++i)
+		setbit(dm, in[i]);
+	for (i = 0; i < s - m; ++i)
+		setbit(dm, out[i]);
+	if (md->ja) {
+		/* omake: the rest of the ticket and the rest of the others */
+		pick(p, in + m, s - m, e);
+		pick(p, out + s - m, nout - (s - m), g->omake - e);
+		for (i = 0; i < e; ++i)
+			setbit(bm, in[m + i]);
+		for (i = 0; i < g->omake - e; ++i)
+			setbit(bm, out[s - m + i]);
+	} else if (g->xsample > 0) {
+		nout = split(t + s, g->xsample, g->xnumber, in, out);
+		pick(p, in, g->xsample, e);
+		pick(p, out, nout, g->xsample - e);
+		for (i = 0; i < e; ++i)
+			setbit(bm, in[i]);
+		for (i = 0; i < g->xsample - e; ++i)
+			setbit(bm, out[i]);
+	}
+}
+
+static void
+uniform(const struct model *md, struct pool *p, uint64_t *dm, uint64_t *bm)
+{
+	const struct game *g = md->g;
+	int main[GAME_MAXPICK], bonus[GAME_MAXBONUS];
+	int i;
+
+	draw_game(g, p, main, bonus);
+	for (i = 0; i < g->sample; ++i)
+		setbit(dm, main[i]);
+	for (i = 0; i < md->nb; ++i)
+		setbit(bm, bonus[i]);
+}
+
+static void
+sample(struct model *md, struct pool *p, struct rare_sums *s)
+{
+	const struct game *g = md->g;
+	const struct tmask *tm;
+	uint64_t cnt[GAME_MAXPICK + 1][MAXE + 1];
+	uint64_t dm[2] = { 0, 0 }, bm[2] = { 0, 0 };
+	double bias, f, paid, w, won[PRIZE_MAXTIER];
+	size_t i;
+	int e, l, m, t;
+
+	if (pool_u32(p) < (uint32_t) (RARE_UNIFORM * 4294967296.0))
+		uniform(md, p, dm, bm);
+	else {
+		i = pool_bounded(p, (uint32_t) md->n);
+		l = (int) pool_bounded(p, md->nlevel);
+		biased(md, p, md->tickets + i * md->width, md->level[l][0],
+		    md->level[l][1], dm, bm);
+	}
+
+	memset(cnt, 0, sizeof(cnt));
+	for (i = 0, tm = md->mask; i < md->n; ++i, ++tm) {
+		m = popcount2(tm->main[0] & dm[0], tm->main[1] & dm[1]);
+		e = popcount2(tm->bonus[0] & bm[0], tm->bonus[1] & bm[1]);
+		++cnt[m][e];
+	}
+
+	memset(won, 0, sizeof(won));
+	for (bias = 0, m = 0; m <= g->sample; ++m) {
+		for (e = 0; e <= md->nb; ++e) {
+			bias += cnt[m][e] * md->bias[m][e];
+			if ((t = md->tierof[m][e]) >= 0)
+				won[t] += cnt[m][e];
+		}
+	}
+	w = 1 / (RARE_UNIFORM + (1 - RARE_UNIFORM) * bias);
+	s->w += w;
+	s->ww += w * w;
+	for (paid = 0, t = 0; t < PRIZE_MAXTIER; ++t) {
+		f = w * (won[t] > 0);
+		s->any[t] += f;
+		s->anyany[t] += f * f;
+		f = w * won[t];
+		s->won[t] += f;
+		s->wonwon[t] += f * f;
+		paid += won[t] * md->prize[t];
+	}
+	s->paid += w * paid;
+	s->paidpaid += w * paid * w * paid;
+}
+
+static void *
+worker(void *arg)
+{
+	struct rarethread *rt = arg;
+	struct model *md = rt->md;
+	struct pool *p;
+	uint64_t chunk, i, n;
+
+	if ((p = malloc(sizeof(*p))) == NULL)
+		err(1, NULL);
+	while ((chunk = atomic_fetch_add(&md->next, 1)) < md->end) {
+		n = MIN(RARE_CHUNK, md->draws - chunk * RARE_CHUNK);
+		pool_seed(p, md->seed, chunk);
+		for (i = 0; i < n; ++i)
+			sample(md, p, &md->chunk[chunk - md->base]);
+	}
+	free(p);
+	return NULL;
+}
+
+static void
+add(struct rare_sums *into, const struct rare_sums *from)
+{
+	int t;
+
+	into->w += from->w;
+	into->ww += from->ww;
+	for (t = 0; t < PRIZE_MAXTIER; ++t) {
+		into->any[t] += from->any[t];
+		into->anyany[t] += from->anyany[t];
+		into->won[t] += from->won[t];
+		into->wonwon[t] += from->wonwon[t];
+	}
+	into->paid += from->paid;
+	into->paidpaid += from->paidpaid;
+}
+
+/*
+ * Estimates the tiers won by n tickets of game (TK_WIDTH numbers each)
+ * over draws importance-sampled draws on threads threads (all online
+ * CPUs when 0).  Returns -1 with errno set when there are no tickets
+ * or memory runs out.
+ */
+int
+rare_run(int game, const vector tickets, size_t n, uint64_t draws,
+    uint64_t seed, int threads, struct rare_result *r)
+{
+	const struct prize_table *pt;
+	struct rarethread *rt;
+	struct model md;
+	double N, U;
+	size_t i;
+	uint64_t nchunk;
+	int e, j, k, m, t;
+
+	memset(&md, 0, sizeof(md));
+	md.g = &games[game];
+	md.tickets = tickets;
+	md.n = n;
+	md.width = TK_WIDTH(md.g);
+	md.ja = md.g->xsample == 0;
+	md.nb = md.ja ? md.g->omake : md.g->xsample;
+	md.draws = draws;
+	md.seed = seed;
+	atomic_init(&md.next, 0);
+	nchunk = (draws + RARE_CHUNK - 1) / RARE_CHUNK;
+	if (n == 0 || (md.mask = calloc(n, sizeof(*md.mask))) == NULL ||
+	    (md.chunk = calloc(RARE_ROUND, sizeof(*md.chunk))) == NULL) {
+		free(md.mask);
+		if (n == 0)
+			errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < n; ++i) {
+		for (k = 0; k < md.g->sample; ++k)
+			setbit(md.mask[i].main, tickets[i * md.width + k]);
+		if (md.ja)
+			memcpy(md.mask[i].bonus, md.mask[i].main,
+			    sizeof(md.mask[i].bonus));
+		for (k = 0; k < md.g->xsample; ++k)
+			setbit(md.mask[i].bonus,
+			    tickets[i * md.width + md.g->sample + k]);
+	}
+
+	pt = &prizes[game];
+	for (t = 0; t < pt->ntier; ++t)
+		md.prize[t] = pt->tier[t].prize == PRIZE_JACKPOT ? pt->seed :
+		    pt->tier[t].prize;
+	memset(r, 0, sizeof(*r));
+	r->game = game;
+	r->tickets = n;
+	r->draws = draws;
+	U = draw_count(md.g);
+	for (m = 0; m <= md.g->sample; ++m)
+		for (e = 0; e <= md.nb; ++e)
+			if (level_count(md.g, m, e) > 0) {
+				md.level[md.nlevel][0] = m;
+				md.level[md.nlevel][1] = e;
+				++md.nlevel;
+			}
+	for (m = 0; m <= md.g->sample; ++m) {
+		for (e = 0; e <= MAXE; ++e) {
+			md.tierof[m][e] = e <= md.nb ?
+			    prize_tier(game, m, e) : -1;
+			if (e > md.nb || (N = level_count(md.g, m, e)) == 0)
+				continue;
+			md.bias[m][e] = U / (md.nlevel * N * n);
+			if (md.tierof[m][e] >= 0)
+				r->exact[md.tierof[m][e]] += n * N / U;
+		}
+	}
+
+	k = threads > 0 ? threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+	k = (int) MAX(MIN((uint64_t) k, nchunk), 1);
+	if ((rt = calloc(k, sizeof(*rt))) == NULL)
+		err(1, NULL);
+	for (md.base = 0; md.base < nchunk; md.base += RARE_ROUND) {
+		md.end = MIN(md.base + RARE_ROUND, nchunk);
+		atomic_store(&md.next, md.base);
+		memset(md.chunk, 0, RARE_ROUND * sizeof(*md.chunk));
+		for (j = 0; j < k; ++j) {
+			rt[j].md = &md;
+			if (pthread_create(&rt[j].tid, NULL, worker,
+			    &rt[j]) != 0)
+				err(1, "pthread_create");
+		}
+		for (j = 0; j < k; ++j)
+			pthread_join(rt[j].tid, NULL);
+		for (i = 0; i < md.end - md.base; ++i)
+			add(&r->s, &md.chunk[i]);
+	}
+	free(rt);
+	free(md.chunk);
+	free(md.mask);
+	return 0;
+}
+
+/* The 95% half-width of the mean of x whose squares sum to xx. */
+static double
+ci(double x, double xx, uint64_t n)
+{
+	double mean, var;
+
+	mean = x / n;
+	var = xx / n - mean * mean;
+	return 1.96 * sqrt(MAX(var, 0) / n);
+}
+
+void
+rare_report(FILE *fp, const struct rare_result *r)
+{
+	const struct prize_table *pt;
+	const struct tier *t;
+	const struct rare_sums *s = &r->s;
+	double p, var;
+	char match[16];
+	int i;
+
+	pt = &prizes[r->game];
+	fprintf(fp, "%s: %zu tickets, %llu draws, mean weight %.4f +- %.4f\n",
+	    games[r->game].name, r->tickets, (unsigned long long) r->draws,
+	    s->w / r->draws, ci(s->w, s->ww, r->draws));
+	fprintf(fp, "%-6s %12s %10s %12s %10s %12s %10s\n", "tier",
+	    "P(winner)", "+-", "winners", "+-", "exact", "speedup");
+	for (i = 0; i < pt->ntier; ++i) {
+		t = &pt->tier[i];
+		if (t->extra == ANY)
+			snprintf(match, sizeof(match), "%d", t->main);
+		else
+			snprintf(match, sizeof(match), "%d+%d", t->main,
+			    t->extra);
+		/* uniform draws needed for the same error, per draw here */
+		p = s->any[i] / r->draws;
+		var = s->anyany[i] / r->draws - p * p;
+		fprintf(fp, "%-6s %12.4g %10.2g %12.4g %10.2g %12.4g ", match,
+		    p, ci(s->any[i], s->anyany[i], r->draws),
+		    s->won[i] / r->draws,
+		    ci(s->won[i], s->wonwon[i], r->draws), r->exact[i]);
+		if (var > 0 && p > 0 && p < 1)
+			fprintf(fp, "%10.3g\n", p * (1 - p) / var);
+		else
+			fprintf(fp, "%10s\n", "-");
+	}
+	fprintf(fp, "liability per draw %.6g +- %.2g (jackpots at %.0f)\n",
+	    s->paid / r->draws, ci(s->paid, s->paidpaid, r->draws),
+	    pt->seed);
+}
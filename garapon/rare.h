@@ -0,0 +1,46 @@
+/* rare.h */
+
+#ifndef RARE_H
+#define RARE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "engine.h"
+#include "prize.h"
+
+#define RARE_CHUNK 1024
+#define RARE_ROUND 1024	/* chunks summed at a time */
+#define RARE_UNIFORM 0.1	/* share of the draws left unbiased */
+
+/*
+ * Weighted sums over the draws of an importance-sampled run.  x holds
+ * w * f(draw) summed and xx its square, for f the indicator of at least
+ * one winner in a tier (any), the winners of a tier (won) and the prize
+ * money owed (paid).
+ */
+struct rare_sums {
+	double w;
+	double ww;
+	double any[PRIZE_MAXTIER];
+	double anyany[PRIZE_MAXTIER];
+	double won[PRIZE_MAXTIER];
+	double wonwon[PRIZE_MAXTIER];
+	double paid;
+	double paidpaid;
+};
+
+struct rare_result {
+	int game;
+	size_t tickets;
+	uint64_t draws;
+	double exact[PRIZE_MAXTIER];	/* expected winners, by counting */
+	struct rare_sums s;
+};
+
+int rare_run(int game, const vector tickets, size_t n, uint64_t draws,
+    uint64_t seed, int threads, struct rare_result *r);
+void rare_report(FILE *fp, const struct rare_result *r);
+
+#endif /* RARE_H */
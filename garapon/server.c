@@ -0,0 +1,926 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+
+#include "server.h"
+
+#if HAVE_SYS_EPOLL_H
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "entropy.h"
+#include "session.h"
+
+/*
+ * Every client of the server plays on a fixed 80x24 screen.  Each frame
+ * is drawn from the session state into one shared back buffer and
+ * compared with the client's front buffer, the picture its terminal
+ * already shows; only the cells that differ go out as ANSI sequences.
+ * A client whose output has not drained below SERVER_HIGHWATER is
+ * simply not redrawn, so a slow reader sees frames dropped rather than
+ * queued.  Clients sitting in the menu own no session and no pool.
+ */
+
+/* colours of a cell: 0 is the terminal default, else 1 + ANSI colour */
+enum {
+	FG_DEFAULT,
+	FG_BLACK,
+	FG_RED,
+	FG_GREEN,
+	FG_YELLOW,
+	FG_BLUE,
+	FG_MAGENTA,
+	FG_CYAN,
+	FG_WHITE
+};
+
+#define CELL(ch, fg) ((uint16_t) ((unsigned char) (ch) | (fg) << 8))
+#define CELL_CH(c) ((c) & 0xff)
+#define CELL_FG(c) ((c) >> 8)
+#define BLANK CELL(' ', FG_DEFAULT)
+
+struct buf {
+	char *p;
+	size_t off;
+	size_t len;
+	size_t cap;
+};
+
+struct play {
+	struct pool pool;
+	struct session s;
+};
+
+struct client {
+	int fd;
+	uint32_t id;
+	uint32_t games;
+	struct play *play;	/* NULL in the menu */
+	struct buf out;
+	int events;		/* registered with epoll */
+	int closing;		/* close once out has drained */
+	int queued;		/* on the redraw list */
+	int cr;			/* last byte was '\r' */
+	long hpos;		/* index in the timer heap or -1 */
+	uint16_t front[SERVER_ROWS][SERVER_COLS];
+};
+
+struct server {
+	int ep;
+	int lfd;
+	int spare;		/* given up to refuse clients, out of fds */
+	uint64_t seed;
+	uint32_t next;
+	size_t nclients;
+	struct history *history;
+	struct bcast *bcast;
+	struct client **heap;
+	size_t nheap;
+	size_t heapcap;
+	struct client **redraw;
+	size_t nredraw;
+	size_t redrawcap;
+	uint16_t back[SERVER_ROWS][SERVER_COLS];
+};
+
+static const unsigned char ball_fg[7] = {
+	FG_RED, FG_YELLOW, FG_WHITE, FG_GREEN, FG_CYAN, FG_BLUE, FG_MAGENTA
+};
+
+static const unsigned char machine_fg[NGAMES][2] = {
+	{ 0, 0 }, { 0, 0 }, { 0, 0 },
+	{ FG_BLUE, FG_RED }, { FG_CYAN, FG_YELLOW }, { FG_RED, FG_YELLOW }
+};
+
+static volatile sig_atomic_t done;
+
+static void
+stop(int sig)
+{
+	(void) sig;
+	done = 1;
+}
+
+static int64_t
+now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+buf_add(struct buf *b, const char *s, size_t n)
+{
+	char *p;
+	size_t cap;
+
+	if (b->len + n > b->cap) {
+		for (cap = b->cap ? b->cap : 4096; cap < b->len + n; cap *= 2)
+			;
+		if ((p = (char *) realloc(b->p, cap)) == NULL)
+			err(1, NULL);
+		b->p = p;
+		b->cap = cap;
+	}
+	memcpy(b->p + b->len, s, n);
+	b->len += n;
+}
+
+static void
+buf_printf(struct buf *b, const char *fmt, ...)
+{
+	char tmp[64];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+	va_end(ap);
+	buf_add(b, tmp, (size_t) n);
+}
+
+/*
+ * Timer heap ordered by session due time; only clients whose session
+ * is waiting for a tick are in it.
+ */
+static int64_t
+due(const struct server *sv, size_t i)
+{
+	return sv->heap[i]->play->s.due;
+}
+
+static void
+heap_swap(struct server *sv, size_t i, size_t j)
+{
+	struct client *t;
+
+	t = sv->heap[i];
+	sv->heap[i] = sv->heap[j];
+	sv->heap[j] = t;
+	sv->heap[i]->hpos = (long) i;
+	sv->heap[j]->hpos = (long) j;
+}
+
+static void
+heap_fix(struct server *sv, size_t i)
+{
+	size_t c;
+
+	while (i > 0 && due(sv, (i - 1) / 2) > due(sv, i)) {
+		heap_swap(sv, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	while ((c = 2 * i + 1) < sv->nheap) {
+		if (c + 1 < sv->nheap && due(sv, c + 1) < due(sv, c))
+			++c;
+		if (due(sv, i) <= due(sv, c))
+			break;
+		heap_swap(sv, i, c);
+		i = c;
+	}
+}
+
+static void
+heap_remove(struct server *sv, struct client *c)
+{
+	size_t i;
+
+	if (c->hpos < 0)
+		return;
+	i = (size_t) c->hpos;
+	c->hpos = -1;
+	if (i != --sv->nheap) {
+		sv->heap[i] = sv->heap[sv->nheap];
+		sv->heap[i]->hpos = (long) i;
+		heap_fix(sv, i);
+	}
+}
+
+/* Puts c where its session's next tick says it belongs. */
+static void
+schedule(struct server *sv, struct client *c)
+{
+	if (c->play == NULL || c->play->s.due == SESSION_WAIT) {
+		heap_remove(sv, c);
+		return;
+	}
+	if (c->hpos < 0) {
+		if (sv->nheap == sv->heapcap) {
+			sv->heapcap = sv->heapcap ? sv->heapcap * 2 : 256;
+			sv->heap = (struct client **) realloc(sv->heap,
+			    sv->heapcap * sizeof(struct client *));
+			if (sv->heap == NULL)
+				err(1, NULL);
+		}
+		c->hpos = (long) sv->nheap;
+		sv->heap[sv->nheap++] = c;
+	}
+	heap_fix(sv, (size_t) c->hpos);
+}
+
+static void
+queue_redraw(struct server *sv, struct client *c)
+{
+	if (c->queued)
+		return;
+	if (sv->nredraw == sv->redrawcap) {
+		sv->redrawcap = sv->redrawcap ? sv->redrawcap * 2 : 256;
+		sv->redraw = (struct client **) realloc(sv->redraw,
+		    sv->redrawcap * sizeof(struct client *));
+		if (sv->redraw == NULL)
+			err(1, NULL);
+	}
+	c->queued = 1;
+	sv->redraw[sv->nredraw++] = c;
+}
+
+static void
+watch(struct server *sv, struct client *c, int events)
+{
+	struct epoll_event ev;
+
+	if (c->events == events)
+		return;
+	ev.events = events;
+	ev.data.ptr = c;
+	if (epoll_ctl(sv->ep, EPOLL_CTL_MOD, c->fd, &ev) == -1)
+		err(1, "epoll_ctl");
+	c->events = events;
+}
+
+/*
+ * Ends the client's game, if any, and takes it back to the menu.
+ */
+static void
+end_play(struct client *c)
+{
+	if (c->play == NULL)
+		return;
+	session_free(&c->play->s);
+	free(c->play);
+	c->play = NULL;
+}
+
+static void
+free_client(struct client *c)
+{
+	end_play(c);
+	free(c->out.p);
+	free(c);
+}
+
+static void
+drop_client(struct server *sv, struct client *c)
+{
+	heap_remove(sv, c);
+	close(c->fd);
+	c->fd = -1;
+	--sv->nclients;
+	if (!c->queued)
+		free_client(c);
+}
+
+/*
+ * Writes as much pending output as the socket takes.  Returns -1 when
+ * the client has gone and been dropped.
+ */
+static int
+flush(struct server *sv, struct client *c)
+{
+	ssize_t n;
+
+	while (c->out.off < c->out.len) {
+		n = send(c->fd, c->out.p + c->out.off,
+		    c->out.len - c->out.off, MSG_NOSIGNAL);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			drop_client(sv, c);
+			return -1;
+		}
+		c->out.off += (size_t) n;
+	}
+	if (c->out.off == c->out.len) {
+		c->out.off = c->out.len = 0;
+		if (c->closing) {
+			drop_client(sv, c);
+			return -1;
+		}
+		watch(sv, c, EPOLLIN);
+	} else
+		watch(sv, c, EPOLLIN | EPOLLOUT);
+	return 0;
+}
+
+static void
+put(struct server *sv, int y, int x, int fg, const char *s)
+{
+	for (; *s != '\0' && x < SERVER_COLS; ++s, ++x)
+		if (y >= 0 && y < SERVER_ROWS && x >= 0)
+			sv->back[y][x] = CELL(*s, fg);
+}
+
+static void
+put_mid(struct server *sv, int y, int x, int width, int fg, const char *s)
+{
+	put(sv, y, x + (width - (int) strlen(s)) / 2, fg, s);
+}
+
+static void
+put_num(struct server *sv, int y, int x, int fg, int n)
+{
+	char tmp[8];
+
+	snprintf(tmp, sizeof(tmp), "%02d", n);
+	put(sv, y, x, fg, tmp);
+}
+
+static void
+put_box(struct server *sv, int y, int x, int h, int w)
+{
+	int i;
+
+	for (i = 1; i < w - 1; ++i) {
+		sv->back[y][x + i] = CELL('-', FG_DEFAULT);
+		sv->back[y + h - 1][x + i] = CELL('-', FG_DEFAULT);
+	}
+	for (i = 1; i < h - 1; ++i) {
+		sv->back[y + i][x] = CELL('|', FG_DEFAULT);
+		sv->back[y + i][x + w - 1] = CELL('|', FG_DEFAULT);
+	}
+	sv->back[y][x] = sv->back[y][x + w - 1] = CELL('+', FG_DEFAULT);
+	sv->back[y + h - 1][x] = CELL('+', FG_DEFAULT);
+	sv->back[y + h - 1][x + w - 1] = CELL('+', FG_DEFAULT);
+}
+
+static int
+colorful(int n)
+{
+	return n == 0 ? FG_BLACK : ball_fg[n % 7];
+}
+
+static int
+machine_color(const struct session *s, int m, int n)
+{
+	int fg;
+
+	fg = machine_fg[s->game][m];
+	if (fg == 0)
+		return colorful(n);
+	return n == 0 ? FG_BLACK : fg;
+}
+
+static void
+put_machine(struct server *sv, const struct session *s, int m, int y,
+    int x, int newline)
+{
+	const GARAPON *g;
+	size_t i;
+
+	g = &s->machine[m];
+	for (i = 0; i < g->size; ++i)
+		put_num(sv, y + 1 + (int) i / newline,
+		    x + 2 + 3 * ((int) i % newline),
+		    machine_color(s, m, g->v[i]), g->v[i]);
+}
+
+/* character k of the zzz... after sleep frame zzz */
+static int
+zchar(int zzz, int k)
+{
+	int cycle;
+
+	cycle = zzz / 6;
+	if (k > zzz % 6) {
+		if (cycle == 0)
+			return ' ';
+		--cycle;
+	}
+	if (cycle % 2 != 0)
+		return ' ';
+	return k < 3 ? 'z' : '.';
+}
+
+static void
+put_results(struct server *sv, const struct session *s)
+{
+	const struct game *g;
+	int i, w, x;
+
+	g = &games[s->game];
+	if (g->style == STYLE_JA) {
+		x = (SERVER_COLS - 24) / 2;
+		put_mid(sv, 4, x, 24, FG_WHITE, "winning numbers");
+		put_mid(sv, 8, x, 24, FG_WHITE, "omake");
+		x += (24 - g->sample * 3 + 1) / 2;
+		for (i = 0; i < g->sample; ++i)
+			put_num(sv, 6, x + 3 * i, colorful(s->main[i]),
+			    s->main[i]);
+		x = (SERVER_COLS - 24) / 2 + (24 - g->omake * 3 + 1) / 2;
+		for (i = 0; i < g->omake; ++i)
+			put_num(sv, 10, x + 3 * i, colorful(s->bonus[i]),
+			    s->bonus[i]);
+		return;
+	}
+	w = g->style == STYLE_US ? 21 : 24;
+	x = (SERVER_COLS - w) / 2;
+	put_mid(sv, 4, x, w, FG_WHITE, "winning numbers");
+	for (i = 0; i < g->sample; ++i)
+		put_num(sv, 6, x + 2 + 3 * i, machine_fg[s->game][0],
+		    s->main[i]);
+	for (i = 0; i < g->xsample; ++i)
+		put_num(sv, 6, x + 2 + 3 * (g->sample + i),
+		    machine_fg[s->game][1], s->bonus[g->omake + i]);
+}
+
+/*
+ * Draws the whole screen of a client into the back buffer.  The layout
+ * follows the curses windows of the standalone game.
+ */
+static void
+paint(struct server *sv, const struct client *c)
+{
+	const struct session *s;
+	const struct game *g;
+	char item[32];
+	int bottom, i, m, x, y;
+
+	bottom = SERVER_ROWS - 2;
+	for (y = 0; y < SERVER_ROWS; ++y)
+		for (x = 0; x < SERVER_COLS; ++x)
+			sv->back[y][x] = BLANK;
+
+	if (c->play == NULL) {
+		put_mid(sv, 0, 0, SERVER_COLS, FG_DEFAULT, "garapon");
+		for (i = 0; i < NGAMES; ++i) {
+			snprintf(item, sizeof(item), "%d  %s", i + 1,
+			    games[i].name);
+			put(sv, 3 + i, 2, FG_DEFAULT, item);
+		}
+		put_mid(sv, bottom, 0, SERVER_COLS, FG_DEFAULT,
+		    "'1'-'6' to play, 'q' to exit");
+		return;
+	}
+
+	s = &c->play->s;
+	g = &games[s->game];
+	put_mid(sv, 0, 0, SERVER_COLS, FG_DEFAULT, g->name);
+	if (s->state >= S_RESULTS) {
+		put_results(sv, s);
+		put_mid(sv, bottom, 0, SERVER_COLS, FG_DEFAULT,
+		    "'r' to retry, 'q' to exit");
+		return;
+	}
+
+	if (g->style == STYLE_JA) {
+		x = (SERVER_COLS - 24) / 2;
+		put_box(sv, 3, x, 12, 24);
+		put_box(sv, 15, x, 3, 24);
+		put_box(sv, 18, x, 3, 24);
+		put_machine(sv, s, 0, 3, x, 7);
+		for (i = 0; i < s->ball; ++i) {
+			if (i < g->sample)
+				put_num(sv, 16, x + 2 + 3 * i,
+				    colorful(s->tray[i]), s->tray[i]);
+			else
+				put_num(sv, 19, x + 2 + 3 * (i - g->sample),
+				    colorful(s->tray[i]), s->tray[i]);
+		}
+	} else {
+		put_box(sv, 3, SERVER_COLS / 2 - 31, 14, 30);
+		put_machine(sv, s, 0, 3, SERVER_COLS / 2 - 31, 9);
+		if (g->style == STYLE_US) {
+			put_box(sv, 3, SERVER_COLS / 2 + 1, 14, 30);
+			put_machine(sv, s, 1, 3, SERVER_COLS / 2 + 1, 9);
+			x = (SERVER_COLS - 21) / 2;
+			put_box(sv, 18, x, 3, 21);
+		} else {
+			put_box(sv, 5, SERVER_COLS / 2 + 1, 11, 21);
+			put_machine(sv, s, 1, 5, SERVER_COLS / 2 + 1, 6);
+			x = (SERVER_COLS - 24) / 2;
+			put_box(sv, 18, x, 3, 24);
+		}
+		for (i = 0; i < s->ball; ++i) {
+			m = session_source(s, i);
+			put_num(sv, 19, x + 2 + 3 * i, machine_fg[s->game][m],
+			    s->tray[i]);
+		}
+	}
+
+	if (s->state == S_SLEEPING) {
+		x = (SERVER_COLS - 18) / 2;
+		if (s->zzz >= -1)
+			put(sv, bottom, x, FG_DEFAULT, "nowsleeping");
+		for (i = 0; i < 6 && s->zzz >= 0; ++i)
+			sv->back[bottom][x + 12 + i] =
+			    CELL(zchar(s->zzz, i), FG_DEFAULT);
+	} else if (s->state != S_DRAWN || g->style != STYLE_JA)
+		put_mid(sv, bottom, 0, SERVER_COLS, FG_DEFAULT,
+		    "Press <Enter> key");
+}
+
+/* Appends the escapes that turn the client's front into back. */
+static void
+diff(struct server *sv, struct client *c)
+{
+	int cy, cx, fg, x, y;
+	uint16_t b;
+	char ch;
+
+	cy = cx = -1;
+	fg = -1;
+	for (y = 0; y < SERVER_ROWS; ++y) {
+		for (x = 0; x < SERVER_COLS; ++x) {
+			b = sv->back[y][x];
+			if (b == c->front[y][x])
+				continue;
+			if (y != cy || x != cx)
+				buf_printf(&c->out, "\033[%d;%dH", y + 1, x + 1);
+			if (CELL_FG(b) != fg) {
+				fg = CELL_FG(b);
+				if (fg == FG_DEFAULT)
+					buf_add(&c->out, "\033[0m", 4);
+				else
+					buf_printf(&c->out, "\033[0;3%dm",
+					    fg - FG_BLACK);
+			}
+			ch = (char) CELL_CH(b);
+			buf_add(&c->out, &ch, 1);
+			c->front[y][x] = b;
+			cy = y;
+			cx = x + 1;
+		}
+	}
+	if (fg > FG_DEFAULT)
+		buf_add(&c->out, "\033[0m", 4);
+}
+
+static void
+redraw(struct server *sv)
+{
+	struct client *c;
+	size_t i, n;
+
+	n = 0;
+	for (i = 0; i < sv->nredraw; ++i) {
+		c = sv->redraw[i];
+		if (c->fd == -1) {
+			free_client(c);
+			continue;
+		}
+		if (c->closing) {
+			c->queued = 0;
+			continue;
+		}
+		if (c->out.len - c->out.off > SERVER_HIGHWATER) {
+			/* try again once the client has drained */
+			sv->redraw[n++] = c;
+			continue;
+		}
+		c->queued = 0;
+		paint(sv, c);
+		diff(sv, c);
+		flush(sv, c);
+	}
+	sv->nredraw = n;
+}
+
+static void
+record(struct server *sv, const struct session *s)
+{
+	const struct game *g;
+
+	g = &games[s->game];
+	if (sv->history != NULL && hist_append(sv->history, s->game,
+	    (vector) s->main, (vector) s->bonus, (int64_t) time(NULL)))
+		warn("history");
+	if (sv->bcast != NULL && bcast_publish(sv->bcast, s->game, s->main,
+	    g->sample, s->bonus, GAME_BONUS(g)))
+		warn("broadcast");
+}
+
+static void
+goodbye(struct server *sv, struct client *c)
+{
+	end_play(c);
+	heap_remove(sv, c);
+	buf_add(&c->out, "\033[0m\033[2J\033[H\033[?25h", 17);
+	c->closing = 1;
+	flush(sv, c);
+}
+
+/*
+ * Feeds one event to the client's session and deals with whatever
+ * state it ends up in.  Returns -1 when the client is gone.
+ */
+static int
+step(struct server *sv, struct client *c, int ev, int64_t now)
+{
+	struct session *s;
+
+	s = &c->play->s;
+	session_step(s, ev, now);
+	if (s->dirty & D_RESULT)
+		record(sv, s);
+	if (s->dirty != 0) {
+		s->dirty = 0;
+		queue_redraw(sv, c);
+	}
+	switch (s->state) {
+	case S_QUIT:
+		goodbye(sv, c);
+		return -1;
+	case S_RETRY:
+		end_play(c);
+		heap_remove(sv, c);
+		queue_redraw(sv, c);
+		break;
+	default:
+		schedule(sv, c);
+		break;
+	}
+	return 0;
+}
+
+static void
+start_game(struct server *sv, struct client *c, int game)
+{
+	if ((c->play = (struct play *) malloc(sizeof(*c->play))) == NULL)
+		err(1, NULL);
+	pool_seed(&c->play->pool, sv->seed,
+	    (uint64_t) c->id << 32 | c->games++);
+	session_init(&c->play->s, game, &c->play->pool);
+	c->play->s.dirty = 0;
+	queue_redraw(sv, c);
+}
+
+static void
+input(struct server *sv, struct client *c)
+{
+	char in[256];
+	ssize_t n, i;
+	int ch, ev;
+
+	for (;;) {
+		if ((n = read(c->fd, in, sizeof(in))) == 0) {
+			drop_client(sv, c);
+			return;
+		}
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				drop_client(sv, c);
+			return;
+		}
+		for (i = 0; i < n && !c->closing; ++i) {
+			ch = (unsigned char) in[i];
+			if (ch == '\n' && c->cr) {
+				c->cr = 0;
+				continue;
+			}
+			c->cr = ch == '\r';
+			if (ch == 'q' || ch == 3) {
+				if (c->play == NULL) {
+					goodbye(sv, c);
+					return;
+				}
+				ev = E_QUIT;
+			} else if (c->play == NULL) {
+				if (ch >= '1' && ch < '1' + NGAMES)
+					start_game(sv, c, ch - '1');
+				continue;
+			} else if (ch == '\r' || ch == '\n')
+				ev = E_ENTER;
+			else if (ch == 'r')
+				ev = E_RETRY;
+			else
+				continue;
+			if (step(sv, c, ev, now_ms()) == -1)
+				return;
+		}
+		if (c->closing)
+			return;
+	}
+}
+
+/*
+ * Out of descriptors, a pending client would keep the listener readable
+ * and the loop spinning, so the spare descriptor is given up to accept
+ * the client and hang up on it at once.
+ */
+static int
+refuse(struct server *sv)
+{
+	int fd, saved;
+
+	if (sv->spare == -1)
+		return -1;
+	close(sv->spare);
+	if ((fd = accept(sv->lfd, NULL, NULL)) != -1)
+		close(fd);
+	saved = errno;
+	sv->spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	errno = saved;
+	return fd;
+}
+
+static void
+accept_clients(struct server *sv)
+{
+	struct epoll_event ev;
+	struct client *c;
+	int fd, full, y, x;
+
+	if (sv->spare == -1)
+		sv->spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	for (full = 0;;) {
+		fd = accept4(sv->lfd, NULL, NULL,
+		    SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if ((errno == EMFILE || errno == ENFILE) &&
+			    refuse(sv) != -1) {
+				if (!full++)
+					warnx("out of descriptors, "
+					    "refusing clients");
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				warn("accept");
+			return;
+		}
+		if ((c = (struct client *) calloc(1, sizeof(*c))) == NULL)
+			err(1, NULL);
+		c->fd = fd;
+		c->id = sv->next++;
+		c->hpos = -1;
+		c->events = EPOLLIN;
+		for (y = 0; y < SERVER_ROWS; ++y)
+			for (x = 0; x < SERVER_COLS; ++x)
+				c->front[y][x] = BLANK;
+		ev.events = EPOLLIN;
+		ev.data.ptr = c;
+		if (epoll_ctl(sv->ep, EPOLL_CTL_ADD, fd, &ev) == -1)
+			err(1, "epoll_ctl");
+		++sv->nclients;
+		buf_add(&c->out, "\033[0m\033[2J\033[?25l", 14);
+		queue_redraw(sv, c);
+	}
+}
+
+static int
+listen_on(const char *path)
+{
+	struct sockaddr_un sun;
+	struct stat st;
+	int fd;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun.sun_path))
+		errx(1, "%s: socket path too long", path);
+	strcpy(sun.sun_path, path);
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		err(1, "socket");
+	if (bind(fd, (struct sockaddr *) &sun, sizeof(sun)) == -1)
+		err(1, "%s", path);
+	if (listen(fd, SERVER_BACKLOG) == -1)
+		err(1, "%s", path);
+	return fd;
+}
+
+/*
+ * Serves games to every client that connects to the UNIX socket at
+ * path until SIGINT or SIGTERM.  Client n plays its games on streams
+ * n << 32, n << 32 | 1, ... of seed.  Results go to h and b when given.
+ */
+void
+server_run(const char *path, uint64_t seed, struct history *h,
+    struct bcast *b)
+{
+	struct epoll_event ev[SERVER_EVENTS];
+	struct server sv;
+	struct client *c;
+	struct rlimit rl;
+	int64_t now;
+	int i, n, timeout;
+
+	memset(&sv, 0, sizeof(sv));
+	sv.seed = seed;
+	sv.history = h;
+	sv.bcast = b;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	sv.lfd = listen_on(path);
+	if ((sv.spare = open("/dev/null", O_RDONLY | O_CLOEXEC)) == -1)
+		err(1, "/dev/null");
+	if ((sv.ep = epoll_create1(EPOLL_CLOEXEC)) == -1)
+		err(1, "epoll_create1");
+	ev[0].events = EPOLLIN;
+	ev[0].data.ptr = NULL;
+	if (epoll_ctl(sv.ep, EPOLL_CTL_ADD, sv.lfd, &ev[0]) == -1)
+		err(1, "epoll_ctl");
+
+	while (!done) {
+		now = now_ms();
+		while (sv.nheap > 0 && due(&sv, 0) <= now)
+			step(&sv, sv.heap[0], E_TICK, now);
+		redraw(&sv);
+
+		if (sv.nheap == 0)
+			timeout = -1;
+		else
+			timeout = (int) MAX(due(&sv, 0) - now_ms(), 0);
+		if ((n = epoll_wait(sv.ep, ev, SERVER_EVENTS, timeout)) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(1, "epoll_wait");
+		}
+		for (i = 0; i < n; ++i) {
+			if ((c = (struct client *) ev[i].data.ptr) == NULL) {
+				accept_clients(&sv);
+				continue;
+			}
+			if (c->fd == -1)
+				continue;
+			if (ev[i].events & (EPOLLERR | EPOLLHUP)) {
+				drop_client(&sv, c);
+				continue;
+			}
+			if ((ev[i].events & EPOLLOUT) && flush(&sv, c) == -1)
+				continue;
+			if (ev[i].events & EPOLLIN)
+				input(&sv, c);
+		}
+	}
+
+	close(sv.lfd);
+	unlink(path);
+	close(sv.ep);
+	if (sv.spare != -1)
+		close(sv.spare);
+}
+
+#else /* HAVE_SYS_EPOLL_H */
+
+void
+server_run(const char *path, uint64_t seed, struct history *h,
+    struct bcast *b)
+{
+	(void) seed;
+	(void) h;
+	(void) b;
+	errx(1, "%s: server mode needs epoll", path);
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
@@ -0,0 +1,20 @@
+/* server.h */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#include "bcast.h"
+#include "history.h"
+
+#define SERVER_ROWS 24
+#define SERVER_COLS 80
+#define SERVER_BACKLOG 512
+#define SERVER_EVENTS 256
+#define SERVER_HIGHWATER 16384
+
+void server_run(const char *path, uint64_t seed, struct history *h,
+    struct bcast *b);
+
+#endif /* SERVER_H */
@@ -0,0 +1,310 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "session.h"
+#include "sort.h"
+
+/*
+ * One game as a state machine.  Nothing in here blocks, sleeps or
+ * touches the terminal: the caller feeds key events and ticks, each
+ * carrying the current time in milliseconds, and draws whatever the
+ * dirty bits say has changed.  A tick before s->due is ignored, so the
+ * caller may tick as often as it likes.  Since the machines live inside
+ * the session, a session must not be copied once initialised.
+ *
+ * By default a spin shuffles the machine and the ball is picked at
+ * random.  After session_drums() each machine is a drum of balls
+ * instead, stepped at DRUM_HZ while it turns; Enter, or the end of the
+ * spin, opens its exit, and the ball drawn is the one that falls out.
+ */
+
+#define SLEEP_BLANK_MS 1000
+#define SLEEP_TEXT_MS 500
+#define SLEEP_Z_MS 150
+
+static void
+setup(GARAPON *m, vector slot, size_t size, int number, int sample,
+    int omake)
+{
+	int i;
+
+	m->v = slot;
+	m->color = 0;
+	m->size = size;
+	m->number = number;
+	m->sample = sample;
+	m->omake = omake;
+	for (i = 0; i < number; ++i)
+		slot[i] = i + 1;
+}
+
+void
+session_init(struct session *s, int game, struct pool *p)
+{
+	const struct game *g;
+
+	g = &games[game];
+	memset(s, 0, sizeof(*s));
+	s->game = game;
+	s->state = S_IDLE;
+	s->nball = g->sample + g->omake + g->xsample;
+	s->due = SESSION_WAIT;
+	s->pool = p;
+	s->nmachine = g->xsample > 0 ? 2 : 1;
+	setup(&s->machine[0], s->slot[0], g->size, g->number, g->sample,
+	    g->omake);
+	if (s->nmachine == 2)
+		setup(&s->machine[1], s->slot[1], g->xsize, g->xnumber,
+		    g->xsample, 0);
+	s->dirty = D_START | D_MACHINE | D_PROMPT;
+}
+
+/*
+ * Puts the balls of each machine into a drum.  Returns -1 when out of
+ * memory.
+ */
+int
+session_drums(struct session *s)
+{
+	int label[GAME_MAXNUMBER];
+	GARAPON *m;
+	int i, k, n;
+
+	for (k = 0; k < s->nmachine; ++k) {
+		m = &s->machine[k];
+		for (n = 0, i = 0; i < (int) m->size; ++i)
+			if (m->v[i] != 0)
+				label[n++] = m->v[i];
+		if ((s->drum[k] = drum_new(label, n, s->pool)) == NULL)
+			return -1;
+	}
+	return 0;
+}
+
+void
+session_free(struct session *s)
+{
+	int k;
+
+	for (k = 0; k < 2; ++k) {
+		drum_free(s->drum[k]);
+		s->drum[k] = NULL;
+	}
+}
+
+/*
+ * The machine the given ball comes out of: omake numbers come from the
+ * main machine, the rest from the second one.
+ */
+int
+session_source(const struct session *s, int ball)
+{
+	const struct game *g;
+
+	g = &games[s->game];
+	return ball < g->sample + g->omake ? 0 : 1;
+}
+
+int
+session_turning(const struct session *s, int m)
+{
+	if (s->state != S_SPINNING || m >= s->nmachine)
+		return 0;
+	switch (games[s->game].style) {
+	case STYLE_US:
+		return 1;
+	case STYLE_EU:
+		return m == session_source(s, s->ball);
+	default:
+		return m == 0;
+	}
+}
+
+static void
+spin(struct session *s, int64_t now)
+{
+	s->state = S_SPINNING;
+	s->spins = DAINOBONNOU;
+	s->due = s->t0 = now;
+	s->frame = 0;
+	s->dirty |= D_PROMPT;
+}
+
+/*
+ * Takes ball b out of its machine, or a random one when b is 0.
+ */
+static void
+drop(struct session *s, int b, int64_t now)
+{
+	GARAPON *m;
+	size_t ts;
+
+	m = &s->machine[session_source(s, s->ball)];
+	if (b == 0) {
+		do {
+			ts = pool_bounded(s->pool, m->size);
+		} while (m->v[ts] == 0);
+	} else
+		for (ts = 0; m->v[ts] != b; ++ts)
+			;
+	s->tray[s->ball++] = m->v[ts];
+	m->v[ts] = 0;
+	s->state = S_DRAWN;
+	s->due = now;
+	s->dirty |= D_BALL | D_MACHINE;
+}
+
+/*
+ * A spin of the drums: Enter or the last turn opens the exit of the
+ * drum the ball comes from, and the spin ends when a ball falls out.
+ */
+static void
+tumble(struct session *s, int ev, int64_t now)
+{
+	struct drum *d;
+	int b, m;
+
+	d = s->drum[session_source(s, s->ball)];
+	if (ev == E_ENTER || (ev == E_TICK && s->spins == 0)) {
+		drum_open(d);
+		s->spins = 0;
+	}
+	if (ev != E_TICK)
+		return;
+	for (m = 0; m < s->nmachine; ++m)
+		if (session_turning(s, m))
+			drum_step(s->drum[m]);
+	if (s->spins > 0)
+		--s->spins;
+	if ((b = drum_take(d)) != 0) {
+		drop(s, b, now);
+		return;
+	}
+	s->due = s->t0 + ++s->frame * 1000 / DRUM_HZ;
+	s->dirty |= D_MACHINE;
+}
+
+static void
+results(struct session *s)
+{
+	const struct game *g;
+
+	g = &games[s->game];
+	distsort(g->sample, s->tray, s->main);
+	distsort(g->omake, s->tray + g->sample, s->bonus);
+	distsort(g->xsample, s->tray + g->sample + g->omake,
+	    s->bonus + g->omake);
+	s->state = S_RESULTS;
+	s->due = SESSION_WAIT;
+	s->dirty |= D_RESULT;
+}
+
+void
+session_step(struct session *s, int ev, int64_t now)
+{
+	int m;
+
+	if (ev == E_QUIT) {
+		s->state = S_QUIT;
+		s->due = SESSION_WAIT;
+		return;
+	}
+	if (ev == E_TICK && (s->due == SESSION_WAIT || now < s->due))
+		return;
+
+	switch (s->state) {
+	case S_IDLE:
+		if (ev == E_ENTER)
+			spin(s, now);
+		break;
+	case S_SPINNING:
+		if (s->drum[0] != NULL) {
+			tumble(s, ev, now);
+		} else if (ev == E_ENTER || (ev == E_TICK && s->spins == 0)) {
+			drop(s, 0, now);
+		} else if (ev == E_TICK) {
+			for (m = 0; m < s->nmachine; ++m)
+				if (session_turning(s, m))
+					pool_shuffle(s->pool, s->machine[m].v,
+					    s->machine[m].size);
+			--s->spins;
+			s->due = now + SESSION_SPIN_MS;
+			s->dirty |= D_MACHINE;
+		}
+		break;
+	case S_DRAWN:
+		if (ev == E_ENTER && s->ball < s->nball) {
+			/* an Enter typed ahead stops the next spin at once */
+			spin(s, now);
+			if (s->drum[0] != NULL)
+				tumble(s, ev, now);
+			else
+				drop(s, 0, now);
+		} else if (ev != E_TICK) {
+			break;
+		} else if (s->ball < s->nball) {
+			spin(s, now);
+		} else {
+			s->state = S_SLEEPING;
+			s->zzz = -2;
+			s->due = now + SLEEP_BLANK_MS;
+			s->dirty |= D_SLEEP;
+		}
+		break;
+	case S_SLEEPING:
+		if (ev != E_TICK)
+			break;
+		if (++s->zzz == SESSION_ZZZ) {
+			results(s);
+		} else {
+			s->due = now + (s->zzz < 0 ? SLEEP_TEXT_MS : SLEEP_Z_MS);
+			s->dirty |= D_SLEEP;
+		}
+		break;
+	case S_RESULTS:
+		if (ev == E_RETRY)
+			s->state = S_RETRY;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Plays the rest of the game at once: every spin is cut short and the
+ * clock jumps straight to each due tick.
+ */
+void
+session_forward(struct session *s)
+{
+	int64_t now;
+
+	now = 0;
+	while (s->state < S_RESULTS) {
+		if (s->due != SESSION_WAIT && s->due > now)
+			now = s->due;
+		session_step(s, s->state == S_IDLE ||
+		    (s->state == S_SPINNING && s->spins > 0) ?
+		    E_ENTER : E_TICK, now);
+	}
+}
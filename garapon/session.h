@@ -0,0 +1,73 @@
+/* session.h */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+
+#include "drum.h"
+#include "engine.h"
+#include "entropy.h"
+#include "garapon.h"
+
+#define SESSION_WAIT (-1)
+#define SESSION_SPIN_MS 30
+#define SESSION_ZZZ 30
+
+/* states */
+enum {
+	S_IDLE,		/* waiting for the first Enter */
+	S_SPINNING,	/* machines turning until Enter or DAINOBONNOU turns */
+	S_DRAWN,	/* a ball has just come out */
+	S_SLEEPING,	/* nowsleeping zzz... */
+	S_RESULTS,	/* winning numbers shown */
+	S_RETRY,	/* finished, back to the menu */
+	S_QUIT		/* finished, leave the program */
+};
+
+/* events */
+enum {
+	E_TICK,
+	E_ENTER,
+	E_RETRY,
+	E_QUIT
+};
+
+/* what changed since the renderer last looked */
+#define D_START		0x01
+#define D_MACHINE	0x02
+#define D_PROMPT	0x04
+#define D_BALL		0x08
+#define D_SLEEP		0x10
+#define D_RESULT	0x20
+
+struct session {
+	int game;
+	int state;
+	int ball;		/* balls drawn so far */
+	int nball;
+	int spins;		/* turns left before the ball drops */
+	long frame;		/* drum frames since t0 */
+	int64_t t0;
+	int zzz;		/* sleep frame, negative before the first z */
+	int64_t due;		/* ms of the next tick, or SESSION_WAIT */
+	unsigned int dirty;
+	struct pool *pool;
+	int nmachine;
+	GARAPON machine[2];
+	struct drum *drum[2];	/* NULL while the machines only shuffle */
+	int slot[2][GAME_MAXNUMBER];
+	int tray[GAME_MAXPICK + GAME_MAXBONUS];
+	int main[GAME_MAXPICK];
+	int bonus[GAME_MAXBONUS];
+};
+
+void session_init(struct session *s, int game, struct pool *p);
+int session_drums(struct session *s);
+void session_free(struct session *s);
+void session_step(struct session *s, int ev, int64_t now);
+int session_turning(const struct session *s, int m);
+int session_source(const struct session *s, int ball);
+void session_forward(struct session *s);
+
+#endif /* SESSION_H */
@@ -0,0 +1,119 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "settle.h"
+#include "ticket.h"
+
+/*
+ * Settlement by ticket scan: every ticket is matched against the draw
+ * and counted in its prize tier.  The stage argument is a struct settle
+ * holding the draw; each thread counts into a copy of it.
+ */
+
+void
+settle_add(struct settle *s, const vector tickets, size_t n)
+{
+	const struct game *g;
+	const int *t;
+	size_t i;
+	int m, e, tier, w;
+
+	g = &games[s->game];
+	w = TK_WIDTH(g);
+	for (i = 0, t = tickets; i < n; ++i, t += w) {
+		count_matches(g, (vector) t, s->main, s->bonus, &m, &e);
+		if ((tier = prize_tier(s->game, m, e)) >= 0)
+			++s->winners[tier];
+	}
+	s->tickets += n;
+}
+
+void
+settle_report(FILE *fp, const struct settle *s)
+{
+	const struct prize_table *pt;
+	const struct tier *t;
+	char match[16];
+	int i;
+
+	pt = &prizes[s->game];
+	fprintf(fp, "%-8s %13s %13s\n", "tier", "prize", "winners");
+	for (i = 0; i < pt->ntier; ++i) {
+		t = &pt->tier[i];
+		if (t->extra == ANY)
+			snprintf(match, sizeof(match), "%d", t->main);
+		else
+			snprintf(match, sizeof(match), "%d+%d", t->main,
+			    t->extra);
+		if (t->prize == PRIZE_JACKPOT)
+			fprintf(fp, "%-8s %13s", match, "jackpot");
+		else
+			fprintf(fp, "%-8s %13.0f", match, t->prize);
+		fprintf(fp, " %13llu\n", (unsigned long long) s->winners[i]);
+	}
+	fprintf(fp, "%-8s %13s %13llu\n", "tickets", "",
+	    (unsigned long long) s->tickets);
+}
+
+static void *
+stage_open(int game, void *arg)
+{
+	struct settle *s;
+
+	(void) game;
+	if ((s = (struct settle *) malloc(sizeof(*s))) == NULL)
+		err(1, NULL);
+	memcpy(s, arg, sizeof(*s));
+	memset(s->winners, 0, sizeof(s->winners));
+	s->tickets = 0;
+	return s;
+}
+
+static void
+stage_feed(void *st, const vector tickets, size_t n)
+{
+	settle_add(st, tickets, n);
+}
+
+static void
+stage_merge(void *into, void *from)
+{
+	struct settle *a = into, *b = from;
+	int i;
+
+	for (i = 0; i < PRIZE_MAXTIER; ++i)
+		a->winners[i] += b->winners[i];
+	a->tickets += b->tickets;
+}
+
+static void
+stage_close(void *st)
+{
+	free(st);
+}
+
+const struct stage settle_stage = {
+	"settlement", stage_open, stage_feed, stage_merge, stage_close, NULL
+};
@@ -0,0 +1,26 @@
+/* settle.h */
+
+#ifndef SETTLE_H
+#define SETTLE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "engine.h"
+#include "ingest.h"
+#include "prize.h"
+
+struct settle {
+	int game;
+	int main[GAME_MAXPICK];
+	int bonus[GAME_MAXBONUS];
+	uint64_t tickets;
+	uint64_t winners[PRIZE_MAXTIER];
+};
+
+extern const struct stage settle_stage;
+
+void settle_add(struct settle *s, const vector tickets, size_t n);
+void settle_report(FILE *fp, const struct settle *s);
+
+#endif /* SETTLE_H */
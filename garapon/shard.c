@@ -0,0 +1,212 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "shard.h"
+
+/*
+ * A simulation split into shards, each a contiguous range of scenarios
+ * (and so of random streams) run by a process of its own.  The
+ * processes form a binary tree: shard i forks shards 2i+1 and 2i+2,
+ * runs its own range, and passes its results up followed by everything
+ * its subtree sent it, so each pipe carries the reduction of a subtree
+ * and the coordinator reads from shard 0 alone.  Pipes stand in for
+ * whatever links the nodes would have.
+ *
+ * On the wire the results of a range travel as one block: a header of
+ * the first scenario and the count, then the records.  Since scenario i
+ * runs on stream i wherever it runs, the merged results are the same as
+ * those of sim_run().
+ */
+
+struct block {
+	uint32_t first;
+	uint32_t count;
+};
+
+static int
+readall(int fd, void *buf, size_t len)
+{
+	unsigned char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = read(fd, p, len)) == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return n == 0 && p == buf ? 0 : -1;
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int
+writeall(int fd, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static pid_t
+spawn(const struct sim_params *sp, int shards, int i, int *fd,
+    const int *other, int nother);
+
+/*
+ * The body of shard i, writing to fd.  Never returns.
+ */
+static void
+shard(const struct sim_params *sp, int shards, int i, int out)
+{
+	struct sim_result *r;
+	struct block b;
+	unsigned char buf[65536];
+	pid_t pid[2];
+	int c, fd[2], n, st, fail;
+
+	/* each child closes our output and the pipe of the one before */
+	fd[0] = fd[1] = out;
+	for (c = 0; c < 2; ++c)
+		pid[c] = 2 * i + 1 + c < shards ?
+		    spawn(sp, shards, 2 * i + 1 + c, &fd[c], fd, c + 1) : -1;
+
+	b.first = (int64_t) sp->scenarios * i / shards;
+	b.count = (int64_t) sp->scenarios * (i + 1) / shards - b.first;
+	r = sim_range(sp, b.first, b.first + b.count);
+	if (writeall(out, &b, sizeof(b)) == -1 ||
+	    writeall(out, r, b.count * sizeof(*r)) == -1)
+		err(1, "shard %d", i);
+	free(r);
+
+	fail = 0;
+	for (c = 0; c < 2; ++c) {
+		if (pid[c] == -1)
+			continue;
+		while ((n = read(fd[c], buf, sizeof(buf))) != 0) {
+			if (n == -1 && errno == EINTR)
+				continue;
+			if (n == -1 || writeall(out, buf, n) == -1)
+				err(1, "shard %d", i);
+		}
+		close(fd[c]);
+		if (waitpid(pid[c], &st, 0) == -1 || !WIFEXITED(st) ||
+		    WEXITSTATUS(st) != 0)
+			fail = 1;
+	}
+	_exit(fail);
+}
+
+/*
+ * Forks shard i with its output on a new pipe whose read end is
+ * returned in *fd.  The child closes the other descriptors its parent
+ * holds, so each pipe ends when the shard writing to it exits.
+ */
+static pid_t
+spawn(const struct sim_params *sp, int shards, int i, int *fd,
+    const int *other, int nother)
+{
+	pid_t pid;
+	int j, p[2];
+
+	if (pipe(p) == -1)
+		err(1, "pipe");
+	switch (pid = fork()) {
+	case -1:
+		err(1, "fork");
+	case 0:
+		close(p[0]);
+		for (j = 0; j < nother; ++j)
+			close(other[j]);
+		shard(sp, shards, i, p[1]);
+	}
+	close(p[1]);
+	*fd = p[0];
+	return pid;
+}
+
+/*
+ * Runs sp->scenarios scenarios in the given number of processes, each
+ * with sp->threads threads (all online CPUs shared out when 0).
+ */
+struct sim_result *
+shard_run(const struct sim_params *sp, int shards)
+{
+	struct sim_params p;
+	struct sim_result *r;
+	struct block b;
+	unsigned char *seen;
+	pid_t pid;
+	long ncpu;
+	int fd, got, n, st;
+
+	p = *sp;
+	p.checkpoint = NULL;
+	shards = MIN(shards, p.scenarios);
+	if (p.threads == 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		p.threads = MAX(ncpu / shards, 1);
+	}
+	if ((r = calloc(p.scenarios, sizeof(*r))) == NULL ||
+	    (seen = calloc(p.scenarios, 1)) == NULL)
+		err(1, NULL);
+
+	fflush(NULL);
+	pid = spawn(&p, shards, 0, &fd, NULL, 0);
+	for (got = 0; (n = readall(fd, &b, sizeof(b))) == 1; got += b.count) {
+		if (b.first > (uint32_t) p.scenarios ||
+		    b.count > p.scenarios - b.first ||
+		    memchr(seen + b.first, 1, b.count) != NULL)
+			errx(1, "shards: bad block");
+		if (readall(fd, r + b.first, b.count * sizeof(*r)) != 1)
+			errx(1, "shards: short block");
+		memset(seen + b.first, 1, b.count);
+	}
+	if (n == -1)
+		errx(1, "shards: short read");
+	close(fd);
+	if (waitpid(pid, &st, 0) == -1 || !WIFEXITED(st) ||
+	    WEXITSTATUS(st) != 0 || got != p.scenarios)
+		errx(1, "shards: a shard failed");
+	free(seen);
+	return r;
+}
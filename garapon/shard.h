@@ -0,0 +1,12 @@
+/* shard.h */
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "sim.h"
+
+#define SHARD_MAX 256
+
+struct sim_result *shard_run(const struct sim_params *sp, int shards);
+
+#endif /* SHARD_H */
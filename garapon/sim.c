@@ -0,0 +1,661 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ckpt.h"
+#include "engine.h"
+#include "entropy.h"
+#include "prize.h"
+#include "rank.h"
+#include "sim.h"
+
+/*
+ * Jackpot scenarios.  Every scenario runs years of draws of one game
+ * on its own random stream.  Players are a mix of quick picks, birthday
+ * tickets (main numbers all from 1 to SIM_BIRTHDAY) and pattern tickets
+ * (arithmetic progressions such as 1-2-3-4-5 or a column of the slip).
+ * Given the drawn numbers the chance of each prize tier is exact for
+ * every kind of player, so the winners of a tier among all tickets sold
+ * in a draw are sampled at once as one Poisson variate instead of
+ * ticket by ticket.
+ *
+ * A long run can be checkpointed.  Every interval the workers are asked
+ * to stop at the next draw boundary; once all have parked, the finished
+ * results and the state of each scenario in flight (draw, jackpot,
+ * rolldown, and how far into its stream it is) are copied into the
+ * checkpoint file and the workers let go before the copy is synced.  A
+ * resumed run finishes the scenarios in flight from where they were,
+ * seeking their streams back to the same word, so the results are the
+ * same as those of a run never stopped.
+ */
+
+#define MAXE GAME_MAXBONUS
+
+struct sim_state {
+	int scenario;
+	long draw;
+	double jackpot;
+	double rolldown;
+	uint64_t pos;
+	struct sim_result r;
+};
+
+struct sim_ckpt {
+	int game;
+	int scenarios;
+	int years;
+	int draws;
+	double sales;
+	double elasticity;
+	double quick;
+	double birthday;
+	double pattern;
+	uint64_t seed;
+	int next;
+	int nstate;
+	struct sim_state state[SIM_CKPT_SLOTS];
+};
+
+struct worker {
+	struct model *md;
+	pthread_t tid;
+	struct sim_state st;
+};
+
+#define CKPT_RESULT(c) ((struct sim_result *) ((c) + 1))
+#define CKPT_DONE(c, n) ((unsigned char *) (CKPT_RESULT(c) + (n)))
+
+struct model {
+	const struct sim_params *sp;
+	const struct game *g;
+	const struct prize_table *pt;
+	int tierof[GAME_MAXPICK + 1][MAXE + 1];
+	double px[MAXE + 1];
+	double quick[PRIZE_MAXTIER];
+	double bday[GAME_MAXPICK + 1][MAXE + 1][PRIZE_MAXTIER];
+	int npattern;
+	uint64_t pattern[SIM_MAXPATTERN][2];
+	atomic_int next;
+	int first;
+	int last;
+	struct sim_result *result;
+	unsigned char *done;
+	struct ckpt *ckpt;
+	pthread_mutex_t lock;
+	pthread_cond_t parked;
+	pthread_cond_t resume;
+	atomic_int pause;
+	int nparked;
+	int active;
+	int nthreads;
+	struct worker *worker;
+	struct sim_state pending[SIM_CKPT_SLOTS];
+	int npending;
+};
+
+static const struct {
+	double sales;
+	int draws;
+} defaults[NGAMES] = {
+	{ 1000000, 52 },
+	{ 5000000, 104 },
+	{ 4000000, 52 },
+	{ 10000000, 156 },
+	{ 8000000, 104 },
+	{ 20000000, 104 }
+};
+
+/*
+ * Fills the fields of sp left at zero with the defaults for sp->game.
+ */
+void
+sim_defaults(struct sim_params *sp)
+{
+	if (sp->scenarios == 0)
+		sp->scenarios = 1000;
+	if (sp->years == 0)
+		sp->years = 10;
+	if (sp->draws == 0)
+		sp->draws = defaults[sp->game].draws;
+	if (sp->sales == 0)
+		sp->sales = defaults[sp->game].sales;
+	if (sp->elasticity == 0)
+		sp->elasticity = 0.1;
+	if (sp->interval == 0)
+		sp->interval = 60;
+	if (sp->quick == 0 && sp->birthday == 0 && sp->pattern == 0) {
+		sp->quick = 0.7;
+		sp->birthday = 0.25;
+		sp->pattern = 0.05;
+	}
+}
+
+static double
+choose(int n, int k)
+{
+	return (n < 0) ? 0 : (double) comb_count(n, k);
+}
+
+/*
+ * Chance that a ticket of s numbers taken from a set of n, of which a
+ * are drawn main numbers and o drawn omake, matches j and e of them.
+ */
+static double
+hyper(int n, int s, int a, int o, int j, int e)
+{
+	return choose(a, j) * choose(o, e) * choose(n - a - o, s - j - e) /
+	    choose(n, s);
+}
+
+static void
+add_tiers(const struct model *md, double w, int j, int o, double *lam)
+{
+	int e, t;
+
+	if (md->g->omake > 0) {
+		if ((t = md->tierof[j][o]) >= 0)
+			lam[t] += w;
+		return;
+	}
+	for (e = 0; e <= md->g->xsample; ++e)
+		if ((t = md->tierof[j][e]) >= 0)
+			lam[t] += w * md->px[e];
+}
+
+static void
+add_pattern(struct model *md, int first, int step)
+{
+	int i, k;
+
+	if (md->npattern == SIM_MAXPATTERN)
+		return;
+	md->pattern[md->npattern][0] = md->pattern[md->npattern][1] = 0;
+	for (i = 0, k = first - 1; i < md->g->sample; ++i, k += step)
+		md->pattern[md->npattern][k >> 6] |= (uint64_t) 1 << (k & 63);
+	++md->npattern;
+}
+
+static void
+init_model(struct model *md, const struct sim_params *sp)
+{
+	const struct game *g;
+	int b, bo, e, j, o, s, step, first, nb;
+
+	memset(md, 0, sizeof(*md));
+	md->sp = sp;
+	md->g = g = &games[sp->game];
+	md->pt = &prizes[sp->game];
+	s = g->sample;
+
+	for (j = 0; j <= s; ++j)
+		for (e = 0; e <= MAXE; ++e)
+			md->tierof[j][e] = prize_tier(sp->game, j, e);
+	for (e = 0; e <= g->xsample; ++e)
+		md->px[e] = hyper(g->xnumber, g->xsample, g->xsample, 0, e, 0);
+	if (g->xsample == 0)
+		md->px[0] = 1;
+
+	for (j = 0; j <= s; ++j)
+		for (o = 0; o <= g->omake; ++o)
+			add_tiers(md, hyper(g->number, s, s, g->omake, j, o),
+			    j, o, md->quick);
+
+	nb = MIN(SIM_BIRTHDAY, g->number);
+	for (b = 0; b <= s; ++b)
+		for (bo = 0; bo <= g->omake; ++bo)
+			for (j = 0; j <= b; ++j)
+				for (o = 0; o <= bo; ++o)
+					add_tiers(md, hyper(nb, s, b, bo, j, o),
+					    j, o, md->bday[b][bo]);
+
+	for (step = 1; (s - 1) * step < g->number; ++step)
+		for (first = 1; first + (s - 1) * step <= g->number; ++first)
+			add_pattern(md, first, step);
+}
+
+static int
+has_jackpot(const struct prize_table *pt)
+{
+	return (pt->ntier > 0 && pt->tier[0].prize == PRIZE_JACKPOT);
+}
+
+/*
+ * Waits out a checkpoint.  Called between draws, or with st->scenario
+ * at -1 between scenarios.  A worker counts itself out again only once
+ * it has woken, so one not yet scheduled when the next checkpoint
+ * starts is still counted as parked, which it is.
+ */
+static void
+park(struct model *md, struct pool *p, struct sim_state *st)
+{
+	if (st->scenario >= 0)
+		st->pos = pool_tell(p);
+	pthread_mutex_lock(&md->lock);
+	++md->nparked;
+	pthread_cond_signal(&md->parked);
+	while (atomic_load(&md->pause))
+		pthread_cond_wait(&md->resume, &md->lock);
+	--md->nparked;
+	pthread_mutex_unlock(&md->lock);
+}
+
+static void
+run_scenario(struct model *md, struct pool *p, struct sim_state *st)
+{
+	const struct game *g = md->g;
+	const struct prize_table *pt = md->pt;
+	const struct sim_params *sp = md->sp;
+	double lam[PRIZE_MAXTIER];
+	double jackpot, rolldown, tickets, fund, wq, wb, wp;
+	uint64_t dm[2], dom[2];
+	int main[GAME_MAXPICK], bonus[GAME_MAXBONUS];
+	int cnt[GAME_MAXPICK + 1][MAXE + 1];
+	long win[PRIZE_MAXTIER];
+	struct sim_result *r;
+	long d, n;
+	int b, bo, i, j, o, t, jp;
+
+	r = &st->r;
+	jp = has_jackpot(pt);
+	jackpot = st->jackpot;
+	rolldown = st->rolldown;
+	n = (long) sp->years * sp->draws;
+	for (d = st->draw; d < n; ++d) {
+		if (atomic_load_explicit(&md->pause, memory_order_relaxed)) {
+			st->draw = d;
+			st->jackpot = jackpot;
+			st->rolldown = rolldown;
+			park(md, p, st);
+		}
+		tickets = sp->sales;
+		if (jp && pt->seed > 0 && jackpot > pt->seed)
+			tickets *= 1 + sp->elasticity *
+			    (jackpot / pt->seed - 1);
+		tickets = (double) (long) (tickets + 0.5);
+		fund = tickets * pt->price * pt->share;
+		r->sales += tickets * pt->price;
+		if (jp) {
+			jackpot += fund * pt->jpshare;
+			if (pt->cap > 0 && jackpot > pt->cap) {
+				rolldown += jackpot - pt->cap;
+				jackpot = pt->cap;
+			}
+		}
+		r->maxjackpot = MAX(r->maxjackpot, jackpot);
+
+		draw_game(g, p, main, bonus);
+		dm[0] = dm[1] = dom[0] = dom[1] = 0;
+		for (b = 0, i = 0; i < g->sample; ++i) {
+			dm[(main[i] - 1) >> 6] |= (uint64_t) 1 <<
+			    ((main[i] - 1) & 63);
+			b += (main[i] <= SIM_BIRTHDAY);
+		}
+		for (bo = 0, i = 0; i < g->omake; ++i) {
+			dom[(bonus[i] - 1) >> 6] |= (uint64_t) 1 <<
+			    ((bonus[i] - 1) & 63);
+			bo += (bonus[i] <= SIM_BIRTHDAY);
+		}
+		memset(cnt, 0, sizeof(cnt));
+		for (i = 0; i < md->npattern; ++i) {
+			j = __builtin_popcountll(md->pattern[i][0] & dm[0]) +
+			    __builtin_popcountll(md->pattern[i][1] & dm[1]);
+			o = __builtin_popcountll(md->pattern[i][0] & dom[0]) +
+			    __builtin_popcountll(md->pattern[i][1] & dom[1]);
+			++cnt[j][o];
+		}
+
+		wq = tickets * sp->quick;
+		wb = tickets * sp->birthday;
+		wp = tickets * sp->pattern / md->npattern;
+		for (t = 0; t < pt->ntier; ++t)
+			lam[t] = wq * md->quick[t] + wb * md->bday[b][bo][t];
+		for (j = 0; j <= g->sample; ++j)
+			for (o = 0; o <= g->omake; ++o)
+				if (cnt[j][o] > 0)
+					add_tiers(md, wp * cnt[j][o], j, o, lam);
+		for (t = 0; t < pt->ntier; ++t)
+			win[t] = pool_poisson(p, lam[t]);
+
+		for (t = jp; t < pt->ntier; ++t)
+			r->payout += win[t] * pt->tier[t].prize;
+		if (jp && rolldown > 0 && pt->ntier > 1 && win[1] > 0) {
+			r->payout += rolldown;
+			rolldown = 0;
+		}
+		if (jp && win[0] > 0) {
+			r->payout += jackpot;
+			++r->wins;
+			jackpot = pt->seed;
+		}
+	}
+	r->jackpot = jackpot;
+	md->result[st->scenario - md->first] = *r;
+	md->done[st->scenario - md->first] = 1;
+	st->scenario = -1;
+}
+
+/*
+ * Takes the next scenario: one left in flight by the run being resumed,
+ * or else a fresh one.  Returns -1 when there is none.
+ */
+static int
+claim(struct model *md, struct pool *p, struct sim_state *st)
+{
+	int i;
+
+	pthread_mutex_lock(&md->lock);
+	if (md->npending > 0) {
+		*st = md->pending[--md->npending];
+		pthread_mutex_unlock(&md->lock);
+		pool_seed(p, md->sp->seed, st->scenario);
+		pool_seek(p, st->pos);
+		return 0;
+	}
+	pthread_mutex_unlock(&md->lock);
+	if ((i = atomic_fetch_add(&md->next, 1)) >= md->last)
+		return -1;
+	memset(st, 0, sizeof(*st));
+	st->scenario = i;
+	st->jackpot = has_jackpot(md->pt) ? md->pt->seed : 0;
+	pool_seed(p, md->sp->seed, i);
+	return 0;
+}
+
+static void *
+work(void *arg)
+{
+	struct worker *w = arg;
+	struct model *md = w->md;
+	struct sim_state *st = &w->st;
+	struct pool *p;
+
+	if ((p = malloc(sizeof(*p))) == NULL)
+		err(1, NULL);
+	for (;;) {
+		if (atomic_load_explicit(&md->pause, memory_order_relaxed))
+			park(md, p, st);
+		if (claim(md, p, st) == -1)
+			break;
+		run_scenario(md, p, st);
+	}
+	free(p);
+	pthread_mutex_lock(&md->lock);
+	--md->active;
+	pthread_cond_signal(&md->parked);
+	pthread_mutex_unlock(&md->lock);
+	return NULL;
+}
+
+static void
+stamp(struct sim_ckpt *c, const struct sim_params *sp)
+{
+	memset(c, 0, sizeof(*c));
+	c->game = sp->game;
+	c->scenarios = sp->scenarios;
+	c->years = sp->years;
+	c->draws = sp->draws;
+	c->sales = sp->sales;
+	c->elasticity = sp->elasticity;
+	c->quick = sp->quick;
+	c->birthday = sp->birthday;
+	c->pattern = sp->pattern;
+	c->seed = sp->seed;
+}
+
+/*
+ * Stops the workers at their next draw, copies what they have into the
+ * free copy of the checkpoint, and lets them go before syncing it.
+ */
+static void
+checkpoint(struct model *md)
+{
+	const struct sim_params *sp = md->sp;
+	struct sim_ckpt *c;
+	int i, n;
+
+	pthread_mutex_lock(&md->lock);
+	atomic_store(&md->pause, 1);
+	while (md->nparked < md->active)
+		pthread_cond_wait(&md->parked, &md->lock);
+
+	c = ckpt_next(md->ckpt);
+	stamp(c, sp);
+	c->next = MIN(atomic_load(&md->next), sp->scenarios);
+	for (n = 0; n < md->npending; ++n)
+		c->state[n] = md->pending[n];
+	for (i = 0; i < md->nthreads; ++i)
+		if (md->worker[i].st.scenario >= 0)
+			c->state[n++] = md->worker[i].st;
+	c->nstate = n;
+	memcpy(CKPT_RESULT(c), md->result,
+	    sp->scenarios * sizeof(struct sim_result));
+	memcpy(CKPT_DONE(c, sp->scenarios), md->done, sp->scenarios);
+
+	atomic_store(&md->pause, 0);
+	pthread_cond_broadcast(&md->resume);
+	pthread_mutex_unlock(&md->lock);
+
+	if (ckpt_commit(md->ckpt) == -1)
+		err(1, "%s", sp->checkpoint);
+}
+
+/*
+ * Picks up where the checkpoint in sp->checkpoint left off.  A file the
+ * interrupted run never got to commit to starts the run afresh.
+ */
+static void
+resume(struct model *md, size_t size)
+{
+	const struct sim_params *sp = md->sp;
+	const struct sim_ckpt *c;
+	struct sim_ckpt want;
+
+	if ((md->ckpt = ckpt_open(sp->checkpoint)) == NULL)
+		err(1, "%s", sp->checkpoint);
+	if ((c = ckpt_last(md->ckpt)) == NULL)
+		return;
+	stamp(&want, sp);
+	if (md->ckpt->size != size ||
+	    memcmp(c, &want, offsetof(struct sim_ckpt, next)) != 0 ||
+	    c->nstate < 0 || c->nstate > SIM_CKPT_SLOTS)
+		errx(1, "%s: checkpoint of another simulation",
+		    sp->checkpoint);
+	atomic_store(&md->next, c->next);
+	md->npending = c->nstate;
+	memcpy(md->pending, c->state, c->nstate * sizeof(c->state[0]));
+	memcpy(md->result, CKPT_RESULT(c),
+	    sp->scenarios * sizeof(struct sim_result));
+	memcpy(md->done, CKPT_DONE(c, sp->scenarios), sp->scenarios);
+}
+
+static void
+deadline(struct timespec *ts, int secs)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += secs;
+}
+
+/*
+ * Runs sp->scenarios scenarios on sp->threads threads (all online CPUs
+ * when 0).  Scenario i always uses stream i of sp->seed, so the results
+ * do not depend on the number of threads.  With sp->checkpoint set the
+ * run is checkpointed every sp->interval seconds and once at the end,
+ * and with sp->resume it first continues from that file.
+ */
+struct sim_result *
+sim_run(const struct sim_params *sp)
+{
+	return sim_range(sp, 0, sp->scenarios);
+}
+
+/*
+ * Runs only scenarios first to last - 1, each on the same stream as in
+ * a full run, and returns their results from index 0.  Checkpoints are
+ * only kept for a full run.
+ */
+struct sim_result *
+sim_range(const struct sim_params *sp, int first, int last)
+{
+	struct model *md;
+	struct sim_result *r;
+	struct timespec ts;
+	double total;
+	struct sim_params p;
+	size_t size;
+	int i, n;
+
+	p = *sp;
+	total = p.quick + p.birthday + p.pattern;
+	if (total <= 0)
+		errx(1, "no players");
+	p.quick /= total;
+	p.birthday /= total;
+	p.pattern /= total;
+
+	if ((md = malloc(sizeof(*md))) == NULL)
+		err(1, NULL);
+	init_model(md, &p);
+	if ((r = calloc(MAX(last - first, 1), sizeof(*r))) == NULL ||
+	    (md->done = calloc(MAX(last - first, 1), 1)) == NULL)
+		err(1, NULL);
+	md->result = r;
+	md->first = first;
+	md->last = last;
+	atomic_init(&md->next, first);
+	atomic_init(&md->pause, 0);
+	pthread_mutex_init(&md->lock, NULL);
+	pthread_cond_init(&md->parked, NULL);
+	pthread_cond_init(&md->resume, NULL);
+
+	if (p.checkpoint != NULL && first == 0 && last == p.scenarios) {
+		size = sizeof(struct sim_ckpt) +
+		    p.scenarios * (sizeof(*r) + 1);
+		if (p.resume)
+			resume(md, size);
+		else if ((md->ckpt = ckpt_create(p.checkpoint, size)) == NULL)
+			err(1, "%s", p.checkpoint);
+	}
+
+	n = p.threads > 0 ? p.threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+	n = MAX(MIN(n, last - first), 1);
+	if (md->ckpt != NULL)
+		n = MIN(n, SIM_CKPT_SLOTS);
+	if ((md->worker = calloc(n, sizeof(*md->worker))) == NULL)
+		err(1, NULL);
+	md->nthreads = md->active = n;
+	for (i = 0; i < n; ++i) {
+		md->worker[i].md = md;
+		md->worker[i].st.scenario = -1;
+		if (pthread_create(&md->worker[i].tid, NULL, work,
+		    &md->worker[i]) != 0)
+			err(1, "pthread_create");
+	}
+	if (md->ckpt != NULL) {
+		pthread_mutex_lock(&md->lock);
+		deadline(&ts, p.interval);
+		while (md->active > 0)
+			if (pthread_cond_timedwait(&md->parked, &md->lock,
+			    &ts) == ETIMEDOUT) {
+				pthread_mutex_unlock(&md->lock);
+				checkpoint(md);
+				pthread_mutex_lock(&md->lock);
+				deadline(&ts, p.interval);
+			}
+		pthread_mutex_unlock(&md->lock);
+	}
+	for (i = 0; i < n; ++i)
+		pthread_join(md->worker[i].tid, NULL);
+	if (md->ckpt != NULL) {
+		checkpoint(md);
+		ckpt_close(md->ckpt);
+	}
+	pthread_cond_destroy(&md->resume);
+	pthread_cond_destroy(&md->parked);
+	pthread_mutex_destroy(&md->lock);
+	free(md->worker);
+	free(md->done);
+	free(md);
+	return r;
+}
+
+static int
+cmpdouble(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static void
+percentiles(FILE *fp, const char *name, double *v, int n)
+{
+	static const double q[] = { 0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99 };
+	size_t i;
+
+	qsort(v, n, sizeof(double), cmpdouble);
+	fprintf(fp, "%-14s", name);
+	for (i = 0; i < sizeof(q) / sizeof(q[0]); ++i)
+		fprintf(fp, " %13.4g", v[(int) (q[i] * (n - 1))]);
+	fprintf(fp, "\n");
+}
+
+void
+sim_report(FILE *fp, const struct sim_params *sp, const struct sim_result *r)
+{
+	double *v;
+	int i, n;
+
+	n = sp->scenarios;
+	if ((v = malloc(n * sizeof(double))) == NULL)
+		err(1, NULL);
+	fprintf(fp, "%s: %d scenarios of %d years, %d draws a year\n",
+	    games[sp->game].name, n, sp->years, sp->draws);
+	fprintf(fp, "%-14s %13s %13s %13s %13s %13s %13s %13s\n", "",
+	    "p1", "p5", "p25", "p50", "p75", "p95", "p99");
+	for (i = 0; i < n; ++i)
+		v[i] = r[i].maxjackpot;
+	percentiles(fp, "max jackpot", v, n);
+	for (i = 0; i < n; ++i)
+		v[i] = r[i].jackpot;
+	percentiles(fp, "final jackpot", v, n);
+	for (i = 0; i < n; ++i)
+		v[i] = r[i].sales;
+	percentiles(fp, "sales", v, n);
+	for (i = 0; i < n; ++i)
+		v[i] = r[i].payout;
+	percentiles(fp, "payout", v, n);
+	for (i = 0; i < n; ++i)
+		v[i] = r[i].sales > 0 ? r[i].payout / r[i].sales : 0;
+	percentiles(fp, "payout ratio", v, n);
+	for (i = 0; i < n; ++i)
+		v[i] = r[i].wins;
+	percentiles(fp, "jackpot wins", v, n);
+	free(v);
+}
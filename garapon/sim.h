@@ -0,0 +1,45 @@
+/* sim.h */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_MAXPATTERN 1024
+#define SIM_BIRTHDAY 31
+#define SIM_CKPT_SLOTS 256
+
+struct sim_params {
+	int game;
+	int scenarios;
+	int years;
+	int draws;
+	double sales;
+	double elasticity;
+	double quick;
+	double birthday;
+	double pattern;
+	uint64_t seed;
+	int threads;
+	const char *checkpoint;
+	int interval;
+	int resume;
+};
+
+struct sim_result {
+	double maxjackpot;
+	double jackpot;
+	double sales;
+	double payout;
+	long wins;
+};
+
+void sim_defaults(struct sim_params *sp);
+struct sim_result *sim_run(const struct sim_params *sp);
+struct sim_result *sim_range(const struct sim_params *sp, int first,
+    int last);
+void sim_report(FILE *fp, const struct sim_params *sp,
+    const struct sim_result *r);
+
+#endif /* SIM_H */
@@ -0,0 +1,262 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rank.h"
+#include "sketch.h"
+#include "ticket.h"
+
+/*
+ * Heavy hitters of the ticket stream in fixed memory.  Each
+ * combination bumps one counter per row of a count-min sketch, using
+ * conservative update: only the counters at the current minimum grow.
+ * The minimum over the rows never undercounts and overcounts by at
+ * most tickets * e / SKETCH_WIDTH with probability 1 - e^-SKETCH_DEPTH.
+ * A combination whose estimate beats the smallest in the heap of
+ * candidates takes its place.  Merging adds the counters and
+ * re-estimates the candidates of both sides.
+ */
+
+static uint32_t
+slot(uint64_t key, int row)
+{
+	uint64_t z;
+
+	z = key + (uint64_t) (row + 1) * 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return (uint32_t) ((z ^ (z >> 31)) & (SKETCH_WIDTH - 1));
+}
+
+struct sketch *
+sketch_new(int game)
+{
+	struct sketch *sk;
+
+	if ((sk = (struct sketch *) calloc(1, sizeof(*sk))) == NULL)
+		return NULL;
+	sk->game = game;
+	return sk;
+}
+
+static void
+sift_down(struct sketch *sk, int i)
+{
+	struct heavy t;
+	int c;
+
+	while ((c = 2 * i + 1) < sk->ntop) {
+		if (c + 1 < sk->ntop && sk->top[c + 1].count < sk->top[c].count)
+			++c;
+		if (sk->top[i].count <= sk->top[c].count)
+			break;
+		t = sk->top[i];
+		sk->top[i] = sk->top[c];
+		sk->top[c] = t;
+		i = c;
+	}
+}
+
+static void
+sift_up(struct sketch *sk, int i)
+{
+	struct heavy t;
+
+	while (i > 0 && sk->top[(i - 1) / 2].count > sk->top[i].count) {
+		t = sk->top[i];
+		sk->top[i] = sk->top[(i - 1) / 2];
+		sk->top[(i - 1) / 2] = t;
+		i = (i - 1) / 2;
+	}
+}
+
+/* Offers key with estimate est to the heap of candidates. */
+static void
+offer(struct sketch *sk, uint64_t key, uint64_t est)
+{
+	int i;
+
+	if (sk->ntop == SKETCH_TOP && est <= sk->top[0].count)
+		return;
+	for (i = 0; i < sk->ntop; ++i) {
+		if (sk->top[i].key == key) {
+			sk->top[i].count = est;
+			sift_down(sk, i);
+			return;
+		}
+	}
+	if (sk->ntop < SKETCH_TOP) {
+		sk->top[sk->ntop].key = key;
+		sk->top[sk->ntop].count = est;
+		sift_up(sk, sk->ntop++);
+	} else {
+		sk->top[0].key = key;
+		sk->top[0].count = est;
+		sift_down(sk, 0);
+	}
+}
+
+void
+sketch_add(struct sketch *sk, const vector tickets, size_t n)
+{
+	const struct game *g;
+	const int *t;
+	uint32_t h[SKETCH_DEPTH], m;
+	uint64_t key;
+	size_t i;
+	int r, w;
+
+	g = &games[sk->game];
+	w = TK_WIDTH(g);
+	for (i = 0, t = tickets; i < n; ++i, t += w) {
+		key = comb_rank((vector) t, g->sample);
+		for (m = UINT32_MAX, r = 0; r < SKETCH_DEPTH; ++r) {
+			h[r] = slot(key, r);
+			m = MIN(m, sk->count[r][h[r]]);
+		}
+		for (r = 0; r < SKETCH_DEPTH; ++r)
+			if (sk->count[r][h[r]] == m)
+				++sk->count[r][h[r]];
+		offer(sk, key, (uint64_t) m + 1);
+	}
+	sk->tickets += n;
+}
+
+uint64_t
+sketch_estimate(const struct sketch *sk, uint64_t key)
+{
+	uint32_t m;
+	int r;
+
+	for (m = UINT32_MAX, r = 0; r < SKETCH_DEPTH; ++r)
+		m = MIN(m, sk->count[r][slot(key, r)]);
+	return m;
+}
+
+void
+sketch_merge(struct sketch *into, const struct sketch *from)
+{
+	struct heavy cand[2 * SKETCH_TOP];
+	int i, n, r;
+
+	for (r = 0; r < SKETCH_DEPTH; ++r)
+		for (i = 0; i < SKETCH_WIDTH; ++i)
+			into->count[r][i] += from->count[r][i];
+	into->tickets += from->tickets;
+
+	n = 0;
+	for (i = 0; i < into->ntop; ++i)
+		cand[n++] = into->top[i];
+	for (i = 0; i < from->ntop; ++i)
+		cand[n++] = from->top[i];
+	into->ntop = 0;
+	for (i = 0; i < n; ++i)
+		offer(into, cand[i].key, sketch_estimate(into, cand[i].key));
+}
+
+static int
+cmpheavy(const void *a, const void *b)
+{
+	const struct heavy *x = a, *y = b;
+
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return (x->key > y->key) - (x->key < y->key);
+}
+
+/*
+ * Copies the n most popular combinations, most popular first, to out
+ * and returns how many there were.
+ */
+int
+sketch_top(const struct sketch *sk, struct heavy *out, int n)
+{
+	struct heavy all[SKETCH_TOP];
+
+	memcpy(all, sk->top, sk->ntop * sizeof(struct heavy));
+	qsort(all, sk->ntop, sizeof(struct heavy), cmpheavy);
+	n = MIN(n, sk->ntop);
+	memcpy(out, all, n * sizeof(struct heavy));
+	return n;
+}
+
+void
+sketch_report(FILE *fp, const struct sketch *sk, int n)
+{
+	struct heavy top[SKETCH_TOP];
+	int v[GAME_MAXPICK];
+	int i, j;
+
+	n = sketch_top(sk, top, MIN(n, SKETCH_TOP));
+	fprintf(fp, "%-24s %13s   (+%.0f at most, 98%% sure)\n",
+	    "popular combinations", "tickets",
+	    2.718281828 * sk->tickets / SKETCH_WIDTH);
+	for (i = 0; i < n; ++i) {
+		comb_unrank(top[i].key, games[sk->game].sample, v);
+		for (j = 0; j < games[sk->game].sample; ++j)
+			fprintf(fp, "%02d ", v[j]);
+		fprintf(fp, "%*s %13llu\n",
+		    24 - 3 * games[sk->game].sample, "",
+		    (unsigned long long) top[i].count);
+	}
+}
+
+void
+sketch_free(struct sketch *sk)
+{
+	free(sk);
+}
+
+static void *
+stage_open(int game, void *arg)
+{
+	struct sketch *sk;
+
+	(void) arg;
+	if ((sk = sketch_new(game)) == NULL)
+		err(1, "sketch");
+	return sk;
+}
+
+static void
+stage_feed(void *st, const vector tickets, size_t n)
+{
+	sketch_add(st, tickets, n);
+}
+
+static void
+stage_merge(void *into, void *from)
+{
+	sketch_merge(into, from);
+}
+
+static void
+stage_close(void *st)
+{
+	sketch_free(st);
+}
+
+const struct stage sketch_stage = {
+	"sketch", stage_open, stage_feed, stage_merge, stage_close, NULL
+};
@@ -0,0 +1,44 @@
+/* sketch.h */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "engine.h"
+#include "ingest.h"
+
+#define SKETCH_DEPTH 4
+#define SKETCH_WIDTH (1 << 16)
+#define SKETCH_TOP 64
+
+struct heavy {
+	uint64_t key;		/* comb_rank() of the main numbers */
+	uint64_t count;
+};
+
+/*
+ * Count-min sketch of the main number combinations sold, with a
+ * min-heap of the SKETCH_TOP combinations estimated most popular.
+ */
+struct sketch {
+	int game;
+	uint64_t tickets;
+	int ntop;
+	struct heavy top[SKETCH_TOP];
+	uint32_t count[SKETCH_DEPTH][SKETCH_WIDTH];
+};
+
+extern const struct stage sketch_stage;
+
+struct sketch *sketch_new(int game);
+void sketch_add(struct sketch *sk, const vector tickets, size_t n);
+uint64_t sketch_estimate(const struct sketch *sk, uint64_t key);
+void sketch_merge(struct sketch *into, const struct sketch *from);
+int sketch_top(const struct sketch *sk, struct heavy *out, int n);
+void sketch_report(FILE *fp, const struct sketch *sk, int n);
+void sketch_free(struct sketch *sk);
+
+#endif /* SKETCH_H */
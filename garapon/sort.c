@@ -0,0 +1,200 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <err.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sort.h"
+
+/*
+ * Optimal comparator networks for the pick sizes of the games in
+ * garapon.h.  Each pair (i, j) is a compare-exchange with i < j.
+ */
+static const unsigned char net2[] = {
+	0, 1
+};
+
+static const unsigned char net5[] = {
+	0, 1,  3, 4,  2, 4,  2, 3,  1, 4,  0, 3,  0, 2,  1, 3,  1, 2
+};
+
+static const unsigned char net6[] = {
+	1, 2,  4, 5,  0, 2,  3, 5,  0, 1,  3, 4,
+	2, 5,  0, 3,  1, 4,  2, 4,  1, 3,  2, 3
+};
+
+static const unsigned char net7[] = {
+	1, 2,  3, 4,  5, 6,  0, 2,  3, 5,  4, 6,  0, 1,  4, 5,
+	2, 6,  0, 4,  1, 5,  0, 3,  2, 5,  1, 3,  2, 4,  2, 3
+};
+
+static const struct {
+	const unsigned char *cmp;
+	int length;
+} networks[SORT_NET_MAX + 1] = {
+	{ NULL, 0 },
+	{ NULL, 0 },
+	{ net2, 1 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+	{ net5, 9 },
+	{ net6, 12 },
+	{ net7, 16 }
+};
+
+static bool
+has_network(int n)
+{
+	return (n == 1 || (n <= SORT_NET_MAX && networks[n].cmp != NULL));
+}
+
+static void
+network_sort(int n, vector v)
+{
+	const unsigned char *c;
+	int i, lo, hi;
+
+	c = networks[n].cmp;
+	for (i = 0; i < networks[n].length; ++i, c += 2) {
+		lo = MIN(v[c[0]], v[c[1]]);
+		hi = MAX(v[c[0]], v[c[1]]);
+		v[c[0]] = lo;
+		v[c[1]] = hi;
+	}
+}
+
+static void
+insertion_sort(int n, vector v)
+{
+	int i, j, x;
+
+	for (i = 1; i < n; ++i) {
+		x = v[i];
+		for (j = i; j > 0 && v[j - 1] > x; --j)
+			v[j] = v[j - 1];
+		v[j] = x;
+	}
+}
+
+static void
+radix_sort(int n, const vector a, vector b)
+{
+	unsigned int *src, *dst, *tmp, *buf;
+	size_t count[256];
+	size_t sum, t;
+	int i, shift;
+
+	if ((buf = (unsigned int *) malloc(n * sizeof(int))) == NULL)
+		err(1, NULL);
+	src = (unsigned int *) b;
+	dst = buf;
+	for (i = 0; i < n; ++i)
+		src[i] = (unsigned int) a[i] ^ 0x80000000u;
+
+	for (shift = 0; shift < 32; shift += 8) {
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < n; ++i)
+			++count[(src[i] >> shift) & 0xff];
+		if (count[(src[0] >> shift) & 0xff] == (size_t) n)
+			continue;
+		for (sum = 0, i = 0; i < 256; ++i) {
+			t = count[i];
+			count[i] = sum;
+			sum += t;
+		}
+		for (i = 0; i < n; ++i)
+			dst[count[(src[i] >> shift) & 0xff]++] = src[i];
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	for (i = 0; i < n; ++i)
+		b[i] = (int) (src[i] ^ 0x80000000u);
+	free(buf);
+}
+
+void
+distsort(int n, const vector a, vector b)
+{
+	if (n <= 0)
+		return;
+	if (n >= SORT_RADIX_MIN) {
+		radix_sort(n, a, b);
+		return;
+	}
+	if (a != b)
+		memcpy(b, a, n * sizeof(int));
+	if (has_network(n))
+		network_sort(n, b);
+	else
+		insertion_sort(n, b);
+}
+
+/*
+ * Sorts count draws of n numbers each, stored one draw after another.
+ * Draws are transposed SORT_LANES at a time so that every comparator
+ * of the network becomes a min/max over a whole column of lanes.
+ */
+void
+distsort_batch(int n, size_t count, const vector a, vector b)
+{
+	int col[SORT_NET_MAX][SORT_LANES];
+	const unsigned char *c;
+	size_t d, base, lanes;
+	int i, k, lo, hi;
+
+	if (n <= 0)
+		return;
+	if (n == 1) {
+		if (a != b)
+			memcpy(b, a, count * sizeof(int));
+		return;
+	}
+	if (!has_network(n)) {
+		for (d = 0; d < count; ++d)
+			distsort(n, a + d * n, b + d * n);
+		return;
+	}
+
+	for (base = 0; base < count; base += SORT_LANES) {
+		lanes = MIN(count - base, SORT_LANES);
+		for (k = 0; k < n; ++k)
+			for (i = 0; i < SORT_LANES; ++i)
+				col[k][i] = (size_t) i < lanes ?
+				    a[(base + i) * n + k] : 0;
+
+		c = networks[n].cmp;
+		for (k = 0; k < networks[n].length; ++k, c += 2) {
+			for (i = 0; i < SORT_LANES; ++i) {
+				lo = MIN(col[c[0]][i], col[c[1]][i]);
+				hi = MAX(col[c[0]][i], col[c[1]][i]);
+				col[c[0]][i] = lo;
+				col[c[1]][i] = hi;
+			}
+		}
+
+		for (i = 0; i < (int) lanes; ++i)
+			for (k = 0; k < n; ++k)
+				b[(base + i) * n + k] = col[k][i];
+	}
+}
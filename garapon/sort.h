@@ -0,0 +1,17 @@
+/* sort.h */
+
+#ifndef SORT_H
+#define SORT_H
+
+#include <stddef.h>
+
+#include "garapon.h"
+
+#define SORT_NET_MAX 7
+#define SORT_LANES 16
+#define SORT_RADIX_MIN 64
+
+void distsort(int n, const vector a, vector b);
+void distsort_batch(int n, size_t count, const vector a, vector b);
+
+#endif /* SORT_H */
@@ -0,0 +1,283 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binom.h"
+#include "prize.h"
+#include "rank.h"
+#include "subidx.h"
+#include "ticket.h"
+
+/*
+ * Subset-count index.  Every ticket adds one to the counter of each
+ * nonempty subset of its main numbers, addressed by combinatorial rank
+ * within the subsets of that size.  For a draw D the sum N_k of the
+ * counters of the k-subsets of D is the sum over tickets of
+ * C(|T & D|, k), so the number of tickets sharing exactly j numbers
+ * with D follows by binomial inversion:
+ *
+ *	E_j = sum over k >= j of (-1)^(k - j) C(k, j) N_k
+ *
+ * Omake numbers come out of the same machine, so for those games the
+ * subsets of D | B split N by how many bonus numbers they hold and the
+ * same inversion in two variables gives every prize tier.  Counters are
+ * 32 bits wide.
+ */
+
+struct subidx *
+subidx_new(int game)
+{
+	const struct game *g;
+	struct subidx *x;
+	int k;
+
+	g = &games[game];
+	if ((x = (struct subidx *) calloc(1, sizeof(*x))) == NULL)
+		return NULL;
+	x->game = game;
+	x->sample = g->sample;
+	for (k = 1; k <= x->sample; ++k) {
+		x->count[k] = (uint32_t *) calloc(comb_count(g->number, k),
+		    sizeof(uint32_t));
+		if (x->count[k] == NULL) {
+			subidx_free(x);
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+	return x;
+}
+
+static void
+walk(struct subidx *x, const int *t, int from, int k, uint64_t r)
+{
+	uint64_t q;
+	int i;
+
+	for (i = from; i < x->sample; ++i) {
+		q = r + binom[t[i] - 1][k + 1];
+		++x->count[k + 1][q];
+		walk(x, t, i + 1, k + 1, q);
+	}
+}
+
+/*
+ * Adds n tickets of TK_WIDTH numbers, main numbers sorted.
+ */
+void
+subidx_add(struct subidx *x, const vector tickets, size_t n)
+{
+	const int *t;
+	size_t i;
+	int w;
+
+	w = TK_WIDTH(&games[x->game]);
+	for (i = 0, t = tickets; i < n; ++i, t += w)
+		walk(x, t, 0, 0, 0);
+	x->tickets += n;
+}
+
+void
+subidx_merge(struct subidx *into, const struct subidx *from)
+{
+	const struct game *g;
+	uint64_t i, n;
+	uint32_t *a;
+	const uint32_t *b;
+	int k;
+
+	g = &games[into->game];
+	for (k = 1; k <= into->sample; ++k) {
+		a = into->count[k];
+		b = from->count[k];
+		n = comb_count(g->number, k);
+		for (i = 0; i < n; ++i)
+			a[i] += b[i];
+	}
+	into->tickets += from->tickets;
+}
+
+struct sums {
+	const struct subidx *x;
+	int u[GAME_MAXPICK + GAME_MAXBONUS];
+	int bonus[GAME_MAXPICK + GAME_MAXBONUS];
+	int n;
+	int64_t N[GAME_MAXPICK + 1][GAME_MAXBONUS + 1];
+};
+
+static void
+sum(struct sums *s, int from, int k, int l, uint64_t r)
+{
+	uint64_t q;
+	int i, k2, l2;
+
+	for (i = from; i < s->n; ++i) {
+		q = r + binom[s->u[i] - 1][k + l + 1];
+		k2 = k + !s->bonus[i];
+		l2 = l + s->bonus[i];
+		s->N[k2][l2] += s->x->count[k + l + 1][q];
+		if (k + l + 1 < s->x->sample)
+			sum(s, i + 1, k2, l2, q);
+	}
+}
+
+/*
+ * E[j][e]: tickets sharing exactly j numbers with main and e with the
+ * nb numbers of bonus, which must come from the same machine.
+ */
+static void
+invert(const struct subidx *x, const vector main, const vector bonus,
+    int nb, int64_t E[][GAME_MAXBONUS + 1])
+{
+	struct sums s;
+	int64_t v;
+	int i, j, e, k, l, m;
+
+	memset(&s, 0, sizeof(s));
+	s.x = x;
+	for (i = j = m = 0; i < x->sample || j < nb; ++m) {
+		if (j == nb || (i < x->sample && main[i] < bonus[j])) {
+			s.u[m] = main[i++];
+			s.bonus[m] = 0;
+		} else {
+			s.u[m] = bonus[j++];
+			s.bonus[m] = 1;
+		}
+	}
+	s.n = m;
+	s.N[0][0] = (int64_t) x->tickets;
+	sum(&s, 0, 0, 0, 0);
+
+	for (j = 0; j <= x->sample; ++j) {
+		for (e = 0; e <= nb; ++e) {
+			v = 0;
+			for (k = j; k <= x->sample; ++k)
+				for (l = e; l <= nb; ++l)
+					v += (((k - j + l - e) & 1) ? -1 : 1) *
+					    (int64_t) binom[k][j] *
+					    (int64_t) binom[l][e] * s.N[k][l];
+			E[j][e] = v;
+		}
+	}
+}
+
+/*
+ * exact[j], j = 0 .. sample: tickets sharing exactly j numbers with
+ * the sorted main numbers of a draw.
+ */
+void
+subidx_exact(const struct subidx *x, const vector main, uint64_t *exact)
+{
+	int64_t E[GAME_MAXPICK + 1][GAME_MAXBONUS + 1];
+	int j;
+
+	invert(x, main, NULL, 0, E);
+	for (j = 0; j <= x->sample; ++j)
+		exact[j] = (uint64_t) E[j][0];
+}
+
+uint64_t
+subidx_atleast(const struct subidx *x, const vector main, int k)
+{
+	uint64_t exact[GAME_MAXPICK + 1], n;
+	int j;
+
+	subidx_exact(x, main, exact);
+	for (n = 0, j = MAX(k, 0); j <= x->sample; ++j)
+		n += exact[j];
+	return n;
+}
+
+/*
+ * Adds the winners of each prize tier of a draw (as from draw_game())
+ * to winners.  Only games whose bonus numbers come from the main
+ * machine can be settled this way; for the others -1 is returned with
+ * errno set to EINVAL.
+ */
+int
+subidx_tiers(const struct subidx *x, const vector main, const vector bonus,
+    uint64_t *winners)
+{
+	const struct game *g;
+	int64_t E[GAME_MAXPICK + 1][GAME_MAXBONUS + 1];
+	int j, e, t;
+
+	g = &games[x->game];
+	if (g->xsample > 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	invert(x, main, bonus, g->omake, E);
+	for (j = 0; j <= x->sample; ++j)
+		for (e = 0; e <= g->omake; ++e)
+			if ((t = prize_tier(x->game, j, e)) >= 0)
+				winners[t] += (uint64_t) E[j][e];
+	return 0;
+}
+
+void
+subidx_free(struct subidx *x)
+{
+	int k;
+
+	if (x == NULL)
+		return;
+	for (k = 1; k <= x->sample; ++k)
+		free(x->count[k]);
+	free(x);
+}
+
+static void *
+stage_open(int game, void *arg)
+{
+	struct subidx *x;
+
+	(void) arg;
+	if ((x = subidx_new(game)) == NULL)
+		err(1, "subset index");
+	return x;
+}
+
+static void
+stage_feed(void *st, const vector tickets, size_t n)
+{
+	subidx_add(st, tickets, n);
+}
+
+static void
+stage_merge(void *into, void *from)
+{
+	subidx_merge(into, from);
+}
+
+static void
+stage_close(void *st)
+{
+	subidx_free(st);
+}
+
+const struct stage subidx_stage = {
+	"subset index", stage_open, stage_feed, stage_merge, stage_close, NULL
+};
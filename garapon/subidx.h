@@ -0,0 +1,35 @@
+/* subidx.h */
+
+#ifndef SUBIDX_H
+#define SUBIDX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine.h"
+#include "ingest.h"
+
+/*
+ * count[k][r] is the number of tickets whose main numbers contain the
+ * k-subset of rank r, for k = 1 .. sample.
+ */
+struct subidx {
+	int game;
+	int sample;
+	uint64_t tickets;
+	uint32_t *count[GAME_MAXPICK + 1];
+};
+
+extern const struct stage subidx_stage;
+
+struct subidx *subidx_new(int game);
+void subidx_add(struct subidx *x, const vector tickets, size_t n);
+void subidx_merge(struct subidx *into, const struct subidx *from);
+void subidx_exact(const struct subidx *x, const vector main,
+    uint64_t *exact);
+uint64_t subidx_atleast(const struct subidx *x, const vector main, int k);
+int subidx_tiers(const struct subidx *x, const vector main,
+    const vector bonus, uint64_t *winners);
+void subidx_free(struct subidx *x);
+
+#endif /* SUBIDX_H */
@@ -0,0 +1,217 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rank.h"
+#include "ticket.h"
+
+/*
+ * A ticket file is a header followed by fixed-width records, each the
+ * 32-bit rank of a ticket (see rank.c).  The ticket count in the header
+ * is filled in by tk_close().  A rank past the ticket space of the game
+ * would unrank to numbers out of range, so a chunk of ranks holding one
+ * is refused and every later read fails with it.
+ */
+
+struct tkhdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t game;
+	uint32_t width;
+	uint32_t pad;
+	uint64_t count;
+};
+
+#define TK_CHUNK 4096
+
+static struct tkfile *
+new_tkfile(const char *path, const char *mode)
+{
+	struct tkfile *tk;
+
+	if ((tk = (struct tkfile *) calloc(1, sizeof(*tk))) == NULL)
+		return NULL;
+	if ((tk->buf = (char *) malloc(TK_BUFSIZE)) == NULL ||
+	    (tk->fp = fopen(path, mode)) == NULL) {
+		free(tk->buf);
+		free(tk);
+		return NULL;
+	}
+	setvbuf(tk->fp, tk->buf, _IOFBF, TK_BUFSIZE);
+	return tk;
+}
+
+static void
+free_tkfile(struct tkfile *tk)
+{
+	fclose(tk->fp);
+	free(tk->buf);
+	free(tk);
+}
+
+static int
+write_header(struct tkfile *tk)
+{
+	struct tkhdr h;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, TK_MAGIC, sizeof(h.magic));
+	h.version = TK_VERSION;
+	h.game = tk->game;
+	h.width = tk->width;
+	h.count = tk->count;
+	if (fseek(tk->fp, 0, SEEK_SET) == -1 ||
+	    fwrite(&h, sizeof(h), 1, tk->fp) != 1)
+		return -1;
+	return 0;
+}
+
+struct tkfile *
+tk_create(const char *path, int game)
+{
+	struct tkfile *tk;
+
+	if (game < 0 || game >= NGAMES) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if ((tk = new_tkfile(path, "w+b")) == NULL)
+		return NULL;
+	tk->mode = TK_WRITE;
+	tk->version = TK_VERSION;
+	tk->game = game;
+	tk->width = TK_WIDTH(&games[game]);
+	if (write_header(tk) == -1) {
+		free_tkfile(tk);
+		return NULL;
+	}
+	return tk;
+}
+
+struct tkfile *
+tk_open(const char *path)
+{
+	struct tkfile *tk;
+	struct tkhdr h;
+
+	if ((tk = new_tkfile(path, "rb")) == NULL)
+		return NULL;
+	if (fread(&h, sizeof(h), 1, tk->fp) != 1 ||
+	    memcmp(h.magic, TK_MAGIC, sizeof(h.magic)) != 0 ||
+	    h.version != TK_VERSION ||
+	    h.game >= NGAMES ||
+	    h.width != (uint32_t) TK_WIDTH(&games[h.game])) {
+		free_tkfile(tk);
+		errno = EINVAL;
+		return NULL;
+	}
+	tk->mode = TK_READ;
+	tk->version = h.version;
+	tk->game = h.game;
+	tk->width = h.width;
+	tk->count = h.count;
+	return tk;
+}
+
+int
+tk_write_ranks(struct tkfile *tk, const uint32_t *r, size_t n)
+{
+	if (fwrite(r, sizeof(uint32_t), n, tk->fp) != n)
+		return -1;
+	tk->count += n;
+	return 0;
+}
+
+int
+tk_write(struct tkfile *tk, const vector tickets, size_t n)
+{
+	uint32_t r[TK_CHUNK];
+	size_t i, len;
+
+	for (i = 0; i < n; i += len) {
+		len = MIN(n - i, (size_t) TK_CHUNK);
+		ticket_rank_batch(&games[tk->game], tickets + i * tk->width,
+		    len, r);
+		if (tk_write_ranks(tk, r, len) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Reads up to n ranks.  Returns how many were read, or 0 with errno and
+ * tk->error set when the read fails or a rank is out of range.
+ */
+size_t
+tk_read_ranks(struct tkfile *tk, uint32_t *r, size_t n)
+{
+	uint64_t space;
+	size_t got, i;
+
+	if (tk->error != 0) {
+		errno = tk->error;
+		return 0;
+	}
+	if ((got = fread(r, sizeof(uint32_t), n, tk->fp)) == 0 &&
+	    ferror(tk->fp)) {
+		errno = tk->error = EIO;
+		return 0;
+	}
+	space = ticket_space(&games[tk->game]);
+	for (i = 0; i < got; ++i)
+		if (r[i] >= space) {
+			errno = tk->error = EINVAL;
+			return 0;
+		}
+	return got;
+}
+
+size_t
+tk_read(struct tkfile *tk, vector tickets, size_t n)
+{
+	uint32_t r[TK_CHUNK];
+	size_t i, got, len;
+
+	for (i = 0; i < n; i += got) {
+		len = MIN(n - i, (size_t) TK_CHUNK);
+		if ((got = tk_read_ranks(tk, r, len)) == 0)
+			break;
+		ticket_unrank_batch(&games[tk->game], r, got,
+		    tickets + i * tk->width);
+	}
+	return i;
+}
+
+int
+tk_close(struct tkfile *tk)
+{
+	int r = 0;
+
+	if (tk->mode == TK_WRITE)
+		r = write_header(tk);
+	if (fflush(tk->fp) == EOF)
+		r = -1;
+	free_tkfile(tk);
+	return r;
+}
@@ -0,0 +1,41 @@
+/* ticket.h */
+
+#ifndef TICKET_H
+#define TICKET_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "engine.h"
+
+#define TK_MAGIC "GRPNTKTS"
+#define TK_VERSION 2
+#define TK_BUFSIZE (1 << 20)
+
+#define TK_WIDTH(g) ((g)->sample + (g)->xsample)
+
+enum {
+	TK_READ,
+	TK_WRITE
+};
+
+struct tkfile {
+	FILE *fp;
+	char *buf;
+	int mode;
+	int version;
+	int game;
+	int width;
+	int error;		/* errno of a failed read, or 0 */
+	uint64_t count;
+};
+
+struct tkfile *tk_create(const char *path, int game);
+struct tkfile *tk_open(const char *path);
+int tk_write(struct tkfile *tk, const vector tickets, size_t n);
+int tk_write_ranks(struct tkfile *tk, const uint32_t *r, size_t n);
+size_t tk_read(struct tkfile *tk, vector tickets, size_t n);
+size_t tk_read_ranks(struct tkfile *tk, uint32_t *r, size_t n);
+int tk_close(struct tkfile *tk);
+
+#endif /* TICKET_H */
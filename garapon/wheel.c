@@ -0,0 +1,486 @@
+/*  garapon - ncurses based lottery game
+    Copyright (C) 2020 Junji Okamoto
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "entropy.h"
+#include "sort.h"
+#include "ticket.h"
+#include "wheel.h"
+
+/*
+ * Lottery wheels.  The chosen numbers are the bits of a 32-bit mask;
+ * a ticket is a mask of game sample bits and it covers an m-subset of
+ * the chosen numbers when they share at least k bits.  A greedy pass
+ * builds a first complete wheel; every thread then takes the best
+ * wheel, drops one ticket and anneals the rest until nothing is left
+ * uncovered, which yields a wheel one ticket smaller.  A thread only
+ * starts over from the best wheel when some thread improved it.
+ */
+
+#define WHEEL_CANDIDATES 64
+#define WHEEL_MOVES 20000
+#define WHEEL_TSTART 0.6
+#define WHEEL_TEND 0.02
+#define WHEEL_CHECK 256
+
+struct wctx {
+	const struct wheel_spec *spec;
+	int s;
+	uint32_t *mset;
+	size_t nmset;
+	pthread_mutex_t lock;
+	uint32_t *best;
+	int bestsize;
+	struct timespec deadline;
+};
+
+struct wstate {
+	struct wctx *ctx;
+	struct pool pool;
+	uint32_t *ticket;
+	int size;
+	uint32_t *cover;
+	size_t uncovered;
+};
+
+static inline bool
+covers(const struct wctx *c, uint32_t t, uint32_t m)
+{
+	return __builtin_popcount(t & m) >= c->spec->k;
+}
+
+static size_t
+choose(int n, int k)
+{
+	size_t r;
+	int i;
+
+	for (r = 1, i = 1; i <= k; ++i)
+		r = r * (n - k + i) / i;
+	return r;
+}
+
+static int
+make_msets(struct wctx *c)
+{
+	uint64_t x, lim, t;
+	size_t i;
+
+	c->nmset = choose(c->spec->n, c->spec->m);
+	if ((c->mset = malloc(c->nmset * sizeof(uint32_t))) == NULL)
+		return -1;
+	lim = (uint64_t) 1 << c->spec->n;
+	for (i = 0, x = ((uint64_t) 1 << c->spec->m) - 1; x < lim; ++i) {
+		c->mset[i] = (uint32_t) x;
+		t = x | (x - 1);
+		x = (t + 1) | (((~t & -~t) - 1) >> (__builtin_ctzll(x) + 1));
+	}
+	return 0;
+}
+
+static int
+random_bit(struct pool *p, uint32_t mask)
+{
+	int i;
+
+	for (i = pool_bounded(p, __builtin_popcount(mask)); i > 0; --i)
+		mask &= mask - 1;
+	return __builtin_ctz(mask);
+}
+
+/*
+ * A candidate ticket that covers mset m: k of its bits come from m
+ * and the rest from anywhere among the chosen numbers.
+ */
+static uint32_t
+candidate(struct wstate *st, uint32_t m)
+{
+	const struct wctx *c = st->ctx;
+	uint32_t all, t;
+	int i;
+
+	all = (c->spec->n == 32) ? 0xffffffffu :
+	    ((uint32_t) 1 << c->spec->n) - 1;
+	for (t = 0, i = 0; i < c->spec->k; ++i)
+		t |= (uint32_t) 1 << random_bit(&st->pool, m & ~t);
+	for (; i < c->s; ++i)
+		t |= (uint32_t) 1 << random_bit(&st->pool, all & ~t);
+	return t;
+}
+
+static void
+evaluate(struct wstate *st)
+{
+	const struct wctx *c = st->ctx;
+	size_t j;
+	int i;
+
+	st->uncovered = 0;
+	for (j = 0; j < c->nmset; ++j) {
+		st->cover[j] = 0;
+		for (i = 0; i < st->size; ++i)
+			st->cover[j] += covers(c, st->ticket[i], c->mset[j]);
+		st->uncovered += (st->cover[j] == 0);
+	}
+}
+
+static long
+delta(const struct wstate *st, uint32_t from, uint32_t to)
+{
+	const struct wctx *c = st->ctx;
+	size_t j;
+	long d = 0;
+	int a, b;
+
+	for (j = 0; j < c->nmset; ++j) {
+		a = covers(c, from, c->mset[j]);
+		b = covers(c, to, c->mset[j]);
+		d += (a && !b && st->cover[j] == 1);
+		d -= (!a && b && st->cover[j] == 0);
+	}
+	return d;
+}
+
+static void
+replace(struct wstate *st, int i, uint32_t to)
+{
+	const struct wctx *c = st->ctx;
+	uint32_t from;
+	size_t j;
+	int a, b;
+
+	from = st->ticket[i];
+	for (j = 0; j < c->nmset; ++j) {
+		a = covers(c, from, c->mset[j]);
+		b = covers(c, to, c->mset[j]);
+		st->cover[j] += b - a;
+		st->uncovered += (a && !b && st->cover[j] == 0);
+		st->uncovered -= (!a && b && st->cover[j] == 1);
+	}
+	st->ticket[i] = to;
+}
+
+static uint32_t
+uncovered_mset(struct wstate *st)
+{
+	const struct wctx *c = st->ctx;
+	size_t j, start;
+
+	start = pool_bounded(&st->pool, c->nmset);
+	for (j = start; st->cover[j] != 0; )
+		if (++j == c->nmset)
+			j = 0;
+	return c->mset[j];
+}
+
+static void
+greedy(struct wstate *st)
+{
+	const struct wctx *c = st->ctx;
+	uint32_t t, best;
+	size_t j, gain, bestgain;
+	int r;
+
+	st->size = 0;
+	evaluate(st);
+	while (st->uncovered > 0) {
+		best = 0;
+		bestgain = 0;
+		for (r = 0; r < WHEEL_CANDIDATES; ++r) {
+			t = candidate(st, uncovered_mset(st));
+			for (gain = 0, j = 0; j < c->nmset; ++j)
+				gain += (st->cover[j] == 0 &&
+				    covers(c, t, c->mset[j]));
+			if (gain > bestgain) {
+				best = t;
+				bestgain = gain;
+			}
+		}
+		st->ticket[st->size++] = best;
+		for (j = 0; j < c->nmset; ++j) {
+			if (covers(c, best, c->mset[j]) &&
+			    st->cover[j]++ == 0)
+				--st->uncovered;
+		}
+	}
+}
+
+static bool
+expired(const struct wctx *c)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec > c->deadline.tv_sec ||
+	    (now.tv_sec == c->deadline.tv_sec &&
+	    now.tv_nsec >= c->deadline.tv_nsec));
+}
+
+/*
+ * Moves one number of a random ticket towards a random uncovered
+ * m-subset, accepting worse wheels with the Metropolis rule.  An
+ * uncovered m-subset is neither inside a ticket nor around one, or the
+ * ticket would cover it, so both masks given to random_bit() are set.
+ */
+static bool
+anneal(struct wstate *st)
+{
+	const struct wctx *c = st->ctx;
+	uint32_t from, to, m;
+	double temp, cool;
+	long d;
+	int i, n;
+
+	temp = WHEEL_TSTART;
+	cool = pow(WHEEL_TEND / WHEEL_TSTART, 1.0 / WHEEL_MOVES);
+	for (n = 0; n < WHEEL_MOVES && st->uncovered > 0; ++n) {
+		if (n % WHEEL_CHECK == 0 && expired(c))
+			return false;
+		i = pool_bounded(&st->pool, st->size);
+		from = st->ticket[i];
+		m = uncovered_mset(st);
+		to = from & ~((uint32_t) 1 << random_bit(&st->pool,
+		    from & ~m));
+		to |= (uint32_t) 1 << random_bit(&st->pool, m & ~from);
+		d = delta(st, from, to);
+		if (d <= 0 || pool_u32(&st->pool) <
+		    exp(-d / temp) * 4294967296.0)
+			replace(st, i, to);
+		temp *= cool;
+	}
+	return st->uncovered == 0;
+}
+
+static void *
+improve(void *arg)
+{
+	struct wstate *st = arg;
+	struct wctx *c = st->ctx;
+	bool restart;
+	int drop;
+
+	pool_init(&st->pool);
+	st->size = 0;
+	while (!expired(c)) {
+		pthread_mutex_lock(&c->lock);
+		if (st->size != c->bestsize - 1) {
+			st->size = c->bestsize - 1;
+			memcpy(st->ticket, c->best,
+			    c->bestsize * sizeof(uint32_t));
+			restart = true;
+		} else
+			restart = false;
+		pthread_mutex_unlock(&c->lock);
+		if (st->size < 1)
+			break;
+
+		if (restart) {
+			drop = pool_bounded(&st->pool, st->size + 1);
+			st->ticket[drop] = st->ticket[st->size];
+			evaluate(st);
+		}
+		if (!anneal(st))
+			continue;
+
+		pthread_mutex_lock(&c->lock);
+		if (st->size < c->bestsize) {
+			memcpy(c->best, st->ticket,
+			    st->size * sizeof(uint32_t));
+			c->bestsize = st->size;
+		}
+		pthread_mutex_unlock(&c->lock);
+	}
+	return NULL;
+}
+
+static int
+new_state(struct wstate *st, struct wctx *c, size_t maxsize)
+{
+	st->ctx = c;
+	st->ticket = malloc(maxsize * sizeof(uint32_t));
+	st->cover = malloc(c->nmset * sizeof(uint32_t));
+	if (st->ticket == NULL || st->cover == NULL)
+		return -1;
+	return 0;
+}
+
+static void
+free_state(struct wstate *st)
+{
+	free(st->ticket);
+	free(st->cover);
+}
+
+static int
+check_spec(const struct wheel_spec *spec)
+{
+	const struct game *g;
+	int i;
+
+	if (spec->game < 0 || spec->game >= NGAMES)
+		return -1;
+	g = &games[spec->game];
+	if (spec->n < g->sample || spec->n > WHEEL_MAXN ||
+	    spec->k < 1 || spec->k > spec->m || spec->m > g->sample)
+		return -1;
+	for (i = 0; i < spec->n; ++i)
+		if (spec->numbers[i] < 1 || spec->numbers[i] > g->number ||
+		    (i > 0 && spec->numbers[i] <= spec->numbers[i - 1]))
+			return -1;
+	return 0;
+}
+
+/*
+ * Builds a wheel for spec->numbers (ascending) within spec->seconds.
+ * Bit b of every ticket in w stands for spec->numbers[b].
+ */
+int
+wheel_build(const struct wheel_spec *spec, struct wheel *w)
+{
+	struct wctx c;
+	struct wstate *st;
+	pthread_t *tid;
+	size_t maxsize;
+	int i, nthreads, r = -1;
+
+	if (check_spec(spec) == -1) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(&c, 0, sizeof(c));
+	c.spec = spec;
+	c.s = games[spec->game].sample;
+	if (make_msets(&c) == -1)
+		return -1;
+	maxsize = c.nmset;
+	nthreads = spec->threads > 0 ? spec->threads :
+	    (int) sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = MAX(nthreads, 1);
+	st = calloc(nthreads, sizeof(*st));
+	tid = calloc(nthreads, sizeof(*tid));
+	c.best = malloc(maxsize * sizeof(uint32_t));
+	if (st == NULL || tid == NULL || c.best == NULL)
+		goto out;
+	for (i = 0; i < nthreads; ++i)
+		if (new_state(&st[i], &c, maxsize) == -1)
+			goto out;
+
+	clock_gettime(CLOCK_MONOTONIC, &c.deadline);
+	c.deadline.tv_sec += (time_t) spec->seconds;
+	c.deadline.tv_nsec += (long) ((spec->seconds -
+	    (time_t) spec->seconds) * 1e9);
+	if (c.deadline.tv_nsec >= 1000000000L) {
+		c.deadline.tv_nsec -= 1000000000L;
+		++c.deadline.tv_sec;
+	}
+
+	pool_init(&st[0].pool);
+	greedy(&st[0]);
+	memcpy(c.best, st[0].ticket, st[0].size * sizeof(uint32_t));
+	c.bestsize = st[0].size;
+
+	pthread_mutex_init(&c.lock, NULL);
+	for (i = 0; i < nthreads; ++i)
+		if (pthread_create(&tid[i], NULL, improve, &st[i]) != 0)
+			break;
+	nthreads = i;
+	for (i = 0; i < nthreads; ++i)
+		pthread_join(tid[i], NULL);
+	pthread_mutex_destroy(&c.lock);
+
+	w->size = c.bestsize;
+	w->ticket = c.best;
+	c.best = NULL;
+	r = 0;
+out:
+	if (st != NULL)
+		for (i = 0; i < nthreads; ++i)
+			free_state(&st[i]);
+	free(st);
+	free(tid);
+	free(c.best);
+	free(c.mset);
+	return r;
+}
+
+static int
+xpick(struct pool *p, const struct game *g, const vector x, int n)
+{
+	int i, k;
+
+	do {
+		k = pool_bounded(p, g->xnumber) + 1;
+		for (i = 0; i < n && x[i] != k; ++i)
+			;
+	} while (i < n);
+	return k;
+}
+
+/*
+ * Writes the wheel to a ticket file.  The numbers for a second machine
+ * are not part of the wheel and are quick picked.
+ */
+int
+wheel_save(const struct wheel_spec *spec, const struct wheel *w,
+    const char *path)
+{
+	const struct game *g;
+	struct tkfile *tk;
+	struct pool pool;
+	uint32_t t;
+	int v[GAME_MAXPICK + GAME_MAXBONUS];
+	int i, b, n;
+
+	g = &games[spec->game];
+	if ((tk = tk_create(path, spec->game)) == NULL)
+		return -1;
+	pool_init(&pool);
+	for (i = 0; i < w->size; ++i) {
+		for (n = 0, t = w->ticket[i]; t != 0; t &= t - 1) {
+			b = __builtin_ctz(t);
+			v[n++] = spec->numbers[b];
+		}
+		for (b = 0; b < g->xsample; ++b, ++n)
+			v[n] = xpick(&pool, g, v + g->sample, b);
+		distsort(g->xsample, v + g->sample, v + g->sample);
+		if (tk_write(tk, v, 1) == -1) {
+			tk_close(tk);
+			return -1;
+		}
+	}
+	return tk_close(tk);
+}
+
+void
+wheel_free(struct wheel *w)
+{
+	free(w->ticket);
+	w->ticket = NULL;
+	w->size = 0;
+}
@@ -0,0 +1,30 @@
+/* wheel.h */
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stdint.h>
+
+#define WHEEL_MAXN 32
+
+struct wheel_spec {
+	int game;
+	int n;
+	int numbers[WHEEL_MAXN];
+	int k;
+	int m;
+	double seconds;
+	int threads;
+};
+
+struct wheel {
+	int size;
+	uint32_t *ticket;
+};
+
+int wheel_build(const struct wheel_spec *spec, struct wheel *w);
+int wheel_save(const struct wheel_spec *spec, const struct wheel *w,
+    const char *path);
+void wheel_free(struct wheel *w);
+
+#endif /* WHEEL_H */